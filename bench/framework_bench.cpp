@@ -0,0 +1,246 @@
+// Measures the framework's own hot paths and writes the results as JSON.
+//
+//   bench/framework_bench [report.json]
+//
+// The program never calls RUN_ALL_TESTS: it registers its tests itself and
+// runs assertions with one of them installed as the current test.
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "gtest.h"
+#include "gtest_internal_impl.h"
+
+namespace {
+
+using testing::internal::Int64;
+using testing::internal::GetTimeInNanos;
+
+const int kRegisteredTestCases = 1000;
+const int kTestsPerTestCase = 100;
+const int kRepetitions = 5;
+const Int64 kMinBatchNanos = 50 * 1000 * 1000;
+
+class EmptyTest : public testing::Test {
+ private:
+  virtual void TestBody() {}
+};
+
+class CountingListener : public testing::EmptyTestEventListener {
+ public:
+  CountingListener() : parts_(0) {}
+
+  virtual void OnTestPartResult(const testing::TestPartResult& /*result*/) {
+    ++parts_;
+  }
+
+ private:
+  Int64 parts_;
+};
+
+struct Result {
+  std::string name;
+  Int64 operations;
+  double nanos_per_op;
+  double min_nanos_per_op;
+};
+
+std::vector<Result> results;
+
+void AddResult(const std::string& name, Int64 operations,
+               const std::vector<double>& samples) {
+  std::vector<double> sorted(samples);
+  std::sort(sorted.begin(), sorted.end());
+  const Result result = { name, operations, sorted[sorted.size() / 2],
+                          sorted.front() };
+  results.push_back(result);
+  printf("%-40s %12.1f ns/op  (min %.1f, %lld ops)\n", name.c_str(),
+         result.nanos_per_op, result.min_nanos_per_op,
+         static_cast<long long>(operations));
+  fflush(stdout);
+}
+
+// Times op in batches grown until one takes kMinBatchNanos, reporting the
+// median of kRepetitions batches.  reset runs off the clock before each.
+template <typename Op, typename Reset>
+void Measure(const std::string& name, Op op, Reset reset) {
+  Int64 batch = 1;
+  for (;;) {
+    reset();
+    const Int64 start = GetTimeInNanos();
+    for (Int64 i = 0; i < batch; ++i)
+      op();
+    const Int64 nanos = GetTimeInNanos() - start;
+    if (nanos >= kMinBatchNanos)
+      break;
+    batch = nanos <= 0 ? batch * 10 :
+        std::max(batch + 1, std::min(batch * 10, static_cast<Int64>(
+            1.2 * batch * kMinBatchNanos / nanos)));
+  }
+
+  std::vector<double> samples;
+  for (int r = 0; r < kRepetitions; ++r) {
+    reset();
+    const Int64 start = GetTimeInNanos();
+    for (Int64 i = 0; i < batch; ++i)
+      op();
+    samples.push_back(static_cast<double>(GetTimeInNanos() - start) / batch);
+  }
+  AddResult(name, batch * kRepetitions, samples);
+}
+
+template <typename Op>
+void Measure(const std::string& name, Op op) {
+  Measure(name, op, [] {});
+}
+
+// Registers kRegisteredTestCases * kTestsPerTestCase tests, returning the
+// last one.  Registration can only happen once, so this is a single sample.
+testing::TestInfo* BenchmarkRegistration() {
+  std::vector<std::string> case_names;
+  std::vector<std::string> test_names;
+  for (int i = 0; i < kRegisteredTestCases; ++i)
+    case_names.push_back("Registered" + testing::PrintToString(i));
+  for (int i = 0; i < kTestsPerTestCase; ++i)
+    test_names.push_back("Test" + testing::PrintToString(i));
+
+  testing::TestInfo* test_info = NULL;
+  const Int64 start = GetTimeInNanos();
+  for (int i = 0; i < kRegisteredTestCases; ++i) {
+    for (int j = 0; j < kTestsPerTestCase; ++j) {
+      test_info = testing::internal::MakeAndRegisterTestInfo(
+          case_names[i].c_str(), test_names[j].c_str(),
+          testing::internal::CodeLocation(__FILE__, __LINE__),
+          EmptyTest::SetUpTestCase, EmptyTest::TearDownTestCase,
+          new testing::internal::TestFactoryImpl<EmptyTest>);
+    }
+  }
+  const Int64 count = static_cast<Int64>(kRegisteredTestCases) *
+      kTestsPerTestCase;
+  AddResult("register_tests/count:" + testing::PrintToString(count), count,
+            std::vector<double>(1, static_cast<double>(
+                GetTimeInNanos() - start) / count));
+  return test_info;
+}
+
+void BenchmarkCountQueries() {
+  const testing::UnitTest& unit_test = *testing::UnitTest::GetInstance();
+  volatile int sink = 0;
+  Measure("count/total_test_count",
+          [&] { sink = unit_test.total_test_count(); });
+  Measure("count/test_to_run_count",
+          [&] { sink = unit_test.test_to_run_count(); });
+  Measure("count/successful_test_count",
+          [&] { sink = unit_test.successful_test_count(); });
+  Measure("count/failed_test_count",
+          [&] { sink = unit_test.failed_test_count(); });
+  Measure("count/total_test_case_count",
+          [&] { sink = unit_test.total_test_case_count(); });
+  (void)sink;
+}
+
+void BenchmarkAssertions() {
+  testing::internal::UnitTestImpl* const impl =
+      testing::internal::GetUnitTestImpl();
+  volatile int one = 1;
+  volatile int two = 2;
+  Measure("expect_eq/pass", [&] { EXPECT_EQ(one, one); });
+
+  // Failures are recorded in the current test's result, which is emptied
+  // between batches.
+  auto clear = [impl] { impl->ClearNonAdHocTestResult(); };
+  Measure("expect_eq/fail", [&] { EXPECT_EQ(one, two) << "message"; },
+          clear);
+
+  testing::TestEventListeners& listeners =
+      testing::UnitTest::GetInstance()->listeners();
+  std::vector<CountingListener*> appended;
+  const int kListenerCounts[] = { 1, 8, 64 };
+  for (size_t i = 0; i < sizeof(kListenerCounts) / sizeof(int); ++i) {
+    while (static_cast<int>(appended.size()) < kListenerCounts[i]) {
+      appended.push_back(new CountingListener);
+      listeners.Append(appended.back());
+    }
+    Measure("repeater_dispatch/listeners:" +
+                testing::PrintToString(kListenerCounts[i]),
+            [&] { EXPECT_EQ(one, two); }, clear);
+  }
+  for (size_t i = 0; i < appended.size(); ++i)
+    delete listeners.Release(appended[i]);
+  clear();
+}
+
+void BenchmarkPrinting() {
+  const int integer = 123456;
+  const double real = 3.25;
+  const bool boolean = true;
+  const char* const c_string = "hello, world";
+  const std::string string(64, 'x');
+  volatile size_t sink = 0;
+  Measure("print_to_string/int",
+          [&] { sink = testing::PrintToString(integer).size(); });
+  Measure("print_to_string/double",
+          [&] { sink = testing::PrintToString(real).size(); });
+  Measure("print_to_string/bool",
+          [&] { sink = testing::PrintToString(boolean).size(); });
+  Measure("print_to_string/const_char_ptr",
+          [&] { sink = testing::PrintToString(c_string).size(); });
+  Measure("print_to_string/string:64",
+          [&] { sink = testing::PrintToString(string).size(); });
+  (void)sink;
+}
+
+bool WriteReport(const char* path) {
+  FILE* const file = fopen(path, "w");
+  if (file == NULL)
+    return false;
+
+  fprintf(file, "{\n  \"benchmarks\": [\n");
+  for (size_t i = 0; i < results.size(); ++i) {
+    fprintf(file, "    {\"name\": \"%s\", \"operations\": %lld, "
+            "\"ns_per_op\": %.2f, \"min_ns_per_op\": %.2f}%s\n",
+            results[i].name.c_str(),
+            static_cast<long long>(results[i].operations),
+            results[i].nanos_per_op, results[i].min_nanos_per_op,
+            i + 1 < results.size() ? "," : "");
+  }
+  fprintf(file, "  ]\n}\n");
+  return fclose(file) == 0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  // InitGoogleTest takes out the flags it knows; ones it doesn't are
+  // skipped, so the report path is the first argument that isn't a flag.
+  testing::InitGoogleTest(&argc, argv);
+  const char* report_path = "framework_bench.json";
+  for (int i = 1; i < argc; ++i) {
+    if (argv[i][0] != '-') {
+      report_path = argv[i];
+      break;
+    }
+  }
+
+  testing::TestInfo* const test_info = BenchmarkRegistration();
+  BenchmarkCountQueries();
+
+  // Assertions need a current test, and failures shouldn't be printed.
+  testing::TestEventListeners& listeners =
+      testing::UnitTest::GetInstance()->listeners();
+  delete listeners.Release(listeners.default_result_printer());
+  testing::internal::GetUnitTestImpl()->set_current_test_info(test_info);
+  BenchmarkAssertions();
+  BenchmarkPrinting();
+  testing::internal::GetUnitTestImpl()->set_current_test_info(NULL);
+
+  if (!WriteReport(report_path)) {
+    fprintf(stderr, "Unable to write %s\n", report_path);
+    return 1;
+  }
+  printf("Wrote %s\n", report_path);
+  return 0;
+}
@@ -1,10 +1,22 @@
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 #include <string>
 #include <stdarg.h>
 
 // #include "gtest.h"
+#include "gtest_benchmark.h"
+#include "gtest_event_bus.h"
+#include "gtest_interleave.h"
+#include "gtest_isolation.h"
 #include "gtest_internal_impl.h"
+#include "gtest_output.h"
+#include "gtest_result_file.h"
+#include "gtest_stats.h"
+#include "gtest_stream.h"
+#include "gtest_stress.h"
+#include "gtest_virtual_clock.h"
+#include "gtest_watchdog.h"
 // #include "gtest_message.h"
 // #include "gtest_string.h"
 // #include "gtest_port.h"
@@ -27,6 +39,40 @@ GTEST_DEFINE_int32_(
     "How many times to repeat each test.  Specify a negative number "
     "for repeating forever.  Useful for shaking out flaky tests.");
 
+GTEST_DEFINE_bool_(
+    repeat_until_fail,
+    internal::BoolFromGTestEnv("repeat_until_fail", false),
+    "True iff repeating should stop after the first iteration with a "
+    "failure.  Without --gtest_repeat, repeats until then.  Under "
+    "--gtest_stress_threads, likewise for each test's repetitions.");
+
+GTEST_DEFINE_bool_(
+    shuffle,
+    internal::BoolFromGTestEnv("shuffle", false),
+    "True iff the test cases, and the tests within each, should run in a "
+    "random order, a new one each iteration.");
+
+GTEST_DEFINE_int32_(
+    random_seed,
+    internal::Int32FromGTestEnv("random_seed", 0),
+    "The seed of the first iteration, from 1 to 99999; each next iteration "
+    "takes the next seed.  0 picks one from the time under --gtest_shuffle. "
+    "The order and every test's random_seed() follow from it.");
+
+GTEST_DEFINE_string_(
+    filter,
+    internal::StringFromGTestEnv("filter", "*"),
+    "The tests to run, as ':'-separated patterns of their full names, where "
+    "'*' matches any string and '?' any character.  Patterns after a '-' "
+    "leave the tests they match out.");
+
+GTEST_DEFINE_bool_(
+    print_sync,
+    internal::BoolFromGTestEnv("print_sync", true),
+    "Writes out the result printer's output before each test runs, so that "
+    "the test's own output follows its RUN line.  Turn off for suites of "
+    "many quiet tests, whose results are then written in a few batches.");
+
 } // namespace internal
 
 AssertionResult AssertionSuccess() {
@@ -59,13 +105,90 @@ static bool ShouldRunTestCase(const TestCase* test_case) {
   return test_case->should_run();
 }
 
+// Returns true if name matches pattern, up to pattern_end, where '*'
+// matches any string and '?' any one character.
+static bool PatternMatches(const char* pattern, const char* pattern_end,
+                           const char* name) {
+  if (pattern == pattern_end)
+    return *name == '\0';
+  switch (*pattern) {
+    case '*':
+      return PatternMatches(pattern + 1, pattern_end, name) ||
+          (*name != '\0' && PatternMatches(pattern, pattern_end, name + 1));
+    case '?':
+      return *name != '\0' &&
+          PatternMatches(pattern + 1, pattern_end, name + 1);
+    default:
+      return *pattern == *name &&
+          PatternMatches(pattern + 1, pattern_end, name + 1);
+  }
+}
+
+// Returns true if name matches one of the ':'-separated patterns.
+static bool MatchesAnyPattern(const std::string& patterns,
+                              const std::string& name) {
+  size_t start = 0;
+  for (;;) {
+    size_t end = patterns.find(':', start);
+    if (end == std::string::npos)
+      end = patterns.size();
+    if (PatternMatches(patterns.c_str() + start, patterns.c_str() + end,
+                       name.c_str())) {
+      return true;
+    }
+    if (end == patterns.size())
+      return false;
+    start = end + 1;
+  }
+}
+
+// Returns true if the test's full name passes filter, the positive
+// patterns before any '-' and none of the negative ones after it.
+static bool PassesFilter(const std::string& filter,
+                         const std::string& full_name) {
+  const size_t dash = filter.find('-');
+  const std::string positive = filter.substr(0, dash);
+  if (!MatchesAnyPattern(positive.empty() ? "*" : positive, full_name))
+    return false;
+  return dash == std::string::npos ||
+      !MatchesAnyPattern(filter.substr(dash + 1), full_name);
+}
+
+// Returns how many times the suite runs, or -1 for until it's stopped.
+// Under --gtest_stress_threads each stressed test repeats on its own
+// instead, and the rest run once.
+static int IterationsToRun() {
+  if (internal::GTEST_FLAG(stress_threads) > 0)
+    return 1;
+  if (internal::GTEST_FLAG(repeat_until_fail) &&
+      internal::GTEST_FLAG(repeat) == 1)
+    return -1;
+  return internal::GTEST_FLAG(repeat);
+}
+
+// Returns how many repetitions a test runs in all under
+// --gtest_stress_threads, or -1 for until it fails.  --gtest_repeat sets
+// the total, but each thread gets at least one.
+static int StressRepetitions() {
+  const int threads = internal::GTEST_FLAG(stress_threads);
+  const int repeat = internal::GTEST_FLAG(repeat);
+  if (repeat < 0 || (internal::GTEST_FLAG(repeat_until_fail) && repeat == 1))
+    return -1;
+  return std::max(repeat, threads);
+}
+
+static void SetUpEnvironment(Environment* env) { env->SetUp(); }
+static void TearDownEnvironment(Environment* env) { env->TearDown(); }
+
 namespace internal {
 
+// Keeps a dispatch list per event, so an event only reaches the listeners
+// that handle it and the per-test events skip the rest for free.
 class TestEventRepeater : public TestEventListener {
  public:
   TestEventRepeater() : forwarding_enabled_(true) {}
   virtual ~TestEventRepeater();
-  void Append(TestEventListener* listener);
+  void Append(TestEventListener* listener, int events);
   TestEventListener* Release(TestEventListener* listener);
 
   bool forwarding_enabled() const { return forwarding_enabled_; }
@@ -86,8 +209,17 @@ class TestEventRepeater : public TestEventListener {
   virtual void OnTestProgramEnd(const UnitTest& unit_test);
 
  private:
+  static const int kEventCount = 13;
+
+  // The dispatch list of the event with the given TestEvent bit.
+  std::vector<TestEventListener*>& listeners_for(int event) {
+    return dispatch_[__builtin_ctz(event)];
+  }
+
   bool forwarding_enabled_;
+  // Every listener, in the order appended.  The repeater owns them.
   std::vector<TestEventListener*> listeners_;
+  std::vector<TestEventListener*> dispatch_[kEventCount];
 
   GTEST_DISALLOW_COPY_AND_ASSIGN_(TestEventRepeater);
 };
@@ -96,26 +228,36 @@ TestEventRepeater::~TestEventRepeater() {
   ForEach(listeners_, Delete<TestEventListener>);
 }
 
-void TestEventRepeater::Append(TestEventListener* listener) {
+void TestEventRepeater::Append(TestEventListener* listener, int events) {
   listeners_.push_back(listener);
+  for (int i = 0; i < kEventCount; ++i) {
+    if (events & (1 << i))
+      dispatch_[i].push_back(listener);
+  }
 }
 
 TestEventListener* TestEventRepeater::Release(TestEventListener* listener) {
-  for (size_t i = 0; i < listeners_.size(); ++i) {
-    if (listeners_[i] == listener) {
-      listeners_.erase(listeners_.begin() + i);
-      return listener;
-    }
+  std::vector<TestEventListener*>::iterator it =
+      std::find(listeners_.begin(), listeners_.end(), listener);
+  if (it == listeners_.end())
+    return NULL;
+
+  listeners_.erase(it);
+  for (int i = 0; i < kEventCount; ++i) {
+    dispatch_[i].erase(std::remove(dispatch_[i].begin(), dispatch_[i].end(),
+                                   listener),
+                       dispatch_[i].end());
   }
-
-  return NULL;
+  return listener;
 }
 
 #define GTEST_REPEATER_METHOD_(Name, Type) \
 void TestEventRepeater::Name(const Type& parameter) { \
   if (forwarding_enabled_) { \
-    for (size_t i = 0; i < listeners_.size(); ++i) { \
-      listeners_[i]->Name(parameter); \
+    const std::vector<TestEventListener*>& listeners = \
+        listeners_for(k##Name); \
+    for (size_t i = 0; i < listeners.size(); ++i) { \
+      listeners[i]->Name(parameter); \
     } \
   } \
 }
@@ -123,8 +265,10 @@ void TestEventRepeater::Name(const Type& parameter) { \
 #define GTEST_REVERSE_REPEATER_METHOD_(Name, Type) \
 void TestEventRepeater::Name(const Type& parameter) { \
   if (forwarding_enabled_) { \
-    for (int i = static_cast<int>(listeners_.size()) - 1; i >= 0; --i) {\
-      listeners_[i]->Name(parameter); \
+    const std::vector<TestEventListener*>& listeners = \
+        listeners_for(k##Name); \
+    for (int i = static_cast<int>(listeners.size()) - 1; i >= 0; --i) { \
+      listeners[i]->Name(parameter); \
     } \
   } \
 }
@@ -147,8 +291,10 @@ GTEST_REVERSE_REPEATER_METHOD_(OnTestProgramEnd, UnitTest)
 void TestEventRepeater::OnTestIterationStart(const UnitTest& unit_test,
                                              int iteration) {
   if (forwarding_enabled_) {
-    for (size_t i = 0; i < listeners_.size(); ++i) {
-      listeners_[i]->OnTestIterationStart(unit_test, iteration);
+    const std::vector<TestEventListener*>& listeners =
+        listeners_for(kOnTestIterationStart);
+    for (size_t i = 0; i < listeners.size(); ++i) {
+      listeners[i]->OnTestIterationStart(unit_test, iteration);
     }
   }
 }
@@ -156,8 +302,10 @@ void TestEventRepeater::OnTestIterationStart(const UnitTest& unit_test,
 void TestEventRepeater::OnTestIterationEnd(const UnitTest& unit_test,
                                            int iteration) {
   if (forwarding_enabled_) {
-    for (int i = static_cast<int>(listeners_.size()) - 1; i > 0; --i) {
-      listeners_[i]->OnTestIterationEnd(unit_test, iteration);
+    const std::vector<TestEventListener*>& listeners =
+        listeners_for(kOnTestIterationEnd);
+    for (int i = static_cast<int>(listeners.size()) - 1; i >= 0; --i) {
+      listeners[i]->OnTestIterationEnd(unit_test, iteration);
     }
   }
 }
@@ -166,16 +314,22 @@ void TestEventRepeater::OnTestIterationEnd(const UnitTest& unit_test,
 
 TestEventListeners::TestEventListeners()
     : repeater_(new internal::TestEventRepeater()),
+      async_bus_(NULL),
       default_result_printer_(NULL),
       default_xml_generator_(NULL) {
 }
 
 TestEventListeners::~TestEventListeners() {
+  delete async_bus_;
   delete repeater_;
 }
 
 void TestEventListeners::Append(TestEventListener* listener) {
-  repeater_->Append(listener);
+  repeater_->Append(listener, listener->handled_events());
+}
+
+void TestEventListeners::Append(TestEventListener* listener, int events) {
+  repeater_->Append(listener, events);
 }
 
 TestEventListener* TestEventListeners::Release(TestEventListener* listener) {
@@ -187,6 +341,8 @@ TestEventListener* TestEventListeners::Release(TestEventListener* listener) {
 }
 
 TestEventListener* TestEventListeners::repeater() {
+  if (async_bus_ != NULL)
+    return async_bus_;
   return repeater_;
 }
 
@@ -217,6 +373,11 @@ void TestEventListeners::SuppressEventForwarding() {
   repeater_->set_forwarding_enabled(false);
 }
 
+void TestEventListeners::EnableAsyncDispatch() {
+  if (async_bus_ == NULL)
+    async_bus_ = new internal::AsyncEventBus(repeater_);
+}
+
 static std::string FormatCountableNoun(int count,
                                        const char* singular_form,
                                        const char* plural_form) {
@@ -255,11 +416,11 @@ static std::string PrintTestPartResultToString(
           << test_part_result.message()).GetString();
 }
 
-static void PrintTestPartResult(const TestPartResult& test_part_result) {
+static void PrintTestPartResult(AsyncFdWriter* out,
+                                const TestPartResult& test_part_result) {
   const std::string& result =
       PrintTestPartResultToString(test_part_result);
-  printf("%s\n", result.c_str());
-  fflush(stdout);
+  out->Printf("%s\n", result.c_str());
 }
 
 enum GTestColor {
@@ -283,7 +444,8 @@ bool ShouldUseColor(bool stdout_is_tty) {
   return true;
 }
 
-static void ColoredPrintf(GTestColor color, const char* fmt, ...) {
+static void ColoredPrintf(AsyncFdWriter* out, GTestColor color,
+                          const char* fmt, ...) {
   va_list args;
   va_start(args, fmt);
 
@@ -298,7 +460,7 @@ static void ColoredPrintf(GTestColor color, const char* fmt, ...) {
   // The '!= 0' comparison is necessary to satisfy MSVC 7.1.
 
   if (!use_color) {
-    vprintf(fmt, args);
+    out->VPrintf(fmt, args);
     va_end(args);
     return;
   }
@@ -316,18 +478,18 @@ static void ColoredPrintf(GTestColor color, const char* fmt, ...) {
   // We need to flush the stream buffers into the console before each
   // SetConsoleTextAttribute call lest it affect the text that is already
   // printed but has not yet reached the console.
-  fflush(stdout);
+  out->Flush();
   SetConsoleTextAttribute(stdout_handle, new_color);
 
-  vprintf(fmt, args);
+  out->VPrintf(fmt, args);
 
-  fflush(stdout);
+  out->Flush();
   // Restores the text color.
   SetConsoleTextAttribute(stdout_handle, old_color_attrs);
 #else
-  printf("\033[0;3%sm", GetAnsiColorCode(color));
-  vprintf(fmt, args);
-  printf("\033[m");  // Resets the terminal to default.
+  out->Printf("\033[0;3%sm", GetAnsiColorCode(color));
+  out->VPrintf(fmt, args);
+  out->Printf("\033[m");  // Resets the terminal to default.
 #endif  // GTEST_OS_WINDOWS && !GTEST_OS_WINDOWS_MOBILE
   va_end(args);
 }
@@ -338,9 +500,16 @@ static void PrintFullTestCommentIfPresent(const TestInfo& test_info) {
 
 class PrettyUnitTestResultPrinter : public TestEventListener {
  public:
-  PrettyUnitTestResultPrinter() {}
-  static void PrintTestName(const char* test_case, const char* test) {
-    printf("%s.%s", test_case, test);
+  // Lines are written from a background thread; with --gtest_print_sync
+  // the queue is flushed before each test body runs.
+  PrettyUnitTestResultPrinter() : out_(stdout) {}
+  void PrintTestName(const char* test_case, const char* test) {
+    out_.Printf("%s.%s", test_case, test);
+  }
+
+  virtual int handled_events() const {
+    return kAllTestEvents & ~(kOnTestProgramStart | kOnEnvironmentsSetUpEnd |
+                              kOnEnvironmentsTearDownEnd);
   }
 
   virtual void OnTestProgramStart(const UnitTest& /*unit_test*/) {}
@@ -355,46 +524,62 @@ class PrettyUnitTestResultPrinter : public TestEventListener {
   virtual void OnEnvironmentsTearDownStart(const UnitTest& unit_test);
   virtual void OnEnvironmentsTearDownEnd(const UnitTest& /*unit_test*/) {}
   virtual void OnTestIterationEnd(const UnitTest& unit_test, int iteration);
-  virtual void OnTestProgramEnd(const UnitTest& /*unit_test*/) {}
+  virtual void OnTestProgramEnd(const UnitTest& /*unit_test*/) {
+    out_.Flush();
+  }
 
  private:
-  static void PrintFailedTests(const UnitTest& unit_test);
+  void PrintFailedTests(const UnitTest& unit_test);
+
+  AsyncFdWriter out_;
 };
 
 void PrettyUnitTestResultPrinter::OnTestIterationStart(
     const UnitTest& unit_test, int iteration) {
-  if (GTEST_FLAG(repeat) != 1)
-    printf("\nRepeating all tests (iteration %d) . . .\n\n", iteration + 1);
+  if (IterationsToRun() != 1)
+    out_.Printf("\nRepeating all tests (iteration %d) . . .\n\n",
+                iteration + 1);
+  if (internal::GTEST_FLAG(shuffle)) {
+    ColoredPrintf(&out_, COLOR_YELLOW,
+                  "Note: Randomizing tests' orders with a seed of %d .\n",
+                  unit_test.random_seed());
+  }
 
   // const char* const file
-  ColoredPrintf(COLOR_GREEN, "[==========] ");
-  printf("Running %s from %s.\n",
-         FormatTestCount(unit_test.test_to_run_count()).c_str(),
-         FormatTestCaseCount(unit_test.test_case_to_run_count()).c_str());
-  fflush(stdout);
+  ColoredPrintf(&out_, COLOR_GREEN, "[==========] ");
+  out_.Printf("Running %s from %s.\n",
+              FormatTestCount(unit_test.test_to_run_count()).c_str(),
+              FormatTestCaseCount(unit_test.test_case_to_run_count()).c_str());
+  out_.Commit();
 }
 
 void PrettyUnitTestResultPrinter::OnEnvironmentsSetUpStart(const UnitTest&) {
-  ColoredPrintf(COLOR_GREEN, "[----------] ");
-  printf("Global test environment set-up.\n");
-  fflush(stdout);
+  ColoredPrintf(&out_, COLOR_GREEN, "[----------] ");
+  out_.Printf("Global test environment set-up.\n");
+  out_.Commit();
 }
 
 void PrettyUnitTestResultPrinter::OnTestCaseStart(const TestCase& test_case) {
   const std::string counts =
       FormatCountableNoun(test_case.test_to_run_count(), "test", "tests");
-      ColoredPrintf(COLOR_GREEN, "[----------] ");
-      printf("%s from %s\n", counts.c_str(), test_case.name());
+      ColoredPrintf(&out_, COLOR_GREEN, "[----------] ");
+      out_.Printf("%s from %s\n", counts.c_str(), test_case.name());
       // if ()
 
-      fflush(stdout);
+      out_.Commit();
 }
 
 void PrettyUnitTestResultPrinter::OnTestStart(const TestInfo& test_info) {
-  ColoredPrintf(COLOR_GREEN, "[ RUN      ] ");
+  ColoredPrintf(&out_, COLOR_GREEN, "[ RUN      ] ");
   PrintTestName(test_info.test_case_name(), test_info.name());
-  printf("\n");
-  fflush(stdout);
+  out_.Printf("\n");
+  // Captured output can't get ahead of the RUN line, so it needn't wait.
+  if (GTEST_FLAG(print_sync) &&
+      GetUnitTestImpl()->output_capture() == NULL) {
+    out_.Flush();
+  } else {
+    out_.Commit();
+  }
 }
 
 void PrettyUnitTestResultPrinter::OnTestPartResult(
@@ -402,36 +587,43 @@ void PrettyUnitTestResultPrinter::OnTestPartResult(
   if (result.type() == TestPartResult::kSuccess)
     return;
 
-  PrintTestPartResult(result);
-  fflush(stdout);
+  PrintTestPartResult(&out_, result);
+  out_.Commit();
 }
 
 void PrettyUnitTestResultPrinter::OnTestEnd(const TestInfo& test_info) {
+  const std::string& output = test_info.result()->captured_output();
+  if (!output.empty()) {
+    out_.Write(output.data(), output.size());
+    if (output[output.size() - 1] != '\n')
+      out_.Printf("\n");
+  }
+
   if (test_info.result()->Passed()) {
-    ColoredPrintf(COLOR_GREEN, "[       OK ] ");
+    ColoredPrintf(&out_, COLOR_GREEN, "[       OK ] ");
   } else {
-    ColoredPrintf(COLOR_RED, "[  FAILED  ] ");
+    ColoredPrintf(&out_, COLOR_RED, "[  FAILED  ] ");
   }
   PrintTestName(test_info.test_case_name(), test_info.name());
   if (test_info.result()->Failed())
     PrintFullTestCommentIfPresent(test_info);
 
-  printf("\n");
-  fflush(stdout);
+  out_.Printf("\n");
+  out_.Commit();
 }
 
 void PrettyUnitTestResultPrinter::OnTestCaseEnd(const TestCase& test_case) {
   const std::string counts =
       FormatCountableNoun(test_case.test_to_run_count(), "test", "tests");
-      ColoredPrintf(COLOR_GREEN, "[----------] ");
-      printf("%s from %s\n\n", counts.c_str(), test_case.name());
-      fflush(stdout);
+      ColoredPrintf(&out_, COLOR_GREEN, "[----------] ");
+      out_.Printf("%s from %s\n\n", counts.c_str(), test_case.name());
+      out_.Commit();
 }
 
 void PrettyUnitTestResultPrinter::OnEnvironmentsTearDownStart(const UnitTest&) {
-  ColoredPrintf(COLOR_GREEN, "[----------] ");
-  printf("Global test environment tear-down");
-  fflush(stdout);
+  ColoredPrintf(&out_, COLOR_GREEN, "[----------] ");
+  out_.Printf("Global test environment tear-down\n");
+  out_.Commit();
 }
 
 void PrettyUnitTestResultPrinter::PrintFailedTests(const UnitTest& unit_test) {
@@ -450,37 +642,39 @@ void PrettyUnitTestResultPrinter::PrintFailedTests(const UnitTest& unit_test) {
       if (test_info.result()->Passed()) {
         continue;
       }
-      ColoredPrintf(COLOR_RED, "[  FAILED  ] ");
-      printf("%s.%s", test_case.name(), test_info.name());
+      ColoredPrintf(&out_, COLOR_RED, "[  FAILED  ] ");
+      out_.Printf("%s.%s", test_case.name(), test_info.name());
       PrintFullTestCommentIfPresent(test_info);
-      printf("\n");
+      out_.Printf("\n");
     }
   }
 }
 
 void PrettyUnitTestResultPrinter::OnTestIterationEnd(const UnitTest& unit_test,
                                                      int iteration) {
-  ColoredPrintf(COLOR_GREEN, "[==========] ");
-  printf("%s from %s ran.",
-         FormatTestCount(unit_test.test_to_run_count()).c_str(),
-         FormatTestCaseCount(unit_test.test_case_to_run_count()).c_str());
+  ColoredPrintf(&out_, COLOR_GREEN, "[==========] ");
+  out_.Printf("%s from %s ran.",
+              FormatTestCount(unit_test.test_to_run_count()).c_str(),
+              FormatTestCaseCount(unit_test.test_case_to_run_count()).c_str());
   // if ()
-  printf("\n");
-  ColoredPrintf(COLOR_GREEN, "[  PASSED  ] ");
-  printf("%s.\n", FormatTestCount(unit_test.successful_test_count()).c_str());
+  out_.Printf("\n");
+  ColoredPrintf(&out_, COLOR_GREEN, "[  PASSED  ] ");
+  out_.Printf("%s.\n",
+              FormatTestCount(unit_test.successful_test_count()).c_str());
 
   int num_failures = unit_test.failed_test_count();
-  if (unit_test.Passed()) {
+  if (!unit_test.Passed()) {
     const int failed_test_count = unit_test.failed_test_count();
-    ColoredPrintf(COLOR_RED, "[  FAILED  ] ");
-    printf("%s, listed below:\n", FormatTestCount(failed_test_count).c_str());
+    ColoredPrintf(&out_, COLOR_RED, "[  FAILED  ] ");
+    out_.Printf("%s, listed below:\n",
+                FormatTestCount(failed_test_count).c_str());
     PrintFailedTests(unit_test);
-    printf("\n%2d FAILED %s\n", num_failures,
-                        num_failures == 1 ? "TEST" : "TESTS");
+    out_.Printf("\n%2d FAILED %s\n", num_failures,
+                num_failures == 1 ? "TEST" : "TESTS");
   }
 
   // int 
-  fflush(stdout);
+  out_.Flush();
 }
 
 DefaultGlobalTestPartResultReporter::
@@ -509,7 +703,7 @@ void DefaultPerThreadTestPartResultReporter::ReportTestPartResult(
  * TestResult
  * member function implentation
  ************************************************/
-TestResult::TestResult() {
+TestResult::TestResult() : elapsed_time_(0) {
 }
 
 TestResult::~TestResult() {
@@ -531,6 +725,82 @@ void TestResult::AddTestPartResult(const TestPartResult& test_part_result) {
 
 void TestResult::Clear() {
   test_part_results_.clear();
+  test_properties_.clear();
+  elapsed_time_ = 0;
+  captured_output_.clear();
+}
+
+int TestResult::test_property_count() const {
+  return static_cast<int>(test_properties_.size());
+}
+
+const TestProperty& TestResult::GetTestProperty(int i) const {
+  if (i < 0 || i >= test_property_count())
+    internal::posix::Abort();
+  return test_properties_.at(i);
+}
+
+// Records a property, replacing the value of one with the same key.
+void TestResult::RecordProperty(const std::string& xml_element,
+                                const TestProperty& test_property) {
+  if (!ValidateTestProperty(xml_element, test_property))
+    return;
+
+  internal::MutexLock lock(&test_properties_mutex_);
+  for (size_t i = 0; i < test_properties_.size(); ++i) {
+    if (strcmp(test_properties_[i].key(), test_property.key()) == 0) {
+      test_properties_[i].SetValue(test_property.value());
+      return;
+    }
+  }
+  test_properties_.push_back(test_property);
+}
+
+static const char* const kReservedTestSuitesAttributes[] = {
+  "disabled", "errors", "failures", "name", "tests", "time", "timestamp"
+};
+
+static const char* const kReservedTestSuiteAttributes[] = {
+  "disabled", "errors", "failures", "name", "tests", "time"
+};
+
+static const char* const kReservedTestCaseAttributes[] = {
+  "classname", "name", "status", "time", "type_param", "value_param"
+};
+
+template <size_t kSize>
+static bool ArrayContains(const char* const (&array)[kSize],
+                          const char* key) {
+  for (size_t i = 0; i < kSize; ++i) {
+    if (strcmp(array[i], key) == 0)
+      return true;
+  }
+  return false;
+}
+
+// Adds a failure if the key is one of the element's own attributes.
+bool TestResult::ValidateTestProperty(const std::string& xml_element,
+                                      const TestProperty& test_property) {
+  const char* const key = test_property.key();
+  const bool reserved = xml_element == "testsuites" ?
+      ArrayContains(kReservedTestSuitesAttributes, key) :
+      xml_element == "testsuite" ?
+      ArrayContains(kReservedTestSuiteAttributes, key) :
+      ArrayContains(kReservedTestCaseAttributes, key);
+  if (reserved) {
+    GTEST_NONFATAL_FAILURE_("")
+        << "Reserved key used in RecordProperty(): " << key
+        << " is an attribute of the <" << xml_element << "> element";
+  }
+  return !reserved;
+}
+
+TimeInMillis TestResult::elapsed_time() const {
+  return elapsed_time_;
+}
+
+void TestResult::set_elapsed_time(TimeInMillis elapsed) {
+  elapsed_time_ = elapsed;
 }
 
 bool TestResult::Failed() const {
@@ -581,11 +851,23 @@ void Test::Run() {
   TestBody();
 }
 
+void Test::RecordProperty(const std::string& key, const std::string& value) {
+  UnitTest::GetInstance()->RecordProperty(key, value);
+}
+
+void Test::RecordProperty(const std::string& key, int value) {
+  RecordProperty(key, internal::StreamableToString(value));
+}
+
+// Stress threads add to the result under the UnitTest's mutex while
+// others read it here.
 bool Test::HasFatalFailure() {
+  internal::MutexLock lock(&UnitTest::GetInstance()->mutex_);
   return internal::GetUnitTestImpl()->current_test_result()->HasFatalFailure();
 }
 
 bool Test::HasNonfatalFalure() {
+  internal::MutexLock lock(&UnitTest::GetInstance()->mutex_);
   return internal::GetUnitTestImpl()->current_test_result()->
       HasNonfatalFalure();
 }
@@ -607,6 +889,10 @@ TestInfo::TestInfo(const std::string& test_case_name,
       name_(name),
       location_(a_code_location),
       factory_(factory),
+      id_(-1),
+      timeout_ms_(-1),
+      should_run_(true),
+      stressable_(true),
       result_() {}
 
 TestInfo::~TestInfo() {
@@ -619,10 +905,22 @@ TestInfo* MakeAndRegisterTestInfo (
     const char* test_case_name,
     const char* name,
     CodeLocation code_location,
+    SetUpTestCaseFunc set_up_tc,
+    TearDownTestCaseFunc tear_down_tc,
     TestFactoryBase* factory) {
   TestInfo* const test_info =
       new TestInfo(test_case_name, name, code_location, factory);
-  GetUnitTestImpl()->AddTestInfo(test_info);
+  GetUnitTestImpl()->AddTestInfo(set_up_tc, tear_down_tc, test_info);
+  return test_info;
+}
+
+TestInfo* SetTestTimeout(TestInfo* test_info, int timeout_ms) {
+  test_info->timeout_ms_ = timeout_ms;
+  return test_info;
+}
+
+TestInfo* ExcludeFromStress(TestInfo* test_info) {
+  test_info->stressable_ = false;
   return test_info;
 }
 
@@ -655,10 +953,14 @@ void TestInfo::Run() {
 
   repeater->OnTestStart(*this);
 
-  Test* const test = factory_->CreateTest();
-  if (test != NULL) {
-    test->Run();
-    delete test;
+  internal::WorkerSupervisor* const supervisor = impl->worker_supervisor();
+  if (supervisor != NULL) {
+    internal::WorkerTestOutcome outcome;
+    supervisor->RunTest(this, &outcome);
+    result_.set_elapsed_time(outcome.elapsed_time);
+    result_.set_captured_output(outcome.captured_output);
+  } else {
+    Execute();
   }
 
   repeater->OnTestEnd(*this);
@@ -666,6 +968,61 @@ void TestInfo::Run() {
   impl->set_current_test_info(NULL);
 }
 
+void TestInfo::Execute() {
+  internal::UnitTestImpl* const impl = internal::GetUnitTestImpl();
+  internal::OutputCapture* const capture = impl->output_capture();
+  if (capture != NULL)
+    capture->Begin();
+
+  const int timeout_ms = timeout_to_apply();
+  internal::TestWatchdog* const watchdog =
+      timeout_ms > 0 ? impl->watchdog() : NULL;
+  if (watchdog != NULL)
+    watchdog->Arm(this, timeout_ms);
+
+  const internal::Int64 start = internal::GetTimeInNanos();
+  const internal::Int64 virtual_start = internal::VirtualNanosSkipped();
+  const int stress_threads = internal::GTEST_FLAG(stress_threads);
+  if (stress_threads > 0 && stressable_) {
+    internal::StressRunner runner(factory_, stress_threads,
+                                  StressRepetitions());
+    const internal::Int64 repetitions = runner.Run();
+    Test::RecordProperty("stress_repetitions",
+                         internal::StreamableToString(repetitions));
+  } else {
+    Test* const test = factory_->CreateTest();
+    if (test != NULL) {
+      test->Run();
+      delete test;
+    }
+  }
+  if (watchdog != NULL)
+    watchdog->Disarm();
+  result_.set_elapsed_time((internal::GetTimeInNanos() - start) / 1000000);
+  // The elapsed time is what the test really took; the time its virtual
+  // clocks skipped is reported beside it.
+  const internal::Int64 virtual_nanos =
+      internal::VirtualNanosSkipped() - virtual_start;
+  if (virtual_nanos > 0) {
+    Test::RecordProperty("virtual_time_ms",
+                         internal::StreamableToString(virtual_nanos / 1000000));
+  }
+
+  if (capture != NULL) {
+    result_.set_captured_output(
+        capture->End(result_.Failed(), internal::GTEST_FLAG(capture_limit)));
+  }
+}
+
+int TestInfo::timeout_to_apply() const {
+  return timeout_ms_ >= 0 ? timeout_ms_ : internal::GTEST_FLAG(test_timeout);
+}
+
+int TestInfo::random_seed() const {
+  return internal::TestRandomSeed(internal::GetUnitTestImpl()->random_seed(),
+                                  id_);
+}
+
 /************************************************
  * end of TestInfo
  ************************************************/
@@ -691,8 +1048,12 @@ int TestCase::test_to_run_count() const {
   return CountIf(test_info_list_, ShouldRunTest);
 }
 
-TestCase::TestCase(const char *name)
-    : name_(name) {}
+TestCase::TestCase(const char *name, Test::SetUpTestCaseFunc set_up_tc,
+                   Test::TearDownTestCaseFunc tear_down_tc)
+    : name_(name),
+      set_up_tc_(set_up_tc),
+      tear_down_tc_(tear_down_tc),
+      elapsed_time_(0) {}
 
 TestCase::~TestCase() {
   ForEach(test_info_list_, internal::Delete<TestInfo>);
@@ -713,7 +1074,19 @@ void TestCase::AddTestInfo(TestInfo* test_info) {
   test_indices_.push_back(static_cast<int>(test_indices_.size()));
 }
 
+void TestCase::ShuffleTests(internal::Random* random) {
+  internal::Shuffle(random, &test_indices_);
+}
+
+void TestCase::UnshuffleTests() {
+  for (size_t i = 0; i < test_indices_.size(); ++i)
+    test_indices_[i] = static_cast<int>(i);
+}
+
 void TestCase::Run() {
+  if (!should_run())
+    return;
+
   internal::UnitTestImpl* const impl = internal::GetUnitTestImpl();
   impl->set_current_test_case(this);
 
@@ -721,16 +1094,45 @@ void TestCase::Run() {
 
   repeater->OnTestCaseStart(*this);
 
+  const internal::Int64 start = internal::GetTimeInNanos();
+  RunSetUpTestCase();
   for (int i = 0; i < total_test_count(); ++i) {
-    GetMutableTestInfo(i)->Run();
+    TestInfo* const test_info = GetMutableTestInfo(i);
+    if (test_info->should_run())
+      test_info->Run();
   }
+  // Workers are forked after SetUpTestCase, so each starts from the state
+  // it left; the next test case's need forking after its own.
+  internal::WorkerSupervisor* const supervisor = impl->worker_supervisor();
+  if (supervisor != NULL)
+    supervisor->Stop();
+  RunTearDownTestCase();
+  elapsed_time_ = (internal::GetTimeInNanos() - start) / 1000000;
 
   repeater->OnTestCaseEnd(*this);
   impl->set_current_test_case(NULL);
 }
 
+void TestCase::RunSetUpTestCase() {
+  (*set_up_tc_)();
+}
+
+void TestCase::RunTearDownTestCase() {
+  (*tear_down_tc_)();
+}
+
+TimeInMillis TestCase::elapsed_time() const {
+  return elapsed_time_;
+}
+
+const TestResult& TestCase::ad_hoc_test_result() const {
+  return ad_hoc_test_result_;
+}
+
 void TestCase::ClearResult() {
   ForEach(test_info_list_, TestInfo::ClearTestResult);
+  ad_hoc_test_result_.Clear();
+  elapsed_time_ = 0;
 }
 
 /************************************************
@@ -779,6 +1181,23 @@ int UnitTest::test_to_run_count() const {
   return impl()->test_to_run_count();
 }
 
+TimeInMillis UnitTest::start_timestamp() const {
+  return impl()->start_timestamp();
+}
+
+TimeInMillis UnitTest::elapsed_time() const {
+  return impl()->elapsed_time();
+}
+
+const TestResult& UnitTest::ad_hoc_test_result() const {
+  return *impl()->ad_hoc_test_result();
+}
+
+void UnitTest::RecordProperty(const std::string& key,
+                              const std::string& value) {
+  impl_->RecordProperty(TestProperty(key, value));
+}
+
 bool UnitTest::Passed() const {
   return impl()->Passed();
 }
@@ -834,7 +1253,7 @@ int UnitTest::Run() {
   // }
 
   // return !failed;
-  return impl()->RunAllTests();
+  return impl()->RunAllTests() ? 0 : 1;
 }
 
 const TestCase* UnitTest::current_test_case() const {
@@ -847,6 +1266,17 @@ const TestInfo* UnitTest::current_test_info() const {
   return impl_->current_test_info();
 }
 
+int UnitTest::random_seed() const {
+  return impl_->random_seed();
+}
+
+Environment* UnitTest::AddEnvironment(Environment* env) {
+  if (env == NULL)
+    return NULL;
+  impl_->environments().push_back(env);
+  return env;
+}
+
 UnitTest::UnitTest() {
   impl_ = new internal::UnitTestImpl(this);
 }
@@ -875,28 +1305,125 @@ UnitTestImpl::UnitTestImpl(UnitTest* parent)
           &default_global_test_part_result_reporter_),
       per_thread_test_part_result_reporter_(
           &default_per_thread_test_part_result_reporter_),
+      registered_test_count_(0),
+      random_seed_(0),
+      random_(0),
       current_test_case_(NULL),
-      current_test_info_(NULL) {
+      current_test_info_(NULL),
+      post_flag_parse_init_performed_(false),
+      start_timestamp_(0),
+      elapsed_time_(0) {
   listeners()->SetDefaultResultPrinter(new PrettyUnitTestResultPrinter);
 }
 
 UnitTestImpl::~UnitTestImpl() {
   ForEach(test_cases_, internal::Delete<TestCase>);
+  ForEach(environments_, internal::Delete<Environment>);
+}
+
+void UnitTestImpl::PostFlagParsingInit() {
+  if (post_flag_parse_init_performed_)
+    return;
+  post_flag_parse_init_performed_ = true;
+
+  ConfigureXmlOutput();
+  if (GTEST_FLAG(capture_output))
+    output_capture_.reset(OutputCapture::Create());
+  if (!GTEST_FLAG(stats_file).empty()) {
+    TestEventListener* const publisher =
+        LiveStatsPublisher::Create(GTEST_FLAG(stats_file));
+    if (publisher != NULL)
+      listeners()->Append(publisher);
+  }
+  if (!GTEST_FLAG(stream_to).empty()) {
+    TestEventListener* const streamer =
+        SocketStreamer::Create(GTEST_FLAG(stream_to));
+    if (streamer != NULL)
+      listeners()->Append(streamer);
+  }
+  if (GTEST_FLAG(async_listeners))
+    listeners()->EnableAsyncDispatch();
+  worker_supervisor_.reset(WorkerSupervisor::Create(GTEST_FLAG(isolation)));
+}
+
+TestWatchdog* UnitTestImpl::watchdog() {
+  if (watchdog_.get() == NULL)
+    watchdog_.reset(new TestWatchdog);
+  return watchdog_.get();
+}
+
+// The hung test's thread can't be stopped, so this finishes its events in
+// its stead: the test, its test case and the program end, every listener
+// writes out what the run got done, and the process exits.
+void UnitTestImpl::EndHungRun(TestInfo* hung_test, TimeInMillis elapsed) {
+  // A worker leaves the rest to its supervisor.
+  if (worker_supervisor_.get() != NULL && worker_supervisor_->in_worker())
+    worker_supervisor_->EndHungTest(hung_test, elapsed);
+
+  TestEventListener* const repeater = listeners()->repeater();
+  hung_test->result_.set_elapsed_time(elapsed);
+  if (output_capture_.get() != NULL) {
+    hung_test->result_.set_captured_output(
+        output_capture_->End(true, GTEST_FLAG(capture_limit)));
+  }
+  repeater->OnTestEnd(*hung_test);
+
+  if (current_test_case_ != NULL) {
+    TimeInMillis test_case_elapsed = 0;
+    for (int i = 0; i < current_test_case_->total_test_count(); ++i) {
+      test_case_elapsed +=
+          current_test_case_->GetTestInfo(i)->result()->elapsed_time();
+    }
+    current_test_case_->elapsed_time_ = test_case_elapsed;
+    repeater->OnTestCaseEnd(*current_test_case_);
+  }
+
+  elapsed_time_ = GetTimeInMillis() - start_timestamp_;
+  // Also drains the async event bus, if listeners are behind one.
+  repeater->OnTestProgramEnd(*parent_);
+  fflush(stdout);
+  fflush(stderr);
+  _exit(1);
 }
 
-TestCase* UnitTestImpl::GetTestCase(const char* test_case_name) {
+// Installs the XML, JSON lines or binary printer if --gtest_output asks
+// for one.
+void UnitTestImpl::ConfigureXmlOutput() {
+  const std::string& output = GTEST_FLAG(output);
+  const std::string format = output.substr(0, output.find(':'));
+  if (format != "xml" && format != "jsonl" && format != "bin")
+    return;
+
+  std::string path = format.size() < output.size() ?
+      output.substr(format.size() + 1) : "";
+  if (path.empty() || path[path.size() - 1] == '/')
+    path += "test_detail." + format;
+  TestEventListener* printer = NULL;
+  if (format == "xml")
+    printer = StreamingXmlPrinter::Create(path);
+  else if (format == "jsonl")
+    printer = JsonLinesPrinter::Create(path);
+  else
+    printer = BinaryResultPrinter::Create(path);
+  if (printer != NULL)
+    listeners()->SetDefaultXmlGenerator(printer);
+}
+
+TestCase* UnitTestImpl::GetTestCase(
+    const char* test_case_name, Test::SetUpTestCaseFunc set_up_tc,
+    Test::TearDownTestCaseFunc tear_down_tc) {
   const std::vector<TestCase*>::const_iterator test_case =
       std::find_if(test_cases_.begin(), test_cases_.end(),
                    [test_case_name](TestCase* test_case) {
                      return test_case != NULL && strcmp(test_case->name(),
-                                                        test_case_name);
+                                                        test_case_name) == 0;
                    });
 
   if (test_case != test_cases_.end())
     return *test_case;
 
   TestCase* const new_test_case =
-      new TestCase(test_case_name);
+      new TestCase(test_case_name, set_up_tc, tear_down_tc);
 
   test_cases_.push_back(new_test_case);
   test_case_indices_.push_back(static_cast<int>(test_case_indices_.size()));
@@ -907,11 +1434,73 @@ bool UnitTestImpl::RunAllTests() {
   bool failed = false;
   TestEventListener* repeater = listeners()->repeater();
 
+  // --gtest_filter picks the tests once, for every iteration, and
+  // --gtest_stress_filter those of them to stress.
+  for (size_t i = 0; i < test_cases_.size(); ++i) {
+    const std::vector<TestInfo*>& tests = test_cases_[i]->test_info_list();
+    for (size_t j = 0; j < tests.size(); ++j) {
+      const std::string full_name =
+          std::string(tests[j]->test_case_name()) + "." + tests[j]->name();
+      tests[j]->should_run_ = PassesFilter(GTEST_FLAG(filter), full_name);
+      if (!PassesFilter(GTEST_FLAG(stress_filter), full_name))
+        tests[j]->stressable_ = false;
+    }
+  }
+
+  start_timestamp_ = GetTimeInMillis();
   repeater->OnTestProgramStart(*parent_);
 
-  for (int test_index = 0; test_index < total_test_case_count(); ++test_index) {
-    GetMutableTestCase(test_index)->Run();
+  const Int64 start = GetTimeInNanos();
+  repeater->OnEnvironmentsSetUpStart(*parent_);
+  ForEach(environments_, SetUpEnvironment);
+  repeater->OnEnvironmentsSetUpEnd(*parent_);
+
+  // Only a shuffled run picks a seed from the time, so an unshuffled run
+  // without --gtest_random_seed gives tests the same seeds each time.
+  const bool should_shuffle = GTEST_FLAG(shuffle);
+  random_seed_ = should_shuffle || GTEST_FLAG(random_seed) != 0 ?
+      GetRandomSeedFromFlag(GTEST_FLAG(random_seed)) : 0;
+
+  // Each iteration reuses the registered tests and whatever the
+  // environments set up, and only clears the results.
+  const int iterations = IterationsToRun();
+  for (int i = 0; iterations < 0 || i < iterations; ++i) {
+    ClearNonAdHocTestResult();
+    if (should_shuffle) {
+      random_.Reseed(static_cast<UInt64>(random_seed_));
+      ShuffleTests();
+    }
+    const Int64 iteration_start = GetTimeInNanos();
+    repeater->OnTestIterationStart(*parent_, i);
+
+    // A fatal failure in an environment's SetUp leaves nothing to test.
+    if (!Test::HasFatalFailure()) {
+      for (int test_index = 0; test_index < total_test_case_count();
+           ++test_index) {
+        GetMutableTestCase(test_index)->Run();
+      }
+    }
+
+    elapsed_time_ = (GetTimeInNanos() - iteration_start) / 1000000;
+    repeater->OnTestIterationEnd(*parent_, i);
+    if (!Passed()) {
+      failed = true;
+      if (GTEST_FLAG(repeat_until_fail))
+        break;
+    }
+    if (should_shuffle) {
+      UnshuffleTests();
+      random_seed_ = GetNextRandomSeed(random_seed_);
+    }
   }
+  if (worker_supervisor_.get() != NULL)
+    worker_supervisor_->Stop();
+
+  repeater->OnEnvironmentsTearDownStart(*parent_);
+  std::for_each(environments_.rbegin(), environments_.rend(),
+                TearDownEnvironment);
+  repeater->OnEnvironmentsTearDownEnd(*parent_);
+  elapsed_time_ = (GetTimeInNanos() - start) / 1000000;
 
   repeater->OnTestProgramEnd(*parent_);
 
@@ -922,6 +1511,19 @@ bool UnitTestImpl::RunAllTests() {
   return !failed;
 }
 
+void UnitTestImpl::ShuffleTests() {
+  Shuffle(random(), &test_case_indices_);
+  for (size_t i = 0; i < test_cases_.size(); ++i)
+    test_cases_[i]->ShuffleTests(random());
+}
+
+void UnitTestImpl::UnshuffleTests() {
+  for (size_t i = 0; i < test_cases_.size(); ++i) {
+    test_cases_[i]->UnshuffleTests();
+    test_case_indices_[i] = static_cast<int>(i);
+  }
+}
+
 TestPartResultReporterInterface*
 UnitTestImpl::GetGlobalTestPartResultReporter() {
   internal::MutexLock lock(&global_test_part_result_reporter_mutex_);
@@ -976,13 +1578,146 @@ int UnitTestImpl::test_to_run_count() const {
   return SumOverTestCaseList(test_cases_, &TestCase::test_to_run_count);
 }
 
+// Results outside any test go to the enclosing test case's ad hoc result,
+// or the program's.
 TestResult* UnitTestImpl::current_test_result() {
-  return current_test_info_ ? &(current_test_info_->result_) : NULL;
+  if (current_test_info_ != NULL)
+    return &current_test_info_->result_;
+  if (current_test_case_ != NULL)
+    return &current_test_case_->ad_hoc_test_result_;
+  return &ad_hoc_test_result_;
+}
+
+void UnitTestImpl::RecordProperty(const TestProperty& test_property) {
+  const char* const xml_element = current_test_info_ != NULL ? "testcase" :
+      current_test_case_ != NULL ? "testsuite" : "testsuites";
+  current_test_result()->RecordProperty(xml_element, test_property);
 }
 } // namespace internal
 
 
-void InitGoogleTest(int* argc, char** argv) {}
+namespace internal {
+
+static const char kGTestFlagPrefix[] = "gtest_";
+
+// Returns the value of --gtest_<flag>=value in str, or NULL if str is a
+// different flag.  If def_optional is true, --gtest_<flag> alone yields "".
+static const char* ParseFlagValue(const char* str,
+                                  const char* flag,
+                                  bool def_optional) {
+  if (str == NULL || flag == NULL)
+    return NULL;
+
+  const std::string flag_str =
+      std::string("--") + kGTestFlagPrefix + flag;
+  const size_t flag_len = flag_str.length();
+  if (strncmp(str, flag_str.c_str(), flag_len) != 0)
+    return NULL;
+
+  const char* flag_end = str + flag_len;
+  if (def_optional && (flag_end[0] == '\0'))
+    return flag_end;
+
+  if (flag_end[0] != '=')
+    return NULL;
+
+  return flag_end + 1;
+}
+
+static bool ParseBoolFlag(const char* str, const char* flag, bool* value) {
+  const char* const value_str = ParseFlagValue(str, flag, true);
+  if (value_str == NULL)
+    return false;
+
+  *value = !(*value_str == '0' || *value_str == 'f' || *value_str == 'F');
+  return true;
+}
+
+static bool ParseInt32Flag(const char* str, const char* flag, Int32* value) {
+  const char* const value_str = ParseFlagValue(str, flag, false);
+  if (value_str == NULL)
+    return false;
+
+  return ParseInt32((Message() << "The value of flag --" << flag).GetString()
+                        .c_str(),
+                    value_str, value);
+}
+
+static bool ParseStringFlag(const char* str, const char* flag,
+                            std::string* value) {
+  const char* const value_str = ParseFlagValue(str, flag, false);
+  if (value_str == NULL)
+    return false;
+
+  *value = value_str;
+  return true;
+}
+
+static bool ParseGoogleTestFlag(const char* const arg) {
+  return ParseInt32Flag(arg, "repeat", &GTEST_FLAG(repeat)) ||
+      ParseBoolFlag(arg, "repeat_until_fail", &GTEST_FLAG(repeat_until_fail)) ||
+      ParseInt32Flag(arg, "stress_threads", &GTEST_FLAG(stress_threads)) ||
+      ParseInt32Flag(arg, "stress_rounds", &GTEST_FLAG(stress_rounds)) ||
+      ParseStringFlag(arg, "stress_filter", &GTEST_FLAG(stress_filter)) ||
+      ParseStringFlag(arg, "interleave_strategy",
+                      &GTEST_FLAG(interleave_strategy)) ||
+      ParseInt32Flag(arg, "interleave_schedules",
+                     &GTEST_FLAG(interleave_schedules)) ||
+      ParseInt32Flag(arg, "interleave_seed", &GTEST_FLAG(interleave_seed)) ||
+      ParseInt32Flag(arg, "interleave_preemptions",
+                     &GTEST_FLAG(interleave_preemptions)) ||
+      ParseStringFlag(arg, "interleave_replay",
+                      &GTEST_FLAG(interleave_replay)) ||
+      ParseBoolFlag(arg, "shuffle", &GTEST_FLAG(shuffle)) ||
+      ParseInt32Flag(arg, "random_seed", &GTEST_FLAG(random_seed)) ||
+      ParseStringFlag(arg, "filter", &GTEST_FLAG(filter)) ||
+      ParseBoolFlag(arg, "print_sync", &GTEST_FLAG(print_sync)) ||
+      ParseStringFlag(arg, "output", &GTEST_FLAG(output)) ||
+      ParseBoolFlag(arg, "capture_output", &GTEST_FLAG(capture_output)) ||
+      ParseInt32Flag(arg, "capture_limit", &GTEST_FLAG(capture_limit)) ||
+      ParseStringFlag(arg, "stats_file", &GTEST_FLAG(stats_file)) ||
+      ParseStringFlag(arg, "stream_to", &GTEST_FLAG(stream_to)) ||
+      ParseBoolFlag(arg, "async_listeners", &GTEST_FLAG(async_listeners)) ||
+      ParseInt32Flag(arg, "test_timeout", &GTEST_FLAG(test_timeout)) ||
+      ParseStringFlag(arg, "isolation", &GTEST_FLAG(isolation)) ||
+      ParseInt32Flag(arg, "fork_batch", &GTEST_FLAG(fork_batch)) ||
+      ParseInt32Flag(arg, "benchmark_repetitions",
+                     &GTEST_FLAG(benchmark_repetitions)) ||
+      ParseStringFlag(arg, "benchmark_baseline",
+                      &GTEST_FLAG(benchmark_baseline)) ||
+      ParseStringFlag(arg, "benchmark_save_baseline",
+                      &GTEST_FLAG(benchmark_save_baseline)) ||
+      ParseStringFlag(arg, "benchmark_fail_on_regression",
+                      &GTEST_FLAG(benchmark_fail_on_regression)) ||
+      ParseBoolFlag(arg, "benchmark_pin", &GTEST_FLAG(benchmark_pin)) ||
+      ParseStringFlag(arg, "benchmark_target_ci",
+                      &GTEST_FLAG(benchmark_target_ci)) ||
+      ParseInt32Flag(arg, "benchmark_max_repetitions",
+                     &GTEST_FLAG(benchmark_max_repetitions));
+}
+
+// Parses the --gtest_* flags and removes them from argv.
+void ParseGoogleTestFlagsOnly(int* argc, char** argv) {
+  for (int i = 1; i < *argc; i++) {
+    if (!ParseGoogleTestFlag(argv[i]))
+      continue;
+
+    // Shifts the remainder of argv left by one, including the NULL
+    // terminator.
+    for (int j = i; j != *argc; j++) {
+      argv[j] = argv[j + 1];
+    }
+    (*argc)--;
+    i--;
+  }
+}
+
+} // namespace internal
+
+void InitGoogleTest(int* argc, char** argv) {
+  internal::ParseGoogleTestFlagsOnly(argc, argv);
+  internal::GetUnitTestImpl()->PostFlagParsingInit();
+}
 
 namespace internal {
 
@@ -1018,6 +1753,30 @@ std::string StringStreamToString(::std::stringstream* ss) {
   return result;
 }
 
+// Prints s as a quoted C string literal, escaping what isn't printable.
+void PrintStringTo(const ::std::string& s, ::std::ostream* os) {
+  *os << '"';
+  for (size_t i = 0; i < s.size(); ++i) {
+    const unsigned char ch = static_cast<unsigned char>(s[i]);
+    switch (ch) {
+      case '\\': *os << "\\\\"; break;
+      case '"': *os << "\\\""; break;
+      case '\n': *os << "\\n"; break;
+      case '\r': *os << "\\r"; break;
+      case '\t': *os << "\\t"; break;
+      default:
+        if (ch < 0x20 || ch == 0x7f) {
+          char buffer[8];
+          snprintf(buffer, sizeof(buffer), "\\x%02X", ch);
+          *os << buffer;
+        } else {
+          *os << s[i];
+        }
+    }
+  }
+  *os << '"';
+}
+
 }
 
 Message::Message()
@@ -1038,33 +1797,6 @@ AssertionResult::AssertionResult(const AssertionResult& other)
 
 namespace internal {
 
-namespace {
-
-std::vector<std::string> SplitEscapedString(const std::string& str) {
-  std::vector<std::string> lines;
-  size_t start = 0, end = str.size();
-  if (end > 2 && str[0] == '"' && str[end - 1] == '"') {
-    ++start;
-    --end;
-  }
-  bool escaped = false;
-  for (size_t i = start; i + 1 < end; ++i) {
-    if (escaped) {
-      escaped = false;
-      if (str[i] == 'n') {
-        lines.push_back(str.substr(start, i - start - 1));
-        start = i + 1;
-      }
-    } else {
-      escaped = str[i] == '\\';
-    }
-  }
-  lines.push_back(str.substr(start, end - start));
-  return lines;
-}
-
-}
-
 AssertionResult EqFailure(const char* lhs_expression,
                           const char* rhs_expression,
                           const std::string& lhs_value,
@@ -1081,19 +1813,6 @@ AssertionResult EqFailure(const char* lhs_expression,
     msg << "\n    Which is: " << rhs_value;
   }
 
-#if 0
-  if (!lhs_value.empty() && rhs_value.empty()) {
-    const std::vector<std::string> lhs_lines =
-        SplitEscapedString(lhs_value);
-    const std::vector<std::string> rhs_lines =
-        SplitEscapedString(rhs_value);
-    if (lhs_lines.size() > 1 || rhs_lines.size() > 1) {
-      msg << "\nWith diff:\n"
-          << edit_distance::CreateUnifiedDiff(lhs_lines, rhs_lines);
-    }
-  }
-#endif
-
   return AssertionFailure() << msg;
 }
 
@@ -22,7 +22,12 @@ class UnitTest;
 
 namespace internal {
 
+class AsyncEventBus;
 class TestEventRepeater;
+class WorkerResultReporter;
+class TestResultAccessor;
+class WorkerSupervisor;
+class StressRunner;
 class DefaultGlobalTestPartResultReporter;
 class UnitTestImpl;
 struct TraceInfo;
@@ -105,15 +110,18 @@ class GTEST_API_ TestProperty;
 class GTEST_API_ Test {
  public:
   friend class TestInfo;
+  friend class internal::StressRunner;
 
   typedef internal::SetUpTestCaseFunc SetUpTestCaseFunc;
   typedef internal::TearDownTestCaseFunc TearDownTestCaseFunc;
 
   virtual ~Test();
 
-  static void SetUpTestCase();
+  // Run once for each test case, before its first test and after its
+  // last.  A fixture hides them with its own to share costly state.
+  static void SetUpTestCase() {}
 
-  static void TearDownTestCase();
+  static void TearDownTestCase() {}
 
   static bool HasFatalFailure();
 
@@ -145,9 +153,25 @@ class GTEST_API_ Test {
 
 
 /************************************************
- * TestResult
+ * TestProperty
  ************************************************/
-class TestProperty;
+// A key/value pair recorded with RecordProperty() and reported by the
+// output listeners.
+class GTEST_API_ TestProperty {
+ public:
+  TestProperty(const std::string& a_key, const std::string& a_value)
+      : key_(a_key), value_(a_value) {}
+
+  const char* key() const { return key_.c_str(); }
+
+  const char* value() const { return value_.c_str(); }
+
+  void SetValue(const std::string& new_value) { value_ = new_value; }
+
+ private:
+  std::string key_;
+  std::string value_;
+};
 
 
 /************************************************
@@ -177,21 +201,33 @@ class GTEST_API_ TestResult {
 
   const TestProperty& GetTestProperty(int i) const;
 
+  // What the test wrote to stdout and stderr, if it failed while
+  // --gtest_capture_output was on.
+  const std::string& captured_output() const { return captured_output_; }
+
  private:
   friend class TestInfo;
   friend class TestCase;
   friend class UnitTest;
   friend class internal::DefaultGlobalTestPartResultReporter;
   friend class internal::UnitTestImpl;
+  friend class internal::WorkerResultReporter;
+  friend class internal::TestResultAccessor;
 
   const std::vector<TestPartResult>& test_part_results() const {
     return test_part_results_;
   }
 
-  const std::vector<TestProperty>& test_properties() const;
+  const std::vector<TestProperty>& test_properties() const {
+    return test_properties_;
+  }
 
   void set_elapsed_time(TimeInMillis elapsed);
 
+  void set_captured_output(const std::string& output) {
+    captured_output_ = output;
+  }
+
   void RecordProperty(const std::string& xml_element,
                       const TestProperty& test_property);
 
@@ -209,6 +245,10 @@ class GTEST_API_ TestResult {
   void Clear();
 
   std::vector<TestPartResult> test_part_results_;
+  std::vector<TestProperty> test_properties_;
+  internal::Mutex test_properties_mutex_;
+  TimeInMillis elapsed_time_;
+  std::string captured_output_;
 
   GTEST_DISALLOW_COPY_AND_ASSIGN_(TestResult);
 };
@@ -233,7 +273,21 @@ class GTEST_API_ TestInfo {
 
   int line() const { return location_.line; }
 
-  bool should_run() const;
+  // The test's place in registration order, which is the same in every run
+  // of the program.
+  int id() const { return id_; }
+
+  // A seed for the test's own randomness, derived from the iteration's
+  // seed and the test's id: the same every run with the same
+  // --gtest_random_seed, whatever order or process the test runs in.
+  int random_seed() const;
+
+  // The test's own timeout in milliseconds, 0 for none, or -1 if
+  // --gtest_test_timeout applies.
+  int timeout_ms() const { return timeout_ms_; }
+
+  // False if --gtest_filter leaves the test out.
+  bool should_run() const { return should_run_; }
 
   bool is_reportable() const;
 
@@ -244,12 +298,18 @@ class GTEST_API_ TestInfo {
   friend class TestCase;
   friend class UnitTest;
   friend class internal::UnitTestImpl;
+  friend class internal::WorkerSupervisor;
 
   friend TestInfo* internal::MakeAndRegisterTestInfo (
       const char* test_case_name,
       const char* name,
       internal::CodeLocation code_location,
+      internal::SetUpTestCaseFunc set_up_tc,
+      internal::TearDownTestCaseFunc tear_down_tc,
       internal::TestFactoryBase* factory);
+  friend TestInfo* internal::SetTestTimeout(TestInfo* test_info,
+                                            int timeout_ms);
+  friend TestInfo* internal::ExcludeFromStress(TestInfo* test_info);
 
   TestInfo(const std::string& test_case_name,
            const std::string& name,
@@ -260,6 +320,12 @@ class GTEST_API_ TestInfo {
 
   void Run();
 
+  // Runs the test here and records its result, without any events.
+  void Execute();
+
+  // The timeout to run the test with, or 0 for none.
+  int timeout_to_apply() const;
+
   static void ClearTestResult(TestInfo* test_info) {
     test_info->result_.Clear();
   }
@@ -268,6 +334,11 @@ class GTEST_API_ TestInfo {
   const std::string name_;
   internal::CodeLocation location_;
   internal::TestFactoryBase* const factory_;
+  int id_;
+  int timeout_ms_;
+  bool should_run_;
+  // False if --gtest_stress_threads runs the test once as usual.
+  bool stressable_;
 
   TestResult result_;
 
@@ -280,7 +351,8 @@ class GTEST_API_ TestInfo {
  ************************************************/
 class GTEST_API_ TestCase {
  public:
-  TestCase(const char *name);
+  TestCase(const char *name, Test::SetUpTestCaseFunc set_up_tc,
+           Test::TearDownTestCaseFunc tear_down_tc);
 
   virtual ~TestCase();
 
@@ -288,7 +360,7 @@ class GTEST_API_ TestCase {
 
   const char* type_param() const;
 
-  bool should_run() const { return true; }
+  bool should_run() const { return test_to_run_count() > 0; }
 
   int successful_test_count() const;
 
@@ -306,7 +378,10 @@ class GTEST_API_ TestCase {
 
   bool Passed() const { return !Failed(); }
 
-  bool Failed() const { return failed_test_count() > 0; }
+  // A failure in SetUpTestCase or TearDownTestCase fails the test case.
+  bool Failed() const {
+    return failed_test_count() > 0 || ad_hoc_test_result().Failed();
+  }
 
   TimeInMillis elapsed_time() const;
 
@@ -318,6 +393,7 @@ class GTEST_API_ TestCase {
   friend class Test;
   friend class UnitTest;
   friend class internal::UnitTestImpl;
+  friend class internal::WorkerSupervisor;
 
   std::vector<TestInfo*>& test_info_list() { return test_info_list_; }
 
@@ -342,7 +418,7 @@ class GTEST_API_ TestCase {
   void RunTearDownTestCase();
 
   static bool TestPassed(const TestInfo* test_info) {
-    return test_info->result()->Passed();
+    return test_info->should_run() && test_info->result()->Passed();
   }
 
   static bool TestFailed(const TestInfo* test_info) {
@@ -356,17 +432,22 @@ class GTEST_API_ TestCase {
   static bool TestReportable(const TestInfo* test_info);
 
   static bool ShouldRunTest(const TestInfo* test_info) {
-    // return test_info->should_run();
-    return true;
+    return test_info->should_run();
   }
 
+  // Shuffles the order the tests run in.
   void ShuffleTests(internal::Random* random);
 
+  // Restores the order they were registered in.
   void UnshuffleTests();
 
   const std::string name_;
+  Test::SetUpTestCaseFunc set_up_tc_;
+  Test::TearDownTestCaseFunc tear_down_tc_;
   std::vector<TestInfo*> test_info_list_;
   std::vector<int> test_indices_;
+  TimeInMillis elapsed_time_;
+  TestResult ad_hoc_test_result_;
   // std::vector<
 
   GTEST_DISALLOW_COPY_AND_ASSIGN_(TestCase);
@@ -376,16 +457,56 @@ class GTEST_API_ TestCase {
 /************************************************
  * Environment
  ************************************************/
-class Environment;
+// Global set-up and tear-down, registered with AddGlobalTestEnvironment.
+// SetUp runs once before the first test and TearDown once after the last,
+// however many times the tests are repeated.  Workers are forked after
+// SetUp, so they share what it made instead of making it again.
+class Environment {
+ public:
+  virtual ~Environment() {}
+
+  virtual void SetUp() {}
+
+  virtual void TearDown() {}
+
+ private:
+  // Catches the misspelling Setup(), which would otherwise never run.
+  struct Setup_should_be_spelled_SetUp {};
+  virtual Setup_should_be_spelled_SetUp* Setup() { return NULL; }
+};
 
 
 /************************************************
  * TestEventListener
  ************************************************/
+// One bit per TestEventListener callback, named after it.  A listener
+// that handles only some events says which, and the rest are never
+// dispatched to it.
+enum TestEvent {
+  kOnTestProgramStart          = 1 << 0,
+  kOnTestIterationStart        = 1 << 1,
+  kOnEnvironmentsSetUpStart    = 1 << 2,
+  kOnEnvironmentsSetUpEnd      = 1 << 3,
+  kOnTestCaseStart             = 1 << 4,
+  kOnTestStart                 = 1 << 5,
+  kOnTestPartResult            = 1 << 6,
+  kOnTestEnd                   = 1 << 7,
+  kOnTestCaseEnd               = 1 << 8,
+  kOnEnvironmentsTearDownStart = 1 << 9,
+  kOnEnvironmentsTearDownEnd   = 1 << 10,
+  kOnTestIterationEnd          = 1 << 11,
+  kOnTestProgramEnd            = 1 << 12,
+  kAllTestEvents               = (1 << 13) - 1
+};
+
 class TestEventListener {
  public:
   virtual ~TestEventListener() {}
 
+  // The TestEvent bits of the callbacks this listener handles.  It's read
+  // once, when the listener is appended.
+  virtual int handled_events() const { return kAllTestEvents; }
+
   virtual void OnTestProgramStart(const UnitTest& unit_test) = 0;
 
   virtual void OnTestIterationStart(const UnitTest& unit_test,
@@ -439,6 +560,20 @@ class EmptyTestEventListener : public TestEventListener {
 };
 
 
+// An EmptyTestEventListener that receives only the events in
+// kHandledEvents, e.g.
+//
+//   class Timer
+//       : public SelectiveTestEventListener<kOnTestStart | kOnTestEnd> {
+//     ...
+//   };
+template <int kHandledEvents>
+class SelectiveTestEventListener : public EmptyTestEventListener {
+ public:
+  virtual int handled_events() const { return kHandledEvents; }
+};
+
+
 /************************************************
  * TestEventListeners
  ************************************************/
@@ -449,6 +584,10 @@ class GTEST_API_ TestEventListeners {
 
   void Append(TestEventListener* listener);
 
+  // Appends a listener that receives only the events in the TestEvent
+  // mask, whatever its handled_events() says.
+  void Append(TestEventListener* listener, int events);
+
   TestEventListener* Release(TestEventListener* listener);
 
   TestEventListener* default_result_printer() const {
@@ -475,7 +614,11 @@ class GTEST_API_ TestEventListeners {
   bool EventForwardingEnabled() const;
   void SuppressEventForwarding();
 
+  // Delivers events to the listeners on a thread of their own from now on.
+  void EnableAsyncDispatch();
+
   internal::TestEventRepeater* repeater_;
+  internal::AsyncEventBus* async_bus_;
   TestEventListener* default_result_printer_;
   TestEventListener* default_xml_generator_;
 
@@ -498,6 +641,7 @@ class GTEST_API_ UnitTest {
 
   const TestInfo* current_test_info() const;
 
+  // The current iteration's seed for --gtest_shuffle and tests' seeds.
   int random_seed() const;
 
   int successful_test_case_count() const;
@@ -554,7 +698,9 @@ class GTEST_API_ UnitTest {
   friend class Test;
   friend class internal::AssertHelper;
   friend internal::UnitTestImpl* internal::GetUnitTestImpl();
+  friend Environment* AddGlobalTestEnvironment(Environment* env);
 
+  // Takes ownership of env and returns it, or NULL if it's NULL.
   Environment* AddEnvironment(Environment* env);
 
   void AddTestPartResult(TestPartResult::Type result_type,
@@ -605,6 +751,13 @@ class GTEST_API_ UnitTest {
 //   return UnitTest::GetInstance();
 // }
 
+// Registers env, which the framework then owns, usually from main() before
+// RUN_ALL_TESTS().  Environments are set up in the order they're added and
+// torn down in reverse.
+inline Environment* AddGlobalTestEnvironment(Environment* env) {
+  return UnitTest::GetInstance()->AddEnvironment(env);
+}
+
 GTEST_API_ void InitGoogleTest(int* argc, char** argv);
 
 namespace internal {
@@ -781,6 +934,9 @@ class EqHelper<true> {
   test_case##_##test_name##_Test
 
 #define GTEST_TEST_(test_case, test_name, parent) \
+  GTEST_TEST_WITH_TIMEOUT_(test_case, test_name, parent, -1)
+
+#define GTEST_TEST_WITH_TIMEOUT_(test_case, test_name, parent, timeout_ms) \
 class GTEST_API_ GTEST_TEST_CLASS_NAME_(test_case, test_name) : public parent {\
  public:\
   GTEST_TEST_CLASS_NAME_(test_case, test_name)() {}\
@@ -791,11 +947,14 @@ class GTEST_API_ GTEST_TEST_CLASS_NAME_(test_case, test_name) : public parent {\
 };\
 \
 testing::TestInfo* GTEST_TEST_CLASS_NAME_(test_case, test_name)\
-  ::test_info_ = testing::internal::MakeAndRegisterTestInfo(\
-      #test_case, #test_name,\
-      ::testing::internal::CodeLocation(__FILE__, __LINE__), \
-      new testing::internal::TestFactoryImpl<\
-          GTEST_TEST_CLASS_NAME_(test_case, test_name)>);\
+  ::test_info_ = testing::internal::SetTestTimeout(\
+      testing::internal::MakeAndRegisterTestInfo(\
+          #test_case, #test_name,\
+          ::testing::internal::CodeLocation(__FILE__, __LINE__), \
+          parent::SetUpTestCase, parent::TearDownTestCase, \
+          new testing::internal::TestFactoryImpl<\
+              GTEST_TEST_CLASS_NAME_(test_case, test_name)>),\
+      timeout_ms);\
 \
 void GTEST_TEST_CLASS_NAME_(test_case, test_name)::TestBody()
 
@@ -809,6 +968,14 @@ void GTEST_TEST_CLASS_NAME_(test_case, test_name)::TestBody()
 #define TEST_F(test_case, test_name) \
   GTEST_TEST_(test_case, test_name, test_case)
 
+// A test that fails and ends the run once it has run for timeout_ms,
+// whatever --gtest_test_timeout says; 0 means no limit.
+#define TEST_WITH_TIMEOUT(test_case, test_name, timeout_ms) \
+  GTEST_TEST_WITH_TIMEOUT_(test_case, test_name, ::testing::Test, timeout_ms)
+
+#define TEST_F_WITH_TIMEOUT(test_case, test_name, timeout_ms) \
+  GTEST_TEST_WITH_TIMEOUT_(test_case, test_name, test_case, timeout_ms)
+
 inline int RUN_ALL_TESTS() {
   return testing::UnitTest::GetInstance()->Run();
 }
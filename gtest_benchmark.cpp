@@ -0,0 +1,1351 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <utility>
+
+#include <elf.h>
+#include <link.h>
+
+#include "gtest_benchmark.h"
+#include "gtest_internal_impl.h"
+
+namespace testing {
+namespace internal {
+
+// Returns the size of the highest-level CPU cache, or 0 if unknown.
+static size_t GetLastLevelCacheSize() {
+  int best_level = 0;
+  size_t best_size = 0;
+  for (int index = 0; ; ++index) {
+    const std::string dir = (Message()
+        << "/sys/devices/system/cpu/cpu0/cache/index" << index).GetString();
+    std::ifstream level_file((dir + "/level").c_str());
+    std::ifstream size_file((dir + "/size").c_str());
+    int level = 0;
+    size_t size = 0;
+    std::string unit;
+    if (!(level_file >> level) || !(size_file >> size))
+      break;
+    size_file >> unit;
+
+    if (unit == "K") {
+      size <<= 10;
+    } else if (unit == "M") {
+      size <<= 20;
+    } else if (unit == "G") {
+      size <<= 30;
+    }
+    if (level > best_level || (level == best_level && size > best_size)) {
+      best_level = level;
+      best_size = size;
+    }
+  }
+  return best_size;
+}
+
+// Flushes the data caches by reading through a buffer larger than the
+// last-level cache.
+class CacheEvictor {
+ public:
+  CacheEvictor() {
+    static const size_t kDefaultBufferSize = 64 << 20;
+    static const size_t kMaxBufferSize = static_cast<size_t>(1) << 30;
+    const size_t cache_size = GetLastLevelCacheSize();
+    const size_t buffer_size = cache_size == 0 ? kDefaultBufferSize :
+        std::min(2 * cache_size, kMaxBufferSize);
+    buffer_.assign(buffer_size, 1);
+  }
+
+  // Touches one byte in every cache line; the sum keeps the reads alive.
+  Int64 Evict() const {
+    static const size_t kCacheLine = 64;
+    Int64 sum = 0;
+    for (size_t i = 0; i < buffer_.size(); i += kCacheLine)
+      sum += buffer_[i];
+    return sum;
+  }
+
+  size_t size() const { return buffer_.size(); }
+
+ private:
+  std::vector<char> buffer_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(CacheEvictor);
+};
+
+} // namespace internal
+
+
+/************************************************
+ * LatencyHistogram
+ * member function implentation
+ ************************************************/
+LatencyHistogram::LatencyHistogram()
+    : buckets_(kBucketCount, 0),
+      count_(0),
+      sum_(0),
+      min_(0),
+      max_(0) {}
+
+int LatencyHistogram::BucketIndex(internal::Int64 nanos) {
+  const internal::UInt64 value = static_cast<internal::UInt64>(nanos);
+  if (value < 2 * kSubBuckets)
+    return static_cast<int>(value);
+
+  // Values in [2^k, 2^(k+1)) share one bucket per 2^(k - kSubBucketBits).
+  const int shift = 63 - __builtin_clzll(value) - kSubBucketBits;
+  return (shift + 1) * kSubBuckets +
+      static_cast<int>((value >> shift) - kSubBuckets);
+}
+
+internal::Int64 LatencyHistogram::BucketUpperBound(int index) {
+  if (index < 2 * kSubBuckets)
+    return index;
+
+  const int shift = index / kSubBuckets - 1;
+  const internal::UInt64 sub_bucket = index % kSubBuckets + kSubBuckets;
+  return static_cast<internal::Int64>(((sub_bucket + 1) << shift) - 1);
+}
+
+void LatencyHistogram::Record(internal::Int64 nanos) {
+  if (nanos < 0)
+    nanos = 0;
+  ++buckets_[BucketIndex(nanos)];
+  if (count_ == 0 || nanos < min_)
+    min_ = nanos;
+  if (nanos > max_)
+    max_ = nanos;
+  ++count_;
+  sum_ += nanos;
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+  if (other.count_ == 0)
+    return;
+  for (int i = 0; i < kBucketCount; ++i)
+    buckets_[i] += other.buckets_[i];
+  if (count_ == 0 || other.min_ < min_)
+    min_ = other.min_;
+  if (other.max_ > max_)
+    max_ = other.max_;
+  count_ += other.count_;
+  sum_ += other.sum_;
+}
+
+void LatencyHistogram::Clear() {
+  std::fill(buckets_.begin(), buckets_.end(), 0);
+  count_ = sum_ = min_ = max_ = 0;
+}
+
+internal::Int64 LatencyHistogram::Percentile(double percentile) const {
+  if (count_ == 0)
+    return 0;
+
+  const double clamped = std::min(100.0, std::max(0.0, percentile));
+  internal::Int64 rank =
+      static_cast<internal::Int64>(std::ceil(clamped / 100 * count_));
+  rank = std::max<internal::Int64>(rank, 1);
+
+  internal::Int64 seen = 0;
+  for (int i = 0; i < kBucketCount; ++i) {
+    seen += buckets_[i];
+    if (seen >= rank)
+      return std::max(min_, std::min(max_, BucketUpperBound(i)));
+  }
+  return max_;
+}
+
+/************************************************
+ * end of LatencyHistogram
+ ************************************************/
+
+
+/************************************************
+ * BenchmarkState
+ * member function implentation
+ ************************************************/
+BenchmarkState::BenchmarkState(int thread_index,
+                               int threads,
+                               internal::Int64 iterations,
+                               LatencyHistogram* histogram,
+                               double ops_per_second,
+                               const internal::CacheEvictor* evictor)
+    : thread_index_(thread_index),
+      threads_(threads),
+      iterations_(iterations),
+      remaining_(0),
+      started_(false),
+      finished_(false),
+      start_nanos_(0),
+      stop_nanos_(0),
+      histogram_(histogram),
+      interval_nanos_(ops_per_second > 0 ?
+                      static_cast<internal::Int64>(1e9 / ops_per_second) : 0),
+      issued_(0),
+      op_start_nanos_(0),
+      evictor_(evictor),
+      measured_nanos_(0),
+      evict_sink_(0) {}
+
+bool BenchmarkState::KeepRunningSlow() {
+  if (finished_)
+    return false;
+
+  internal::Int64 now = internal::GetTimeInNanos();
+  if (!started_) {
+    started_ = true;
+    start_nanos_ = now;
+    if (!timed_per_iteration() && iterations_ > 0) {
+      remaining_ = iterations_ - 1;
+      return true;
+    }
+  } else if (timed_per_iteration()) {
+    const internal::Int64 op_nanos = now - op_start_nanos_;
+    measured_nanos_ += op_nanos;
+    if (histogram_ != NULL)
+      histogram_->Record(op_nanos);
+  }
+
+  // When timing every iteration remaining_ stays 0, so each one comes here.
+  if (timed_per_iteration() && issued_ < iterations_) {
+    if (evictor_ != NULL) {
+      evict_sink_ += evictor_->Evict();
+      now = internal::GetTimeInNanos();
+    }
+    if (interval_nanos_ > 0) {
+      // Measuring from the intended rather than the actual issue time
+      // charges a stall to every operation that should have started
+      // during it, instead of silently issuing fewer of them.
+      op_start_nanos_ = start_nanos_ + issued_ * interval_nanos_;
+      while (now < op_start_nanos_)
+        now = internal::GetTimeInNanos();
+    } else {
+      op_start_nanos_ = now;
+    }
+    ++issued_;
+    return true;
+  }
+
+  stop_nanos_ = now;
+  finished_ = true;
+  return false;
+}
+
+/************************************************
+ * end of BenchmarkState
+ ************************************************/
+
+
+namespace internal {
+
+GTEST_DEFINE_int32_(
+    benchmark_repetitions, 1,
+    "How many times to repeat each benchmark run.  The repetitions are the "
+    "samples compared against a baseline, which needs 4 or more on each "
+    "side to tell a change from noise.");
+
+GTEST_DEFINE_string_(
+    benchmark_baseline, "",
+    "Path of a baseline file to compare benchmark results against.");
+
+GTEST_DEFINE_string_(
+    benchmark_save_baseline, "",
+    "Path of a baseline file to store this run's benchmark results in.  "
+    "Results of other hosts in the file are kept.");
+
+GTEST_DEFINE_string_(
+    benchmark_fail_on_regression, "",
+    "Fails a benchmark that is significantly slower than the baseline by "
+    "more than this percentage, e.g. 5%.");
+
+GTEST_DEFINE_bool_(
+    benchmark_pin, true,
+    "Pins each benchmark's thread to the CPU the first benchmark started "
+    "on, for as long as the benchmark runs.  Threads of multi-threaded "
+    "benchmarks that don't pin themselves are unaffected.");
+
+GTEST_DEFINE_string_(
+    benchmark_target_ci, "",
+    "Adds repetitions until the 95% confidence interval of the mean is "
+    "within this percentage of it, e.g. 1%.");
+
+GTEST_DEFINE_int32_(
+    benchmark_max_repetitions, 30,
+    "The most repetitions --gtest_benchmark_target_ci may add up to.");
+
+static const Int64 kMaxBenchmarkIterations = 1000000000;
+
+static const char kBaselineMagic[] = "mygtest-benchmark-baseline";
+static const int kBaselineVersion = 1;
+
+// Two samples differing at this level of significance or better are
+// reported as faster or slower.
+static const double kBaselineSignificance = 0.05;
+
+// Up to this many pooled samples without ties, the Mann-Whitney p-value
+// is computed exactly instead of with the normal approximation.
+static const size_t kExactMannWhitneyLimit = 20;
+
+static std::string FormatNanos(double nanos) {
+  char buffer[32];
+  if (nanos < 1e3) {
+    snprintf(buffer, sizeof(buffer), "%.1f ns", nanos);
+  } else if (nanos < 1e6) {
+    snprintf(buffer, sizeof(buffer), "%.2f us", nanos / 1e3);
+  } else if (nanos < 1e9) {
+    snprintf(buffer, sizeof(buffer), "%.2f ms", nanos / 1e6);
+  } else {
+    snprintf(buffer, sizeof(buffer), "%.2f s", nanos / 1e9);
+  }
+  return buffer;
+}
+
+static std::string FormatRate(double per_second) {
+  char buffer[32];
+  if (per_second < 1e3) {
+    snprintf(buffer, sizeof(buffer), "%.1f ops/s", per_second);
+  } else if (per_second < 1e6) {
+    snprintf(buffer, sizeof(buffer), "%.1f Kops/s", per_second / 1e3);
+  } else if (per_second < 1e9) {
+    snprintf(buffer, sizeof(buffer), "%.1f Mops/s", per_second / 1e6);
+  } else {
+    snprintf(buffer, sizeof(buffer), "%.1f Gops/s", per_second / 1e9);
+  }
+  return buffer;
+}
+
+static double Median(std::vector<double> samples) {
+  if (samples.empty())
+    return 0;
+  std::sort(samples.begin(), samples.end());
+  const size_t middle = samples.size() / 2;
+  return samples.size() % 2 == 1 ? samples[middle] :
+      (samples[middle - 1] + samples[middle]) / 2;
+}
+
+// Returns P(U <= u) for samples of sizes n1 and n2 without ties, by
+// counting the arrangements of the pooled ranks.
+static double ExactMannWhitneyCdf(size_t n1, size_t n2, double u) {
+  // counts[i][j][k] is the number of arrangements of i and j samples with
+  // U statistic k.
+  std::vector<std::vector<std::vector<double> > > counts(
+      n1 + 1, std::vector<std::vector<double> >(n2 + 1));
+  for (size_t i = 0; i <= n1; ++i) {
+    for (size_t j = 0; j <= n2; ++j) {
+      std::vector<double>& current = counts[i][j];
+      current.assign(i * j + 1, 0);
+      if (i == 0 || j == 0) {
+        current[0] = 1;
+        continue;
+      }
+      for (size_t k = 0; k <= i * j; ++k) {
+        if (k >= j)
+          current[k] += counts[i - 1][j][k - j];
+        if (k <= i * (j - 1))
+          current[k] += counts[i][j - 1][k];
+      }
+    }
+  }
+
+  const std::vector<double>& distribution = counts[n1][n2];
+  double total = 0;
+  double at_most_u = 0;
+  for (size_t k = 0; k < distribution.size(); ++k) {
+    total += distribution[k];
+    if (k <= u)
+      at_most_u += distribution[k];
+  }
+  return at_most_u / total;
+}
+
+// Returns the smallest two-sided p-value samples of sizes n1 and n2 can
+// reach, when all of one lie below all of the other: 2 / C(n1 + n2, n1).
+static double MinimumMannWhitneyPValue(size_t n1, size_t n2) {
+  double arrangements = 1;
+  for (size_t i = 1; i <= n1; ++i)
+    arrangements = arrangements * static_cast<double>(n2 + i) / i;
+  return std::min(1.0, 2 / arrangements);
+}
+
+// Returns the two-sided p-value of the Mann-Whitney U test for the
+// hypothesis that both samples come from the same distribution.
+static double MannWhitneyUTest(const std::vector<double>& a,
+                               const std::vector<double>& b) {
+  const size_t n1 = a.size();
+  const size_t n2 = b.size();
+  if (n1 == 0 || n2 == 0)
+    return 1;
+
+  std::vector<std::pair<double, int> > pooled;
+  for (size_t i = 0; i < n1; ++i)
+    pooled.push_back(std::make_pair(a[i], 0));
+  for (size_t i = 0; i < n2; ++i)
+    pooled.push_back(std::make_pair(b[i], 1));
+  std::sort(pooled.begin(), pooled.end());
+
+  // Ties share the average of their ranks.
+  const size_t n = pooled.size();
+  double rank_sum_a = 0;
+  double tie_term = 0;
+  for (size_t i = 0; i < n;) {
+    size_t j = i;
+    while (j < n && pooled[j].first == pooled[i].first)
+      ++j;
+    const double rank = (i + 1 + j) / 2.0;
+    const double ties = static_cast<double>(j - i);
+    tie_term += ties * ties * ties - ties;
+    for (size_t k = i; k < j; ++k) {
+      if (pooled[k].second == 0)
+        rank_sum_a += rank;
+    }
+    i = j;
+  }
+
+  const double u1 = rank_sum_a - n1 * (n1 + 1) / 2.0;
+  const double u = std::min(u1, n1 * n2 - u1);
+  if (tie_term == 0 && n <= kExactMannWhitneyLimit)
+    return std::min(1.0, 2 * ExactMannWhitneyCdf(n1, n2, u));
+
+  const double mean = n1 * n2 / 2.0;
+  const double variance =
+      n1 * n2 / 12.0 * ((n + 1) - tie_term / (n * (n - 1.0)));
+  if (variance <= 0)
+    return 1;
+  const double z = std::max(0.0, (mean - u - 0.5) / std::sqrt(variance));
+  return std::min(1.0, std::erfc(z / std::sqrt(2.0)));
+}
+
+static int FindBuildIdCallback(struct dl_phdr_info* info, size_t, void* data) {
+  std::string* const build_id = static_cast<std::string*>(data);
+  for (int i = 0; i < info->dlpi_phnum; ++i) {
+    const ElfW(Phdr)& phdr = info->dlpi_phdr[i];
+    if (phdr.p_type != PT_NOTE)
+      continue;
+
+    const char* note = reinterpret_cast<const char*>(
+        info->dlpi_addr + phdr.p_vaddr);
+    const char* const end = note + phdr.p_memsz;
+    while (note + sizeof(ElfW(Nhdr)) <= end) {
+      const ElfW(Nhdr)* const header =
+          reinterpret_cast<const ElfW(Nhdr)*>(note);
+      const char* const name = note + sizeof(*header);
+      const unsigned char* const desc = reinterpret_cast<const unsigned char*>(
+          name + ((header->n_namesz + 3) & ~3u));
+      if (header->n_type == NT_GNU_BUILD_ID && header->n_namesz == 4 &&
+          memcmp(name, "GNU", 4) == 0) {
+        static const char kHexDigits[] = "0123456789abcdef";
+        for (size_t j = 0; j < header->n_descsz; ++j) {
+          *build_id += kHexDigits[desc[j] >> 4];
+          *build_id += kHexDigits[desc[j] & 0xf];
+        }
+        return 1;
+      }
+      note = reinterpret_cast<const char*>(desc) +
+          ((header->n_descsz + 3) & ~3u);
+    }
+  }
+  // The first object reported is the executable; don't look further.
+  return 1;
+}
+
+// Returns the GNU build id of the running executable.
+static std::string GetBuildId() {
+  std::string build_id;
+  dl_iterate_phdr(&FindBuildIdCallback, &build_id);
+  return build_id.empty() ? "unknown" : build_id;
+}
+
+static std::string ReplaceWhitespace(std::string str) {
+  for (size_t i = 0; i < str.size(); ++i) {
+    if (isspace(static_cast<unsigned char>(str[i])))
+      str[i] = '_';
+  }
+  return str;
+}
+
+// Identifies the machine: host name, CPU model and CPU count.
+static std::string GetHostFingerprint() {
+  char host_name[256] = "unknown";
+  gethostname(host_name, sizeof(host_name) - 1);
+
+  std::string cpu_model = "unknown";
+  std::ifstream cpu_info("/proc/cpuinfo");
+  std::string line;
+  while (std::getline(cpu_info, line)) {
+    if (line.compare(0, 10, "model name") == 0) {
+      const size_t colon = line.find(':');
+      if (colon != std::string::npos && colon + 2 <= line.size())
+        cpu_model = line.substr(colon + 2);
+      break;
+    }
+  }
+
+  return ReplaceWhitespace((Message() << host_name << "/" << cpu_model << "/"
+                                      << GetCpuCount() << "cpu").GetString());
+}
+
+// Parses the value of --gtest_<flag>, a percentage such as "5%" or "5",
+// into a fraction.
+static bool ParsePercentageFlag(const char* flag, const std::string& text,
+                                double* fraction) {
+  char* end = NULL;
+  const double percent = strtod(text.c_str(), &end);
+  if (end == text.c_str() || (*end != '\0' && strcmp(end, "%") != 0) ||
+      percent < 0) {
+    GTEST_LOG_(WARNING) << "--gtest_" << flag << " expects a "
+                        << "percentage such as 5%, got \"" << text << "\".";
+    return false;
+  }
+  *fraction = percent / 100;
+  return true;
+}
+
+// Benchmark results of one run, stored per host in a versioned text file:
+//
+//   mygtest-benchmark-baseline 1
+//   host <host fingerprint>
+//   build <build id>
+//   bench <Case.Name/threads:N> <sample count> <ns/op> ...
+//   end
+class BenchmarkBaseline {
+ public:
+  static BenchmarkBaseline* GetInstance() {
+    static BenchmarkBaseline instance;
+    return &instance;
+  }
+
+  // Returns the baseline samples for key on this host, or NULL.
+  const std::vector<double>* Find(const std::string& key);
+
+  // Remembers samples for key, to be saved when the program ends.
+  void Record(const std::string& key, const std::vector<double>& samples);
+
+  void Save(const std::string& path);
+
+ private:
+  typedef std::map<std::string, std::vector<double> > Entries;
+
+  struct Section {
+    std::string build_id;
+    Entries entries;
+  };
+
+  typedef std::map<std::string, Section> Sections;
+
+  BenchmarkBaseline()
+      : host_(GetHostFingerprint()),
+        loaded_(false),
+        writer_installed_(false) {}
+
+  static bool Load(const std::string& path, Sections* sections);
+
+  const std::string host_;
+  bool loaded_;
+  bool writer_installed_;
+  Section baseline_;
+  Section current_;
+  Mutex mutex_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(BenchmarkBaseline);
+};
+
+class BenchmarkBaselineWriter
+    : public SelectiveTestEventListener<kOnTestProgramEnd> {
+ public:
+  virtual void OnTestProgramEnd(const UnitTest& /*unit_test*/) {
+    BenchmarkBaseline::GetInstance()->Save(
+        GTEST_FLAG(benchmark_save_baseline));
+  }
+};
+
+bool BenchmarkBaseline::Load(const std::string& path, Sections* sections) {
+  std::ifstream input(path.c_str());
+  if (!input)
+    return false;
+
+  std::string magic;
+  int version = 0;
+  if (!(input >> magic >> version) || magic != kBaselineMagic ||
+      version != kBaselineVersion) {
+    GTEST_LOG_(WARNING) << path << " is not a version " << kBaselineVersion
+                        << " benchmark baseline; ignoring it.";
+    return false;
+  }
+
+  std::string keyword;
+  Section* section = NULL;
+  while (input >> keyword) {
+    if (keyword == "host") {
+      std::string host;
+      input >> host;
+      section = &(*sections)[host];
+      section->entries.clear();
+    } else if (keyword == "build" && section != NULL) {
+      input >> section->build_id;
+    } else if (keyword == "bench" && section != NULL) {
+      std::string key;
+      size_t count = 0;
+      input >> key >> count;
+      std::vector<double>& samples = section->entries[key];
+      samples.resize(count);
+      for (size_t i = 0; i < count; ++i)
+        input >> samples[i];
+    } else if (keyword == "end") {
+      section = NULL;
+    } else {
+      GTEST_LOG_(WARNING) << path << " is malformed near \"" << keyword
+                          << "\"; ignoring the rest of it.";
+      break;
+    }
+  }
+  return true;
+}
+
+const std::vector<double>* BenchmarkBaseline::Find(const std::string& key) {
+  MutexLock lock(&mutex_);
+  if (!loaded_) {
+    loaded_ = true;
+    Sections sections;
+    if (!Load(GTEST_FLAG(benchmark_baseline), &sections)) {
+      printf("[ BASELINE ] No baseline in %s; nothing to compare against.\n",
+             GTEST_FLAG(benchmark_baseline).c_str());
+    } else if (sections.count(host_) == 0) {
+      printf("[ BASELINE ] %s has no results for host %s.\n",
+             GTEST_FLAG(benchmark_baseline).c_str(), host_.c_str());
+    } else {
+      baseline_ = sections[host_];
+      printf("[ BASELINE ] Comparing against build %s.\n",
+             baseline_.build_id.c_str());
+    }
+  }
+
+  Entries::const_iterator it = baseline_.entries.find(key);
+  return it == baseline_.entries.end() ? NULL : &it->second;
+}
+
+void BenchmarkBaseline::Record(const std::string& key,
+                               const std::vector<double>& samples) {
+  MutexLock lock(&mutex_);
+  current_.entries[key] = samples;
+  if (!writer_installed_) {
+    writer_installed_ = true;
+    UnitTest::GetInstance()->listeners().Append(new BenchmarkBaselineWriter);
+  }
+}
+
+void BenchmarkBaseline::Save(const std::string& path) {
+  MutexLock lock(&mutex_);
+  Sections sections;
+  Load(path, &sections);
+
+  // Benchmarks that didn't run this time keep their old results.
+  Section& section = sections[host_];
+  section.build_id = GetBuildId();
+  for (Entries::const_iterator it = current_.entries.begin();
+       it != current_.entries.end(); ++it) {
+    section.entries[it->first] = it->second;
+  }
+
+  const std::string temp_path = path + ".tmp";
+  FILE* const file = fopen(temp_path.c_str(), "w");
+  if (file == NULL) {
+    GTEST_LOG_(WARNING) << "Unable to write benchmark baseline " << path;
+    return;
+  }
+
+  fprintf(file, "%s %d\n", kBaselineMagic, kBaselineVersion);
+  for (Sections::const_iterator it = sections.begin();
+       it != sections.end(); ++it) {
+    fprintf(file, "host %s\nbuild %s\n", it->first.c_str(),
+            it->second.build_id.c_str());
+    const Entries& entries = it->second.entries;
+    for (Entries::const_iterator entry = entries.begin();
+         entry != entries.end(); ++entry) {
+      fprintf(file, "bench %s %u", entry->first.c_str(),
+              static_cast<unsigned int>(entry->second.size()));
+      for (size_t i = 0; i < entry->second.size(); ++i)
+        fprintf(file, " %.3f", entry->second[i]);
+      fprintf(file, "\n");
+    }
+    fprintf(file, "end\n");
+  }
+
+  if (fclose(file) != 0 || rename(temp_path.c_str(), path.c_str()) != 0)
+    GTEST_LOG_(WARNING) << "Unable to write benchmark baseline " << path;
+}
+
+// Reads the first word of a sysfs file, returning false if it's missing.
+static bool ReadSysfsValue(const std::string& path, std::string* value) {
+  std::ifstream input(path.c_str());
+  return static_cast<bool>(input >> *value);
+}
+
+// Returns the two-sided 95% quantile of Student's t distribution.
+static double StudentT95(size_t degrees_of_freedom) {
+  static const double kQuantiles[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+  };
+  static const size_t kCount = sizeof(kQuantiles) / sizeof(kQuantiles[0]);
+  if (degrees_of_freedom == 0)
+    return HUGE_VAL;
+  return degrees_of_freedom <= kCount ? kQuantiles[degrees_of_freedom - 1] :
+      1.960;
+}
+
+// Returns the half-width of the 95% confidence interval of the mean of
+// samples relative to the mean, or infinity for fewer than two samples.
+static double RelativeConfidenceInterval(const std::vector<double>& samples) {
+  const size_t n = samples.size();
+  if (n < 2)
+    return HUGE_VAL;
+
+  double mean = 0;
+  for (size_t i = 0; i < n; ++i)
+    mean += samples[i];
+  mean /= n;
+  double squares = 0;
+  for (size_t i = 0; i < n; ++i)
+    squares += (samples[i] - mean) * (samples[i] - mean);
+  if (mean <= 0)
+    return HUGE_VAL;
+  return StudentT95(n - 1) * std::sqrt(squares / (n - 1) / n) / mean;
+}
+
+// Prepares the machine for benchmarking once per program: picks the CPU
+// benchmarks are pinned to, warns about frequency scaling and SMT, and
+// measures how much the timer itself adds to a measurement.
+class BenchmarkEnvironment {
+ public:
+  static BenchmarkEnvironment* GetInstance() {
+    static BenchmarkEnvironment instance;
+    return &instance;
+  }
+
+  void Prepare();
+
+  // Pins the calling thread to the benchmark CPU, if benchmarks are pinned.
+  void PinCurrentThread() const;
+
+  // Lets the calling thread run on the CPUs the program started with.
+  void UnpinCurrentThread() const;
+
+ private:
+  BenchmarkEnvironment()
+      : prepared_(false),
+        pinned_(false),
+        cpu_(-1) {}
+
+  static void CheckCpu(int cpu);
+
+  void MeasureTimer();
+
+  bool prepared_;
+  bool pinned_;
+  int cpu_;
+  cpu_set_t original_affinity_;
+  Mutex mutex_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(BenchmarkEnvironment);
+};
+
+void BenchmarkEnvironment::Prepare() {
+  MutexLock lock(&mutex_);
+  if (prepared_)
+    return;
+  prepared_ = true;
+
+  cpu_ = sched_getcpu();
+  if (GTEST_FLAG(benchmark_pin) && cpu_ >= 0 &&
+      pthread_getaffinity_np(pthread_self(), sizeof(original_affinity_),
+                             &original_affinity_) == 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu_, &cpus);
+    pinned_ = pthread_setaffinity_np(pthread_self(), sizeof(cpus),
+                                     &cpus) == 0;
+  }
+  if (pinned_)
+    printf("[   BENCH  ] Pinned to CPU %d.\n", cpu_);
+  if (cpu_ >= 0)
+    CheckCpu(cpu_);
+  MeasureTimer();
+  fflush(stdout);
+}
+
+void BenchmarkEnvironment::PinCurrentThread() const {
+  if (pinned_) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu_, &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+  }
+}
+
+void BenchmarkEnvironment::UnpinCurrentThread() const {
+  if (pinned_) {
+    pthread_setaffinity_np(pthread_self(), sizeof(original_affinity_),
+                           &original_affinity_);
+  }
+}
+
+void BenchmarkEnvironment::CheckCpu(int cpu) {
+  const std::string cpu_dir = (Message()
+      << "/sys/devices/system/cpu/cpu" << cpu).GetString();
+  std::string value;
+  if (ReadSysfsValue(cpu_dir + "/cpufreq/scaling_governor", &value) &&
+      value != "performance") {
+    printf("[   BENCH  ] Warning: CPU %d uses the %s frequency governor "
+           "rather than performance; results may be noisy.\n",
+           cpu, value.c_str());
+  }
+
+  if ((ReadSysfsValue("/sys/devices/system/cpu/intel_pstate/no_turbo",
+                      &value) && value == "0") ||
+      (ReadSysfsValue("/sys/devices/system/cpu/cpufreq/boost", &value) &&
+       value == "1")) {
+    printf("[   BENCH  ] Warning: turbo boost is enabled; results depend on "
+           "temperature and load.\n");
+  }
+
+  bool smt = false;
+  if (ReadSysfsValue("/sys/devices/system/cpu/smt/active", &value)) {
+    smt = value == "1";
+  } else if (ReadSysfsValue(cpu_dir + "/topology/thread_siblings_list",
+                            &value)) {
+    smt = value.find_first_of(",-") != std::string::npos;
+  }
+  if (smt) {
+    printf("[   BENCH  ] Warning: SMT is active; a sibling thread may share "
+           "the benchmarked core.\n");
+  }
+}
+
+void BenchmarkEnvironment::MeasureTimer() {
+  static const int kTimerSamples = 100000;
+  LatencyHistogram deltas;
+  Int64 previous = GetTimeInNanos();
+  for (int i = 0; i < kTimerSamples; ++i) {
+    const Int64 now = GetTimeInNanos();
+    deltas.Record(now - previous);
+    previous = now;
+  }
+  printf("[   BENCH  ] Timer overhead p50 %s  p99 %s  max %s\n",
+         FormatNanos(deltas.Percentile(50)).c_str(),
+         FormatNanos(deltas.Percentile(99)).c_str(),
+         FormatNanos(deltas.max()).c_str());
+}
+
+// Pins the calling thread for one benchmark and unpins it after, so the
+// tests that follow, and the threads they start, get every CPU back.
+class ScopedBenchmarkPin {
+ public:
+  ScopedBenchmarkPin() {
+    BenchmarkEnvironment* const environment =
+        BenchmarkEnvironment::GetInstance();
+    environment->Prepare();
+    environment->PinCurrentThread();
+  }
+
+  ~ScopedBenchmarkPin() {
+    BenchmarkEnvironment::GetInstance()->UnpinCurrentThread();
+  }
+
+ private:
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(ScopedBenchmarkPin);
+};
+
+class BenchmarkRunner {
+ public:
+  explicit BenchmarkRunner(Benchmark* benchmark)
+      : benchmark_(benchmark),
+        options_(benchmark->benchmark_options()),
+        barrier_(NULL),
+        iterations_(0),
+        single_thread_rate_(0) {}
+
+  void Run();
+
+ private:
+  struct ThreadParam {
+    BenchmarkRunner* runner;
+    int thread_index;
+    int threads;
+    Int64 elapsed_nanos;
+    LatencyHistogram* histogram;
+    bool cold;
+  };
+
+  // Per-thread elapsed nanoseconds of one run.
+  typedef std::vector<Int64> ThreadNanos;
+
+  static void ThreadMain(ThreadParam* param);
+
+  // Runs the body with the given per-thread iteration count on threads
+  // threads released together from a barrier.  Returns false if the body
+  // failed fatally or never started its timer.
+  bool RunOnThreads(int threads, Int64 iterations, bool cold,
+                    ThreadNanos* thread_nanos);
+
+  // Runs repetitions() times, and then more until the confidence interval
+  // meets --gtest_benchmark_target_ci, returning the ns/op samples and the
+  // run with the median one.
+  bool RunRepetitions(int threads, Int64 iterations, bool cold,
+                      std::vector<double>* samples, ThreadNanos* median_run);
+
+  Int64 Calibrate();
+
+  static double NanosPerOp(const ThreadNanos& thread_nanos, Int64 iterations);
+
+  void Report(int threads, Int64 iterations, const ThreadNanos& thread_nanos,
+              const std::string& noise);
+
+  // Describes the uncertainty of the samples, or n/a for a single sample,
+  // which has none to measure.
+  static std::string FormatNoise(const std::vector<double>& samples);
+
+  void ReportLatency() const;
+
+  static void ReportColdCache(double warm_nanos, double cold_nanos);
+
+  // Classifies samples against the baseline, failing the benchmark on a
+  // regression beyond --gtest_benchmark_fail_on_regression.
+  void CompareWithBaseline(const std::string& key,
+                           const std::vector<double>& samples);
+
+  int repetitions() const;
+
+  // Returns the relative confidence interval to repeat until, or 0.
+  static double target_confidence_interval();
+
+  Benchmark* const benchmark_;
+  const BenchmarkOptions options_;
+  Barrier* barrier_;
+  Int64 iterations_;
+  double single_thread_rate_;
+  LatencyHistogram latency_;
+  scoped_ptr<CacheEvictor> evictor_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(BenchmarkRunner);
+};
+
+// Passes a benchmark thread's failures on, noting a fatal one, after
+// which the body returns without finishing its loop.
+class FatalFailureNotingReporter : public TestPartResultReporterInterface {
+ public:
+  explicit FatalFailureNotingReporter(TestPartResultReporterInterface* next)
+      : next_(next), fatally_failed_(false) {}
+
+  virtual void ReportTestPartResult(const TestPartResult& result) {
+    if (result.fatally_failed())
+      fatally_failed_ = true;
+    next_->ReportTestPartResult(result);
+  }
+
+  bool fatally_failed() const { return fatally_failed_; }
+
+ private:
+  TestPartResultReporterInterface* const next_;
+  bool fatally_failed_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(FatalFailureNotingReporter);
+};
+
+void BenchmarkRunner::ThreadMain(ThreadParam* param) {
+  BenchmarkRunner* const runner = param->runner;
+  if (runner->options_.pin_threads()) {
+    PinCurrentThreadToCpu(param->thread_index % GetCpuCount());
+  } else if (param->thread_index > 0) {
+    // Workers inherit the calling thread's pinning to a single CPU.
+    BenchmarkEnvironment::GetInstance()->UnpinCurrentThread();
+  }
+
+  BenchmarkState state(param->thread_index, param->threads,
+                       runner->iterations_, param->histogram,
+                       runner->options_.ops_per_second(),
+                       param->cold ? runner->evictor_.get() : NULL);
+  UnitTestImpl* const impl = GetUnitTestImpl();
+  TestPartResultReporterInterface* const default_reporter =
+      impl->GetTestPartResultReporterForCurrentThread();
+  FatalFailureNotingReporter reporter(default_reporter);
+  impl->SetTestPartResultReporterForCurrentThread(&reporter);
+
+  runner->barrier_->Wait();
+  runner->benchmark_->BenchmarkBody(state);
+
+  impl->SetTestPartResultReporterForCurrentThread(default_reporter);
+  if (!state.finished()) {
+    // A body that stopped at a fatal failure has been reported already.
+    if (!reporter.fatally_failed()) {
+      GTEST_NONFATAL_FAILURE_(
+          "The benchmark body must loop on state.KeepRunning() "
+          "until it returns false.");
+    }
+    param->elapsed_nanos = -1;
+    return;
+  }
+  param->elapsed_nanos = state.elapsed_nanos();
+}
+
+bool BenchmarkRunner::RunOnThreads(int threads, Int64 iterations, bool cold,
+                                   ThreadNanos* thread_nanos) {
+  cpu_set_t saved_affinity;
+  const bool restore_affinity = options_.pin_threads() &&
+      pthread_getaffinity_np(pthread_self(), sizeof(saved_affinity),
+                             &saved_affinity) == 0;
+
+  Barrier barrier(threads);
+  barrier_ = &barrier;
+  iterations_ = iterations;
+
+  if (cold && evictor_.get() == NULL)
+    evictor_.reset(new CacheEvictor);
+
+  // Cold latencies would swamp the warm distribution, so they're dropped.
+  const bool record_latency = options_.latency() && !cold;
+  std::vector<LatencyHistogram> histograms(record_latency ? threads : 0);
+  std::vector<ThreadParam> params(threads);
+  for (int i = 0; i < threads; ++i) {
+    ThreadParam param = { this, i, threads, 0,
+                          record_latency ? &histograms[i] : NULL, cold };
+    params[i] = param;
+  }
+
+  // Thread 0 is the calling thread so that single-threaded runs don't pay
+  // for a thread start and report failures on the test's own thread.
+  std::vector<ThreadWithParam<ThreadParam*>*> workers;
+  for (int i = 1; i < threads; ++i) {
+    workers.push_back(
+        new ThreadWithParam<ThreadParam*>(&ThreadMain, &params[i]));
+  }
+  ThreadMain(&params[0]);
+  ForEach(workers, Delete<ThreadWithParam<ThreadParam*> >);
+  barrier_ = NULL;
+  for (size_t i = 0; i < histograms.size(); ++i)
+    latency_.Merge(histograms[i]);
+
+  if (restore_affinity) {
+    pthread_setaffinity_np(pthread_self(), sizeof(saved_affinity),
+                           &saved_affinity);
+  }
+
+  thread_nanos->clear();
+  for (int i = 0; i < threads; ++i) {
+    if (params[i].elapsed_nanos < 0)
+      return false;
+    thread_nanos->push_back(params[i].elapsed_nanos);
+  }
+  return !Test::HasFatalFailure();
+}
+
+Int64 BenchmarkRunner::Calibrate() {
+  if (options_.iterations() > 0)
+    return options_.iterations();
+
+  // At a fixed rate the run time follows from the iteration count.
+  if (options_.ops_per_second() > 0) {
+    return std::max<Int64>(1, static_cast<Int64>(
+        options_.ops_per_second() * options_.min_time_ms() / 1000));
+  }
+
+  const Int64 min_nanos = static_cast<Int64>(options_.min_time_ms()) * 1000000;
+  Int64 iterations = 1;
+  ThreadNanos thread_nanos;
+  for (;;) {
+    if (!RunOnThreads(1, iterations, false, &thread_nanos))
+      return 0;
+
+    const Int64 nanos = thread_nanos[0];
+    if (nanos >= min_nanos || iterations >= kMaxBenchmarkIterations)
+      return iterations;
+
+    const double multiplier = nanos <= 0 ? 10.0 :
+        std::min(10.0, 1.4 * static_cast<double>(min_nanos) / nanos);
+    iterations = std::max(iterations + 1,
+                          static_cast<Int64>(iterations * multiplier));
+    iterations = std::min(iterations, kMaxBenchmarkIterations);
+  }
+}
+
+double BenchmarkRunner::NanosPerOp(const ThreadNanos& thread_nanos,
+                                   Int64 iterations) {
+  double total_nanos = 0;
+  for (size_t i = 0; i < thread_nanos.size(); ++i)
+    total_nanos += thread_nanos[i];
+  return total_nanos / thread_nanos.size() / iterations;
+}
+
+void BenchmarkRunner::Report(int threads, Int64 iteration_count,
+                             const ThreadNanos& thread_nanos,
+                             const std::string& noise) {
+  const double iterations = static_cast<double>(iteration_count);
+  Int64 wall_nanos = 0;
+  double per_thread_rate = 0;
+  for (size_t i = 0; i < thread_nanos.size(); ++i) {
+    wall_nanos = std::max(wall_nanos, thread_nanos[i]);
+    per_thread_rate += thread_nanos[i] > 0 ?
+        iterations * 1e9 / thread_nanos[i] : 0;
+  }
+  per_thread_rate /= threads;
+
+  const double aggregate_rate = wall_nanos > 0 ?
+      threads * iterations * 1e9 / wall_nanos : 0;
+  if (threads == 1)
+    single_thread_rate_ = aggregate_rate;
+  const double efficiency = single_thread_rate_ > 0 ?
+      aggregate_rate / (threads * single_thread_rate_) : 0;
+
+  printf("[   BENCH  ] %3d %s %12s/op  aggregate %14s  "
+         "per-thread %14s  scaling %5.1f%%  %s\n",
+         threads, threads == 1 ? "thread " : "threads",
+         FormatNanos(NanosPerOp(thread_nanos, iteration_count)).c_str(),
+         FormatRate(aggregate_rate).c_str(),
+         FormatRate(per_thread_rate).c_str(),
+         efficiency * 100, noise.c_str());
+  if (options_.latency())
+    ReportLatency();
+  fflush(stdout);
+}
+
+std::string BenchmarkRunner::FormatNoise(const std::vector<double>& samples) {
+  if (samples.size() < 2)
+    return "noise n/a (n=1)";
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "noise +-%.1f%% (n=%u)",
+           RelativeConfidenceInterval(samples) * 100,
+           static_cast<unsigned int>(samples.size()));
+  return buffer;
+}
+
+void BenchmarkRunner::ReportColdCache(double warm_nanos, double cold_nanos) {
+  printf("[   BENCH  ]     cache warm %s/op  cold %s/op  first touch +%s "
+         "(%.1fx)\n",
+         FormatNanos(warm_nanos).c_str(), FormatNanos(cold_nanos).c_str(),
+         FormatNanos(std::max(0.0, cold_nanos - warm_nanos)).c_str(),
+         warm_nanos > 0 ? cold_nanos / warm_nanos : 0);
+  fflush(stdout);
+}
+
+void BenchmarkRunner::ReportLatency() const {
+  const LatencyHistogram& merged = latency_;
+  printf("[   BENCH  ]     latency p50 %s  p90 %s  p99 %s  p99.9 %s  max %s\n",
+         FormatNanos(merged.Percentile(50)).c_str(),
+         FormatNanos(merged.Percentile(90)).c_str(),
+         FormatNanos(merged.Percentile(99)).c_str(),
+         FormatNanos(merged.Percentile(99.9)).c_str(),
+         FormatNanos(merged.max()).c_str());
+}
+
+void BenchmarkRunner::CompareWithBaseline(const std::string& key,
+                                          const std::vector<double>& samples) {
+  const std::vector<double>* const baseline =
+      BenchmarkBaseline::GetInstance()->Find(key);
+  if (baseline == NULL)
+    return;
+
+  const double old_median = Median(*baseline);
+  const double change = old_median > 0 ? Median(samples) / old_median - 1 : 0;
+  // With 3 samples a side, say, no outcome is significant, and calling it
+  // unchanged would pass any regression.
+  if (MinimumMannWhitneyPValue(baseline->size(), samples.size()) >=
+      kBaselineSignificance) {
+    printf("[ BASELINE ] %s: inconclusive %+.1f%% (%u vs %u samples are too "
+           "few to be significant)\n",
+           key.c_str(), change * 100,
+           static_cast<unsigned int>(baseline->size()),
+           static_cast<unsigned int>(samples.size()));
+    static bool warned = false;
+    if (!GTEST_FLAG(benchmark_fail_on_regression).empty() && !warned) {
+      warned = true;
+      GTEST_LOG_(WARNING)
+          << "--gtest_benchmark_fail_on_regression can't detect a "
+          << "regression with fewer than 4 samples on each side; run the "
+          << "baseline and the comparison with "
+          << "--gtest_benchmark_repetitions=4 or more.";
+    }
+    return;
+  }
+
+  const double p_value = MannWhitneyUTest(*baseline, samples);
+  const char* const verdict =
+      p_value >= kBaselineSignificance || change == 0 ? "unchanged" :
+      change > 0 ? "slower" : "faster";
+  printf("[ BASELINE ] %s: %s %+.1f%% (p=%.3f, %u vs %u samples)\n",
+         key.c_str(), verdict, change * 100, p_value,
+         static_cast<unsigned int>(baseline->size()),
+         static_cast<unsigned int>(samples.size()));
+
+  double threshold = 0;
+  if (p_value < kBaselineSignificance && change > 0 &&
+      !GTEST_FLAG(benchmark_fail_on_regression).empty() &&
+      ParsePercentageFlag("benchmark_fail_on_regression",
+                          GTEST_FLAG(benchmark_fail_on_regression),
+                          &threshold) &&
+      change > threshold) {
+    const std::string message = (Message()
+        << key << " regressed by " << change * 100 << "% (p=" << p_value
+        << "), more than the allowed "
+        << GTEST_FLAG(benchmark_fail_on_regression) << ".").GetString();
+    const TestInfo* const test_info =
+        UnitTest::GetInstance()->current_test_info();
+    GTEST_MESSAGE_AT_(test_info->file(), test_info->line(), message.c_str(),
+                      TestPartResult::kNonFatalFailure);
+  }
+}
+
+bool BenchmarkRunner::RunRepetitions(int threads, Int64 iterations, bool cold,
+                                     std::vector<double>* samples,
+                                     ThreadNanos* median_run) {
+  const double target = target_confidence_interval();
+  size_t min_runs = static_cast<size_t>(repetitions());
+  size_t max_runs = min_runs;
+  if (target > 0) {
+    min_runs = std::max<size_t>(min_runs, 2);
+    max_runs = std::max<size_t>(
+        min_runs, static_cast<size_t>(GTEST_FLAG(benchmark_max_repetitions)));
+  }
+
+  std::vector<ThreadNanos> runs;
+  std::vector<std::pair<double, size_t> > ranked;
+  samples->clear();
+  for (size_t r = 0; r < min_runs || (r < max_runs &&
+           RelativeConfidenceInterval(*samples) > target); ++r) {
+    runs.push_back(ThreadNanos());
+    if (!RunOnThreads(threads, iterations, cold, &runs[r]))
+      return false;
+    samples->push_back(NanosPerOp(runs[r], iterations));
+    ranked.push_back(std::make_pair(samples->back(), r));
+  }
+
+  std::sort(ranked.begin(), ranked.end());
+  *median_run = runs[ranked[ranked.size() / 2].second];
+  return true;
+}
+
+int BenchmarkRunner::repetitions() const {
+  const int repetitions = options_.repetitions() > 0 ?
+      options_.repetitions() : GTEST_FLAG(benchmark_repetitions);
+  return std::max(1, repetitions);
+}
+
+double BenchmarkRunner::target_confidence_interval() {
+  double target = 0;
+  if (GTEST_FLAG(benchmark_target_ci).empty() ||
+      !ParsePercentageFlag("benchmark_target_ci",
+                           GTEST_FLAG(benchmark_target_ci), &target)) {
+    return 0;
+  }
+  return target;
+}
+
+void BenchmarkRunner::Run() {
+  const ScopedBenchmarkPin pin;
+  const Int64 iterations = Calibrate();
+  if (iterations <= 0)
+    return;
+
+  const TestInfo* const test_info = UnitTest::GetInstance()->current_test_info();
+  const std::string name = std::string(test_info->test_case_name()) + "." +
+      test_info->name();
+  printf("[   BENCH  ] %s: %lld iterations per thread, %d repetitions",
+         name.c_str(), static_cast<long long>(iterations), repetitions());
+  if (target_confidence_interval() > 0) {
+    printf(" or more until noise is within %s",
+           GTEST_FLAG(benchmark_target_ci).c_str());
+  }
+  printf("\n");
+  const Int64 cold_iterations = options_.cold_iterations();
+  if (cold_iterations > 0) {
+    evictor_.reset(new CacheEvictor);
+    printf("[   BENCH  ] cold runs: %lld iterations per thread, "
+           "evicting %u MB before each\n",
+           static_cast<long long>(cold_iterations),
+           static_cast<unsigned int>(evictor_->size() >> 20));
+  }
+
+  std::vector<int> thread_counts;
+  for (int threads = 1; threads < options_.max_threads(); threads *= 2)
+    thread_counts.push_back(threads);
+  thread_counts.push_back(options_.max_threads());
+
+  const bool compare = !GTEST_FLAG(benchmark_baseline).empty();
+  const bool save = !GTEST_FLAG(benchmark_save_baseline).empty();
+  single_thread_rate_ = 0;
+  for (size_t i = 0; i < thread_counts.size(); ++i) {
+    const int threads = thread_counts[i];
+    ThreadNanos median_run;
+    if (options_.warm_up_iterations() > 0 &&
+        !RunOnThreads(threads, options_.warm_up_iterations(), false,
+                      &median_run)) {
+      return;
+    }
+    latency_.Clear();
+
+    // The table shows the median repetition.
+    std::vector<double> samples;
+    if (!RunRepetitions(threads, iterations, false, &samples, &median_run))
+      return;
+    Report(threads, iterations, median_run, FormatNoise(samples));
+
+    std::vector<double> cold_samples;
+    if (cold_iterations > 0) {
+      if (!RunRepetitions(threads, cold_iterations, true, &cold_samples,
+                          &median_run)) {
+        return;
+      }
+      ReportColdCache(Median(samples), Median(cold_samples));
+    }
+
+    const std::string key = (Message() << name << "/threads:" << threads)
+        .GetString();
+    if (compare) {
+      CompareWithBaseline(key, samples);
+      if (cold_iterations > 0)
+        CompareWithBaseline(key + "/cold", cold_samples);
+    }
+    if (save) {
+      BenchmarkBaseline::GetInstance()->Record(key, samples);
+      if (cold_iterations > 0)
+        BenchmarkBaseline::GetInstance()->Record(key + "/cold", cold_samples);
+    }
+  }
+}
+
+AssertionResult CmpHelperPercentileLT(const char* histogram_expression,
+                                      const char* bound_expression,
+                                      double percentile,
+                                      const LatencyHistogram& histogram,
+                                      Int64 bound_nanos) {
+  const Int64 actual = histogram.Percentile(percentile);
+  if (histogram.count() > 0 && actual < bound_nanos)
+    return AssertionSuccess();
+
+  return AssertionFailure()
+      << "Expected: p" << percentile << " of " << histogram_expression
+      << " < " << bound_expression << " (" << FormatNanos(bound_nanos) << ")\n"
+      << "  Actual: " << FormatNanos(actual) << " over "
+      << histogram.count() << " samples, max " << FormatNanos(histogram.max());
+}
+
+} // namespace internal
+
+
+/************************************************
+ * Benchmark
+ * member function implentation
+ ************************************************/
+void Benchmark::TestBody() {
+  internal::BenchmarkRunner runner(this);
+  runner.Run();
+}
+
+/************************************************
+ * end of Benchmark
+ ************************************************/
+
+} // namespace testing
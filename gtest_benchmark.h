@@ -0,0 +1,381 @@
+#ifndef GTEST_BENCHMARK_H_
+#define GTEST_BENCHMARK_H_
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "gtest.h"
+
+namespace testing {
+
+class LatencyHistogram;
+
+namespace internal {
+
+GTEST_DECLARE_int32_(benchmark_repetitions);
+GTEST_DECLARE_string_(benchmark_baseline);
+GTEST_DECLARE_string_(benchmark_save_baseline);
+GTEST_DECLARE_string_(benchmark_fail_on_regression);
+GTEST_DECLARE_bool_(benchmark_pin);
+GTEST_DECLARE_string_(benchmark_target_ci);
+GTEST_DECLARE_int32_(benchmark_max_repetitions);
+
+class BenchmarkRunner;
+class CacheEvictor;
+
+} // namespace internal
+
+
+/************************************************
+ * LatencyHistogram
+ ************************************************/
+// A log-bucketed histogram of nanosecond latencies in the style of
+// HdrHistogram: every power-of-two range is split into kSubBuckets linear
+// buckets, so any recorded value is kept to within 1/kSubBuckets of its
+// magnitude with a fixed memory footprint.
+class GTEST_API_ LatencyHistogram {
+ public:
+  LatencyHistogram();
+
+  void Record(internal::Int64 nanos);
+
+  void Merge(const LatencyHistogram& other);
+
+  void Clear();
+
+  internal::Int64 count() const { return count_; }
+
+  internal::Int64 min() const { return count_ == 0 ? 0 : min_; }
+
+  internal::Int64 max() const { return max_; }
+
+  double mean() const {
+    return count_ == 0 ? 0 : static_cast<double>(sum_) / count_;
+  }
+
+  // Returns the smallest recorded value v such that percentile percent
+  // of the samples are less than or equal to v, up to bucket precision.
+  internal::Int64 Percentile(double percentile) const;
+
+ private:
+  enum {
+    kSubBucketBits = 6,
+    kSubBuckets = 1 << kSubBucketBits,
+    kBucketCount = (64 - kSubBucketBits) * kSubBuckets
+  };
+
+  static int BucketIndex(internal::Int64 nanos);
+
+  static internal::Int64 BucketUpperBound(int index);
+
+  std::vector<internal::Int64> buckets_;
+  internal::Int64 count_;
+  internal::Int64 sum_;
+  internal::Int64 min_;
+  internal::Int64 max_;
+};
+
+
+/************************************************
+ * BenchmarkOptions
+ ************************************************/
+class GTEST_API_ BenchmarkOptions {
+ public:
+  BenchmarkOptions()
+      : max_threads_(1),
+        pin_threads_(false),
+        min_time_ms_(100),
+        iterations_(0),
+        latency_(false),
+        ops_per_second_(0),
+        repetitions_(0),
+        cold_iterations_(0),
+        warm_up_iterations_(0) {}
+
+  // Runs the body on 1, 2, 4 ... max_threads threads.
+  BenchmarkOptions& Threads(int max_threads) {
+    max_threads_ = max_threads < 1 ? 1 : max_threads;
+    return *this;
+  }
+
+  // Pins benchmark thread i to CPU i modulo the number of CPUs.
+  BenchmarkOptions& PinThreads(bool pin = true) {
+    pin_threads_ = pin;
+    return *this;
+  }
+
+  // Minimum time a single-threaded run must take when calibrating.
+  BenchmarkOptions& MinTimeMillis(int min_time_ms) {
+    min_time_ms_ = min_time_ms;
+    return *this;
+  }
+
+  // Fixes the per-thread iteration count and skips calibration.
+  BenchmarkOptions& Iterations(internal::Int64 iterations) {
+    iterations_ = iterations;
+    return *this;
+  }
+
+  // Times every iteration into a LatencyHistogram and reports percentiles.
+  BenchmarkOptions& Latency(bool latency = true) {
+    latency_ = latency;
+    return *this;
+  }
+
+  // Issues iterations at a fixed rate per thread instead of back to back
+  // and measures each latency from its intended start, which corrects for
+  // coordinated omission.  Implies Latency().
+  BenchmarkOptions& FixedRate(double ops_per_second) {
+    ops_per_second_ = ops_per_second;
+    latency_ = latency_ || ops_per_second > 0;
+    return *this;
+  }
+
+  // Repeats every run, overriding --gtest_benchmark_repetitions.
+  BenchmarkOptions& Repetitions(int repetitions) {
+    repetitions_ = repetitions;
+    return *this;
+  }
+
+  // Also runs the body with the caches evicted before every iteration, by
+  // streaming through a buffer twice the size of the last-level cache, and
+  // reports these cold numbers next to the warm ones.  Eviction is slow, so
+  // cold runs use their own, small iteration count.
+  BenchmarkOptions& ColdCache(internal::Int64 iterations = 16) {
+    cold_iterations_ = iterations;
+    return *this;
+  }
+
+  // Runs this many untimed iterations before measuring each thread count.
+  BenchmarkOptions& WarmUp(internal::Int64 iterations) {
+    warm_up_iterations_ = iterations;
+    return *this;
+  }
+
+  int max_threads() const { return max_threads_; }
+  bool pin_threads() const { return pin_threads_; }
+  int min_time_ms() const { return min_time_ms_; }
+  internal::Int64 iterations() const { return iterations_; }
+  bool latency() const { return latency_; }
+  double ops_per_second() const { return ops_per_second_; }
+  int repetitions() const { return repetitions_; }
+  internal::Int64 cold_iterations() const { return cold_iterations_; }
+  internal::Int64 warm_up_iterations() const { return warm_up_iterations_; }
+
+ private:
+  int max_threads_;
+  bool pin_threads_;
+  int min_time_ms_;
+  internal::Int64 iterations_;
+  bool latency_;
+  double ops_per_second_;
+  int repetitions_;
+  internal::Int64 cold_iterations_;
+  internal::Int64 warm_up_iterations_;
+};
+
+
+/************************************************
+ * BenchmarkState
+ ************************************************/
+class BenchmarkState;
+
+template <typename Function>
+LatencyHistogram MeasureLatency(internal::Int64 iterations,
+                                Function function,
+                                double ops_per_second = 0);
+
+class GTEST_API_ BenchmarkState {
+ public:
+  // Returns true while the body should run another iteration.  The
+  // timer starts at the first call and stops at the call returning false.
+  bool KeepRunning() {
+    if (remaining_ > 0) {
+      --remaining_;
+      return true;
+    }
+    return KeepRunningSlow();
+  }
+
+  int thread_index() const { return thread_index_; }
+
+  int threads() const { return threads_; }
+
+  internal::Int64 iterations() const { return iterations_; }
+
+ private:
+  friend class internal::BenchmarkRunner;
+
+  template <typename Function>
+  friend LatencyHistogram MeasureLatency(internal::Int64 iterations,
+                                         Function function,
+                                         double ops_per_second);
+
+  // A non-NULL histogram or evictor times every iteration individually;
+  // the evictor then flushes the caches before each one, off the clock.
+  BenchmarkState(int thread_index, int threads, internal::Int64 iterations,
+                 LatencyHistogram* histogram = NULL,
+                 double ops_per_second = 0,
+                 const internal::CacheEvictor* evictor = NULL);
+
+  bool KeepRunningSlow();
+
+  bool finished() const { return finished_; }
+
+  bool timed_per_iteration() const {
+    return histogram_ != NULL || evictor_ != NULL;
+  }
+
+  internal::Int64 elapsed_nanos() const {
+    return evictor_ != NULL ? measured_nanos_ : stop_nanos_ - start_nanos_;
+  }
+
+  const int thread_index_;
+  const int threads_;
+  const internal::Int64 iterations_;
+  internal::Int64 remaining_;
+  bool started_;
+  bool finished_;
+  internal::Int64 start_nanos_;
+  internal::Int64 stop_nanos_;
+  LatencyHistogram* const histogram_;
+  const internal::Int64 interval_nanos_;
+  internal::Int64 issued_;
+  internal::Int64 op_start_nanos_;
+  const internal::CacheEvictor* const evictor_;
+  internal::Int64 measured_nanos_;
+  internal::Int64 evict_sink_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(BenchmarkState);
+};
+
+// Calls function iterations times and returns the histogram of its
+// latencies.  A positive ops_per_second issues the calls at a fixed rate.
+template <typename Function>
+LatencyHistogram MeasureLatency(internal::Int64 iterations,
+                                Function function,
+                                double ops_per_second) {
+  LatencyHistogram histogram;
+  BenchmarkState state(0, 1, iterations, &histogram, ops_per_second);
+  while (state.KeepRunning()) {
+    function();
+  }
+  return histogram;
+}
+
+namespace internal {
+
+inline Int64 LatencyBoundToNanos(Int64 nanos) { return nanos; }
+
+template <typename Rep, typename Period>
+Int64 LatencyBoundToNanos(const std::chrono::duration<Rep, Period>& bound) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(bound).count();
+}
+
+GTEST_API_ AssertionResult CmpHelperPercentileLT(
+    const char* histogram_expression,
+    const char* bound_expression,
+    double percentile,
+    const LatencyHistogram& histogram,
+    Int64 bound_nanos);
+
+} // namespace internal
+
+
+/************************************************
+ * Benchmark
+ ************************************************/
+class GTEST_API_ Benchmark : public Test {
+ public:
+  const BenchmarkOptions& benchmark_options() const { return options_; }
+
+ protected:
+  Benchmark() {}
+
+  void set_benchmark_options(const BenchmarkOptions& options) {
+    options_ = options;
+  }
+
+ private:
+  friend class internal::BenchmarkRunner;
+
+  virtual void TestBody();
+
+  // Called concurrently on every benchmark thread with a per-thread state.
+  virtual void BenchmarkBody(BenchmarkState& state) = 0;
+
+  BenchmarkOptions options_;
+};
+
+} // namespace testing
+
+// The bound is either a nanosecond count or a std::chrono::duration,
+// e.g. EXPECT_P99_LT(histogram, std::chrono::microseconds(2)).
+#define GTEST_PERCENTILE_LT_(histogram, percentile, bound, on_failure) \
+  GTEST_ASSERT_(::testing::internal::CmpHelperPercentileLT( \
+                    #histogram, #bound, percentile, histogram, \
+                    ::testing::internal::LatencyBoundToNanos(bound)), \
+                on_failure)
+
+#define EXPECT_PERCENTILE_LT(histogram, percentile, bound) \
+  GTEST_PERCENTILE_LT_(histogram, percentile, bound, GTEST_NONFATAL_FAILURE_)
+#define ASSERT_PERCENTILE_LT(histogram, percentile, bound) \
+  GTEST_PERCENTILE_LT_(histogram, percentile, bound, GTEST_FATAL_FAILURE_)
+
+#define EXPECT_P50_LT(histogram, bound) \
+  EXPECT_PERCENTILE_LT(histogram, 50, bound)
+#define EXPECT_P90_LT(histogram, bound) \
+  EXPECT_PERCENTILE_LT(histogram, 90, bound)
+#define EXPECT_P99_LT(histogram, bound) \
+  EXPECT_PERCENTILE_LT(histogram, 99, bound)
+#define EXPECT_P999_LT(histogram, bound) \
+  EXPECT_PERCENTILE_LT(histogram, 99.9, bound)
+
+#define ASSERT_P50_LT(histogram, bound) \
+  ASSERT_PERCENTILE_LT(histogram, 50, bound)
+#define ASSERT_P90_LT(histogram, bound) \
+  ASSERT_PERCENTILE_LT(histogram, 90, bound)
+#define ASSERT_P99_LT(histogram, bound) \
+  ASSERT_PERCENTILE_LT(histogram, 99, bound)
+#define ASSERT_P999_LT(histogram, bound) \
+  ASSERT_PERCENTILE_LT(histogram, 99.9, bound)
+
+#define GTEST_BENCHMARK_(test_case, test_name, parent, options) \
+class GTEST_API_ GTEST_TEST_CLASS_NAME_(test_case, test_name) : public parent {\
+ public:\
+  GTEST_TEST_CLASS_NAME_(test_case, test_name)() {\
+    set_benchmark_options(options);\
+  }\
+ private:\
+  virtual void BenchmarkBody(::testing::BenchmarkState& state);\
+  static testing::TestInfo* test_info_;\
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(GTEST_TEST_CLASS_NAME_(test_case, test_name));\
+};\
+\
+testing::TestInfo* GTEST_TEST_CLASS_NAME_(test_case, test_name)\
+  ::test_info_ = testing::internal::ExcludeFromStress(\
+      testing::internal::MakeAndRegisterTestInfo(\
+          #test_case, #test_name,\
+          ::testing::internal::CodeLocation(__FILE__, __LINE__), \
+          parent::SetUpTestCase, parent::TearDownTestCase, \
+          new testing::internal::TestFactoryImpl<\
+              GTEST_TEST_CLASS_NAME_(test_case, test_name)>));\
+\
+void GTEST_TEST_CLASS_NAME_(test_case, test_name)::BenchmarkBody(\
+    ::testing::BenchmarkState& state)
+
+#define BENCHMARK_WITH(test_case, test_name, options) \
+  GTEST_BENCHMARK_(test_case, test_name, ::testing::Benchmark, options)
+
+#define BENCHMARK(test_case, test_name) \
+  BENCHMARK_WITH(test_case, test_name, ::testing::BenchmarkOptions())
+
+// The fixture must derive from ::testing::Benchmark.
+#define BENCHMARK_F_WITH(test_fixture, test_name, options) \
+  GTEST_BENCHMARK_(test_fixture, test_name, test_fixture, options)
+
+#define BENCHMARK_F(test_fixture, test_name) \
+  BENCHMARK_F_WITH(test_fixture, test_name, ::testing::BenchmarkOptions())
+
+#endif // GTEST_BENCHMARK_H_
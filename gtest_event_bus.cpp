@@ -0,0 +1,330 @@
+#include <sched.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gtest_event_bus.h"
+
+namespace testing {
+namespace internal {
+
+GTEST_DEFINE_bool_(
+    async_listeners,
+    internal::BoolFromGTestEnv("async_listeners", false),
+    "True iff listeners should get events on a thread of their own instead "
+    "of on the test threads.");
+
+// A power of two.
+static const size_t kQueueCells = 4096;
+// How long the listener thread sleeps between checks for events when no
+// wake-up comes, in case one was missed.
+static const long kIdleWaitMillis = 10;
+
+// Set on the listener thread, which delivers what it posts itself.
+static __thread bool on_listener_thread = false;
+
+static const int kCrashSignals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+
+// How long a crash handler waits for the listener thread, in 1 ms steps.
+static const int kCrashFlushAttempts = 1000;
+
+// The bus drained on a crash.  A forked worker has no listener thread, so
+// only the process that made the bus waits for it.
+static AsyncEventBus* volatile crash_bus = NULL;
+static pid_t crash_bus_pid = 0;
+static struct sigaction previous_actions[NSIG];
+
+/**** AsyncEventBus member function implentation ****/
+
+AsyncEventBus::AsyncEventBus(TestEventListener* target)
+    : target_(target),
+      cells_(kQueueCells),
+      mask_(kQueueCells - 1),
+      enqueue_pos_(0),
+      dequeue_pos_(0),
+      delivered_(0),
+      sleeping_(false),
+      flushing_(false),
+      stopping_(false) {
+  for (size_t i = 0; i < cells_.size(); ++i)
+    cells_[i].sequence = i;
+  thread_.reset(new ThreadWithParam<AsyncEventBus*>(&ThreadMain, this));
+  InstallCrashHandlers(this);
+}
+
+AsyncEventBus::~AsyncEventBus() {
+  if (crash_bus == this)
+    crash_bus = NULL;
+  Flush();
+  {
+    MutexLock lock(&mutex_);
+    __atomic_store_n(&stopping_, true, __ATOMIC_SEQ_CST);
+    posted_.Signal();
+  }
+  thread_->Join();
+}
+
+void AsyncEventBus::OnTestProgramStart(const UnitTest& unit_test) {
+  const Event event = { kOnTestProgramStart, &unit_test, NULL, NULL, NULL, 0 };
+  Post(event);
+}
+
+void AsyncEventBus::OnTestIterationStart(const UnitTest& unit_test,
+                                         int iteration) {
+  const Event event = { kOnTestIterationStart, &unit_test, NULL, NULL, NULL,
+                        iteration };
+  Post(event);
+}
+
+void AsyncEventBus::OnEnvironmentsSetUpStart(const UnitTest& unit_test) {
+  const Event event = { kOnEnvironmentsSetUpStart, &unit_test, NULL, NULL,
+                        NULL, 0 };
+  Post(event);
+}
+
+void AsyncEventBus::OnEnvironmentsSetUpEnd(const UnitTest& unit_test) {
+  const Event event = { kOnEnvironmentsSetUpEnd, &unit_test, NULL, NULL, NULL,
+                        0 };
+  Post(event);
+}
+
+void AsyncEventBus::OnTestCaseStart(const TestCase& test_case) {
+  const Event event = { kOnTestCaseStart, NULL, &test_case, NULL, NULL, 0 };
+  Post(event);
+}
+
+void AsyncEventBus::OnTestStart(const TestInfo& test_info) {
+  const Event event = { kOnTestStart, NULL, NULL, &test_info, NULL, 0 };
+  Post(event);
+}
+
+void AsyncEventBus::OnTestPartResult(const TestPartResult& result) {
+  const Event event = { kOnTestPartResult, NULL, NULL, NULL,
+                        new TestPartResult(result), 0 };
+  Post(event);
+}
+
+void AsyncEventBus::OnTestEnd(const TestInfo& test_info) {
+  const Event event = { kOnTestEnd, NULL, NULL, &test_info, NULL, 0 };
+  Post(event);
+}
+
+void AsyncEventBus::OnTestCaseEnd(const TestCase& test_case) {
+  const Event event = { kOnTestCaseEnd, NULL, &test_case, NULL, NULL, 0 };
+  Post(event);
+}
+
+void AsyncEventBus::OnEnvironmentsTearDownStart(const UnitTest& unit_test) {
+  const Event event = { kOnEnvironmentsTearDownStart, &unit_test, NULL, NULL,
+                        NULL, 0 };
+  Post(event);
+}
+
+void AsyncEventBus::OnEnvironmentsTearDownEnd(const UnitTest& unit_test) {
+  const Event event = { kOnEnvironmentsTearDownEnd, &unit_test, NULL, NULL,
+                        NULL, 0 };
+  Post(event);
+}
+
+void AsyncEventBus::OnTestIterationEnd(const UnitTest& unit_test,
+                                       int iteration) {
+  const Event event = { kOnTestIterationEnd, &unit_test, NULL, NULL, NULL,
+                        iteration };
+  Post(event);
+  // The next iteration clears the results the listeners are reading.
+  Flush();
+}
+
+void AsyncEventBus::OnTestProgramEnd(const UnitTest& unit_test) {
+  const Event event = { kOnTestProgramEnd, &unit_test, NULL, NULL, NULL, 0 };
+  Post(event);
+  Flush();
+}
+
+void AsyncEventBus::Flush() {
+  if (on_listener_thread)
+    return;
+
+  const UInt64 target = __atomic_load_n(&enqueue_pos_, __ATOMIC_ACQUIRE);
+  MutexLock lock(&mutex_);
+  flushing_ = true;
+  posted_.Signal();
+  while (__atomic_load_n(&delivered_, __ATOMIC_ACQUIRE) < target)
+    drained_.WaitFor(&mutex_, kIdleWaitMillis);
+  flushing_ = false;
+}
+
+void AsyncEventBus::ThreadMain(AsyncEventBus* bus) {
+  on_listener_thread = true;
+  for (;;) {
+    while (bus->DeliverNext()) {}
+    if (__atomic_load_n(&bus->stopping_, __ATOMIC_SEQ_CST) &&
+        !bus->DeliverNext())
+      return;
+    bus->WaitForEvents();
+  }
+}
+
+void AsyncEventBus::Post(const Event& event) {
+  // A listener's own failures are delivered at once; queueing them could
+  // wait forever on a full queue only this thread drains.
+  if (on_listener_thread) {
+    Deliver(event);
+    return;
+  }
+
+  UInt64 pos = __atomic_load_n(&enqueue_pos_, __ATOMIC_RELAXED);
+  Cell* cell;
+  for (;;) {
+    cell = &cells_[pos & mask_];
+    const UInt64 sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+    const Int64 difference =
+        static_cast<Int64>(sequence) - static_cast<Int64>(pos);
+    if (difference == 0) {
+      if (__atomic_compare_exchange_n(&enqueue_pos_, &pos, pos + 1, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        break;
+    } else if (difference < 0) {
+      // Full: the listener thread is behind, so let it run.
+      sched_yield();
+      pos = __atomic_load_n(&enqueue_pos_, __ATOMIC_RELAXED);
+    } else {
+      pos = __atomic_load_n(&enqueue_pos_, __ATOMIC_RELAXED);
+    }
+  }
+  cell->event = event;
+  __atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+
+  // Pairs with the fence in WaitForEvents: either the listener thread sees
+  // this event before it sleeps, or this thread sees it sleeping.
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&sleeping_, __ATOMIC_RELAXED)) {
+    MutexLock lock(&mutex_);
+    posted_.Signal();
+  }
+}
+
+void AsyncEventBus::Deliver(const Event& event) {
+  switch (event.type) {
+    case kOnTestProgramStart:
+      target_->OnTestProgramStart(*event.unit_test);
+      break;
+    case kOnTestIterationStart:
+      target_->OnTestIterationStart(*event.unit_test, event.iteration);
+      break;
+    case kOnEnvironmentsSetUpStart:
+      target_->OnEnvironmentsSetUpStart(*event.unit_test);
+      break;
+    case kOnEnvironmentsSetUpEnd:
+      target_->OnEnvironmentsSetUpEnd(*event.unit_test);
+      break;
+    case kOnTestCaseStart:
+      target_->OnTestCaseStart(*event.test_case);
+      break;
+    case kOnTestStart:
+      target_->OnTestStart(*event.test_info);
+      break;
+    case kOnTestPartResult:
+      target_->OnTestPartResult(*event.result);
+      delete event.result;
+      break;
+    case kOnTestEnd:
+      target_->OnTestEnd(*event.test_info);
+      break;
+    case kOnTestCaseEnd:
+      target_->OnTestCaseEnd(*event.test_case);
+      break;
+    case kOnEnvironmentsTearDownStart:
+      target_->OnEnvironmentsTearDownStart(*event.unit_test);
+      break;
+    case kOnEnvironmentsTearDownEnd:
+      target_->OnEnvironmentsTearDownEnd(*event.unit_test);
+      break;
+    case kOnTestIterationEnd:
+      target_->OnTestIterationEnd(*event.unit_test, event.iteration);
+      break;
+    case kOnTestProgramEnd:
+      target_->OnTestProgramEnd(*event.unit_test);
+      break;
+  }
+}
+
+bool AsyncEventBus::DeliverNext() {
+  Cell* const cell = &cells_[dequeue_pos_ & mask_];
+  if (__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) != dequeue_pos_ + 1)
+    return false;
+
+  // Copied out so the cell can be reused while the event is delivered.
+  const Event event = cell->event;
+  __atomic_store_n(&cell->sequence, dequeue_pos_ + mask_ + 1,
+                   __ATOMIC_RELEASE);
+  ++dequeue_pos_;
+  Deliver(event);
+  __atomic_store_n(&delivered_, dequeue_pos_, __ATOMIC_RELEASE);
+  return true;
+}
+
+void AsyncEventBus::WaitForEvents() {
+  MutexLock lock(&mutex_);
+  if (flushing_)
+    drained_.Broadcast();
+
+  __atomic_store_n(&sleeping_, true, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  const Cell& cell = cells_[dequeue_pos_ & mask_];
+  if (__atomic_load_n(&cell.sequence, __ATOMIC_ACQUIRE) != dequeue_pos_ + 1 &&
+      !__atomic_load_n(&stopping_, __ATOMIC_SEQ_CST))
+    posted_.WaitFor(&mutex_, kIdleWaitMillis);
+  __atomic_store_n(&sleeping_, false, __ATOMIC_RELAXED);
+}
+
+// Runs before the handlers installed earlier, the output writers' among
+// them, so what the listeners are given still gets written out.
+void AsyncEventBus::InstallCrashHandlers(AsyncEventBus* bus) {
+  static bool installed = false;
+  crash_bus = bus;
+  crash_bus_pid = getpid();
+  if (installed)
+    return;
+  installed = true;
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = &HandleCrash;
+  sigemptyset(&action.sa_mask);
+  for (size_t i = 0; i < sizeof(kCrashSignals) / sizeof(int); ++i)
+    sigaction(kCrashSignals[i], &action, &previous_actions[kCrashSignals[i]]);
+}
+
+void AsyncEventBus::HandleCrash(int signal) {
+  if (crash_bus != NULL && getpid() == crash_bus_pid)
+    crash_bus->FlushAfterCrash();
+
+  // The signal is blocked until the handler returns, and is then delivered
+  // to whatever handled it before.
+  sigaction(signal, &previous_actions[signal], NULL);
+  raise(signal);
+}
+
+void AsyncEventBus::FlushAfterCrash() {
+  // The listener thread itself may have crashed.
+  if (on_listener_thread)
+    return;
+
+  const UInt64 target = __atomic_load_n(&enqueue_pos_, __ATOMIC_ACQUIRE);
+  const struct timespec pause = { 0, 1000000 };
+  for (int attempts = 0;
+       __atomic_load_n(&delivered_, __ATOMIC_ACQUIRE) < target &&
+       attempts < kCrashFlushAttempts;
+       ++attempts) {
+    nanosleep(&pause, NULL);
+  }
+}
+
+/************************************************
+ * end of AsyncEventBus
+ ************************************************/
+
+} // namespace internal
+} // namespace testing
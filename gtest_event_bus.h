@@ -0,0 +1,119 @@
+#ifndef GTEST_EVENT_BUS_H_
+#define GTEST_EVENT_BUS_H_
+
+#include <vector>
+
+#include "gtest.h"
+#include "gtest_port.h"
+
+namespace testing {
+namespace internal {
+
+GTEST_DECLARE_bool_(async_listeners);
+
+/************************************************
+ * AsyncEventBus
+ ************************************************/
+// Hands every event to a listener thread, which passes them on to the
+// target one at a time, in the order they were posted.  Test threads only
+// pay for the enqueue, and listeners see a serial stream even when
+// assertions fail on several threads at once.
+//
+// The queue is a bounded multi-producer, single-consumer array queue with
+// a sequence number per cell (D. Vyukov's design); a producer that finds
+// it full yields until there's room.  A TestPartResult is copied into the
+// event, since the reporter's is gone by the time it's delivered.
+//
+// Test cases and tests are passed by reference, not snapshotted.  Their
+// names, locations and counts never change, so any event may read them.
+// Results are only settled at end events: an OnTestEnd or OnTestCaseEnd
+// sees its final result, since the queue is drained at the end of every
+// iteration before results are cleared.  A start event may be delivered
+// after the test has moved on, so a listener mustn't read a result or
+// UnitTest's current test there.  On a crash, queued events are delivered
+// before the crash handlers of the output writers run.
+class GTEST_API_ AsyncEventBus : public TestEventListener {
+ public:
+  // Doesn't own target.
+  explicit AsyncEventBus(TestEventListener* target);
+  virtual ~AsyncEventBus();
+
+  virtual void OnTestProgramStart(const UnitTest& unit_test);
+  virtual void OnTestIterationStart(const UnitTest& unit_test, int iteration);
+  virtual void OnEnvironmentsSetUpStart(const UnitTest& unit_test);
+  virtual void OnEnvironmentsSetUpEnd(const UnitTest& unit_test);
+  virtual void OnTestCaseStart(const TestCase& test_case);
+  virtual void OnTestStart(const TestInfo& test_info);
+  virtual void OnTestPartResult(const TestPartResult& result);
+  virtual void OnTestEnd(const TestInfo& test_info);
+  virtual void OnTestCaseEnd(const TestCase& test_case);
+  virtual void OnEnvironmentsTearDownStart(const UnitTest& unit_test);
+  virtual void OnEnvironmentsTearDownEnd(const UnitTest& unit_test);
+  virtual void OnTestIterationEnd(const UnitTest& unit_test, int iteration);
+  virtual void OnTestProgramEnd(const UnitTest& unit_test);
+
+  // Waits until every event posted so far has been delivered.
+  void Flush();
+
+ private:
+  static void InstallCrashHandlers(AsyncEventBus* bus);
+  static void HandleCrash(int signal);
+
+  // Gives the listener thread a while to deliver what's queued, without
+  // taking locks the crashing thread may hold.
+  void FlushAfterCrash();
+
+  struct Event {
+    int type;  // A TestEvent bit.
+    const UnitTest* unit_test;
+    const TestCase* test_case;
+    const TestInfo* test_info;
+    TestPartResult* result;  // Owned until delivered.
+    int iteration;
+  };
+
+  struct Cell {
+    UInt64 sequence;
+    Event event;
+  };
+
+  static void ThreadMain(AsyncEventBus* bus);
+
+  void Post(const Event& event);
+  void Deliver(const Event& event);
+
+  // Delivers the next event, if one is ready.
+  bool DeliverNext();
+
+  // Sleeps until an event is posted or the bus stops.
+  void WaitForEvents();
+
+  TestEventListener* const target_;
+  std::vector<Cell> cells_;
+  const UInt64 mask_;
+  // The producers' and the consumer's positions sit on separate cache
+  // lines so posting doesn't bounce the consumer's.
+  char pad0_[64];
+  UInt64 enqueue_pos_;
+  char pad1_[64];
+  UInt64 dequeue_pos_;
+  UInt64 delivered_;
+  bool sleeping_;
+  bool flushing_;
+  bool stopping_;
+  Mutex mutex_;
+  ConditionVariable posted_;
+  ConditionVariable drained_;
+  scoped_ptr<ThreadWithParam<AsyncEventBus*> > thread_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(AsyncEventBus);
+};
+
+/************************************************
+ * end of AsyncEventBus
+ ************************************************/
+
+} // namespace internal
+} // namespace testing
+
+#endif
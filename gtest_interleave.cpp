@@ -0,0 +1,737 @@
+#include <stdlib.h>
+#include <ucontext.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "gtest_interleave.h"
+#include "gtest_internal_impl.h"
+
+namespace testing {
+namespace internal {
+
+GTEST_DEFINE_string_(
+    interleave_strategy,
+    internal::StringFromGTestEnv("interleave_strategy", "pct"),
+    "How TEST_INTERLEAVE tests choose schedules: \"pct\" for random "
+    "priorities with a few random preemptions, or \"dfs\" for every "
+    "schedule within the preemption bound.");
+
+GTEST_DEFINE_int32_(
+    interleave_schedules,
+    internal::Int32FromGTestEnv("interleave_schedules", 1000),
+    "The most schedules a TEST_INTERLEAVE test runs.");
+
+GTEST_DEFINE_int32_(
+    interleave_seed,
+    internal::Int32FromGTestEnv("interleave_seed", 0),
+    "The seed of the first random schedule, from which the rest follow, "
+    "or 0 to pick one.");
+
+GTEST_DEFINE_int32_(
+    interleave_preemptions,
+    internal::Int32FromGTestEnv("interleave_preemptions", 2),
+    "How many preemptions a schedule may have: the priority change points "
+    "for pct, the bound for dfs.");
+
+GTEST_DEFINE_string_(
+    interleave_replay,
+    internal::StringFromGTestEnv("interleave_replay", ""),
+    "A schedule to run alone, as printed when one fails.");
+
+static const size_t kThreadStackBytes = 256 * 1024;
+// A schedule this long is taken for a livelock.
+static const int kMaxSteps = 100000;
+
+struct InterleavingThread {
+  std::function<void()> body;
+  ucontext_t context;
+  char* stack;
+  bool finished;
+  const InterleavedMutex* waiting_on;
+  // The condition variable the thread waits to be signalled by, or NULL.
+  const InterleavedConditionVariable* waiting_for;
+  int priority;
+};
+
+// The explorer running on this thread, if any.
+static __thread InterleavingExplorer* active_explorer = NULL;
+
+// splitmix64, for PCT's choices.
+static UInt64 NextRandom(UInt64* state) {
+  UInt64 z = (*state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// A positive seed that fits the flag.
+static Int32 NextSeed(UInt64* state) {
+  for (;;) {
+    const Int32 seed = static_cast<Int32>(NextRandom(state) & 0x7fffffff);
+    if (seed != 0)
+      return seed;
+  }
+}
+
+static void ReportInterleavingFailure(const std::string& message) {
+  const TestInfo* const test_info =
+      UnitTest::GetInstance()->current_test_info();
+  GetUnitTestImpl()->GetTestPartResultReporterForCurrentThread()->
+      ReportTestPartResult(TestPartResult(
+          TestPartResult::kNonFatalFailure,
+          test_info == NULL ? NULL : test_info->file(),
+          test_info == NULL ? -1 : test_info->line(), message.c_str()));
+}
+
+/************************************************
+ * InterleavingExplorer
+ ************************************************/
+// Runs an InterleavingTest's body once per schedule.  Threads run on
+// stacks of their own and switch back to the scheduler, on the body's
+// stack, at every scheduling point.
+class InterleavingExplorer {
+ public:
+  explicit InterleavingExplorer(InterleavingTest* test);
+
+  void Run();
+
+  void Spawn(const std::function<void()>& body);
+  void Join();
+
+  // In a thread: lets the scheduler pick the thread to run next.
+  void Point();
+  void Yield();
+  // In a thread: waits until mutex is unlocked.
+  void WaitFor(const InterleavedMutex* mutex);
+  // In a thread: unlocks mutex until signalled by condition, then locks
+  // it again.
+  void WaitForSignal(const InterleavedConditionVariable* condition,
+                     InterleavedMutex* mutex);
+  // Wakes the first thread waiting on condition, or all of them.
+  void Signal(const InterleavedConditionVariable* condition, bool all);
+
+  // The running thread, or -1 in the body.
+  int current_thread() const { return current_; }
+
+ private:
+  // A scheduling decision, for dfs to backtrack to.
+  struct Decision {
+    // The runnable threads, the one that ran last first if it may go on.
+    std::vector<int> alternatives;
+    size_t chosen;
+    // The preemptions before this decision, and whether choosing other
+    // than alternatives[0] makes another.
+    int preemptions;
+    bool preempts;
+  };
+
+  class FailureNotingReporter;
+
+  static void ThreadMain();
+
+  // Runs the body under the current strategy and returns true if it
+  // passed.
+  bool RunSchedule();
+
+  bool Runnable(int thread) const;
+
+  // Returns the thread to run next, or -1 if none can.
+  int PickNext();
+  int PickDfs(const std::vector<int>& runnable);
+  int PickPct(const std::vector<int>& runnable);
+
+  // Moves on to the next dfs schedule; false once there are none.
+  bool NextDfsSchedule();
+
+  // Frees the threads, which are abandoned if they haven't finished.
+  void ReleaseThreads();
+
+  void ParseReplay(const std::string& schedule);
+
+  // The threads chosen at each step, run-length encoded.
+  std::string FormatChoices() const;
+
+  std::string DescribeThreads() const;
+
+  InterleavingTest* const test_;
+  const bool dfs_;
+  const int preemption_bound_;
+  bool failed_;
+
+  std::vector<InterleavingThread*> threads_;
+  ucontext_t scheduler_context_;
+  int current_;
+  int last_;
+  // The thread that yielded at its last point, or -1.
+  int yielded_;
+  int steps_;
+  std::vector<int> choices_;
+
+  std::vector<int> replay_;
+  size_t replay_position_;
+
+  std::vector<Decision> decisions_;
+  size_t decision_index_;
+  int preemptions_;
+
+  Int32 schedule_seed_;
+  UInt64 random_;
+  int step_estimate_;
+  std::vector<int> change_points_;
+  int lowest_priority_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(InterleavingExplorer);
+};
+
+// Notes whether the schedule failed before passing results on.
+class InterleavingExplorer::FailureNotingReporter
+    : public TestPartResultReporterInterface {
+ public:
+  FailureNotingReporter(InterleavingExplorer* explorer,
+                        TestPartResultReporterInterface* next)
+      : explorer_(explorer), next_(next) {}
+
+  virtual void ReportTestPartResult(const TestPartResult& result) {
+    if (result.failed())
+      explorer_->failed_ = true;
+    next_->ReportTestPartResult(result);
+  }
+
+ private:
+  InterleavingExplorer* const explorer_;
+  TestPartResultReporterInterface* const next_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(FailureNotingReporter);
+};
+
+/**** InterleavingExplorer member function implentation ****/
+
+InterleavingExplorer::InterleavingExplorer(InterleavingTest* test)
+    : test_(test),
+      dfs_(GTEST_FLAG(interleave_strategy) == "dfs"),
+      preemption_bound_(std::max(GTEST_FLAG(interleave_preemptions), 0)),
+      failed_(false),
+      current_(-1),
+      last_(-1),
+      yielded_(-1),
+      steps_(0),
+      replay_position_(0),
+      decision_index_(0),
+      preemptions_(0),
+      schedule_seed_(0),
+      random_(0),
+      step_estimate_(1),
+      lowest_priority_(0) {}
+
+void InterleavingExplorer::Run() {
+  const std::string& strategy = GTEST_FLAG(interleave_strategy);
+  if (strategy != "pct" && strategy != "dfs") {
+    ReportInterleavingFailure("Unknown --gtest_interleave_strategy \"" +
+                              strategy + "\"; use pct or dfs.");
+    return;
+  }
+
+  UnitTestImpl* const impl = GetUnitTestImpl();
+  TestPartResultReporterInterface* const reporter =
+      impl->GetTestPartResultReporterForCurrentThread();
+  FailureNotingReporter noting_reporter(this, reporter);
+  impl->SetTestPartResultReporterForCurrentThread(&noting_reporter);
+  InterleavingExplorer* const outer_explorer = active_explorer;
+  active_explorer = this;
+
+  ParseReplay(GTEST_FLAG(interleave_replay));
+  const bool replaying = !GTEST_FLAG(interleave_replay).empty();
+  UInt64 seeds = GTEST_FLAG(interleave_seed) != 0 ?
+      static_cast<UInt64>(GTEST_FLAG(interleave_seed)) :
+      static_cast<UInt64>(GetTimeInNanos());
+  Int32 next_seed = GTEST_FLAG(interleave_seed) != 0 ?
+      GTEST_FLAG(interleave_seed) : NextSeed(&seeds);
+
+  // The first schedule runs each thread as far as it goes, and measures
+  // the steps among which pct places its preemptions.
+  const int budget = std::max(GTEST_FLAG(interleave_schedules), 1);
+  int schedules = 0;
+  bool exhausted = false;
+  for (;;) {
+    schedule_seed_ = 0;
+    if (!dfs_ && !replaying && schedules > 0) {
+      schedule_seed_ = next_seed;
+      next_seed = NextSeed(&seeds);
+      random_ = static_cast<UInt64>(schedule_seed_);
+      change_points_.clear();
+      for (int i = 0; i < preemption_bound_; ++i) {
+        change_points_.push_back(
+            1 + static_cast<int>(NextRandom(&random_) % step_estimate_));
+      }
+    }
+
+    const bool passed = RunSchedule();
+    ++schedules;
+    if (schedules == 1)
+      step_estimate_ = std::max(steps_, 1);
+
+    if (!passed) {
+      Message message;
+      message << "Interleaving schedule " << schedules << " failed";
+      if (schedule_seed_ != 0) {
+        message << " (pct seed " << schedule_seed_ << ", which "
+                << "--gtest_interleave_seed=" << schedule_seed_
+                << " runs second)";
+      }
+      message << ".  Run it alone with --gtest_interleave_replay="
+              << FormatChoices();
+      ReportInterleavingFailure(message.GetString());
+      break;
+    }
+    if (replaying || schedules >= budget)
+      break;
+    if (dfs_ && !NextDfsSchedule()) {
+      exhausted = true;
+      break;
+    }
+  }
+
+  active_explorer = outer_explorer;
+  impl->SetTestPartResultReporterForCurrentThread(reporter);
+  Test::RecordProperty("interleave_schedules", schedules);
+  if (dfs_)
+    Test::RecordProperty("interleave_exhausted", exhausted ? "true" : "false");
+}
+
+bool InterleavingExplorer::RunSchedule() {
+  failed_ = false;
+  steps_ = 0;
+  choices_.clear();
+  replay_position_ = 0;
+  decision_index_ = 0;
+  preemptions_ = 0;
+  test_->InterleavingBody();
+  if (!threads_.empty())
+    Join();
+  return !failed_;
+}
+
+void InterleavingExplorer::Spawn(const std::function<void()>& body) {
+  GTEST_CHECK_(current_ < 0)
+      << "Interleaving threads can only be spawned by the test body.";
+  InterleavingThread* const thread = new InterleavingThread;
+  thread->body = body;
+  thread->stack = NULL;
+  thread->finished = false;
+  thread->waiting_on = NULL;
+  thread->waiting_for = NULL;
+  thread->priority = 0;
+  threads_.push_back(thread);
+}
+
+void InterleavingExplorer::Join() {
+  GTEST_CHECK_(current_ < 0)
+      << "Interleaving threads can only be joined by the test body.";
+
+  // pct gives the threads distinct random priorities, all above those its
+  // preemptions lower a thread to.
+  std::vector<int> priorities;
+  for (size_t i = 0; i < threads_.size(); ++i)
+    priorities.push_back(preemption_bound_ + 1 + static_cast<int>(i));
+  for (size_t i = priorities.size(); i > 1; --i)
+    std::swap(priorities[i - 1], priorities[NextRandom(&random_) % i]);
+  lowest_priority_ = 0;
+
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    InterleavingThread* const thread = threads_[i];
+    thread->priority = priorities[i];
+    thread->stack = static_cast<char*>(malloc(kThreadStackBytes));
+    getcontext(&thread->context);
+    thread->context.uc_stack.ss_sp = thread->stack;
+    thread->context.uc_stack.ss_size = kThreadStackBytes;
+    thread->context.uc_link = &scheduler_context_;
+    makecontext(&thread->context, &ThreadMain, 0);
+  }
+
+  last_ = yielded_ = -1;
+  for (;;) {
+    const int next = PickNext();
+    if (next < 0) {
+      for (size_t i = 0; i < threads_.size(); ++i) {
+        if (!threads_[i]->finished) {
+          ReportInterleavingFailure(
+              "Deadlock: every unfinished thread waits on a mutex or a "
+              "condition variable.\n" +
+              DescribeThreads());
+          break;
+        }
+      }
+      break;
+    }
+    if (steps_ >= kMaxSteps) {
+      ReportInterleavingFailure(
+          "The schedule ran " + StreamableToString(kMaxSteps) +
+          " steps without the threads finishing, which looks like a "
+          "livelock; a spin loop should call InterleavingYield().\n" +
+          DescribeThreads());
+      break;
+    }
+
+    ++steps_;
+    choices_.push_back(next);
+    current_ = last_ = next;
+    swapcontext(&scheduler_context_, &threads_[next]->context);
+    current_ = -1;
+  }
+  ReleaseThreads();
+}
+
+void InterleavingExplorer::Point() {
+  InterleavingThread* const thread = threads_[current_];
+  swapcontext(&thread->context, &scheduler_context_);
+}
+
+void InterleavingExplorer::Yield() {
+  yielded_ = current_;
+  // Below every other thread, and below the threads that yielded before.
+  threads_[current_]->priority = --lowest_priority_;
+  Point();
+}
+
+void InterleavingExplorer::WaitFor(const InterleavedMutex* mutex) {
+  threads_[current_]->waiting_on = mutex;
+  Point();
+  threads_[current_]->waiting_on = NULL;
+}
+
+void InterleavingExplorer::WaitForSignal(
+    const InterleavedConditionVariable* condition, InterleavedMutex* mutex) {
+  // Unlock's scheduling point doesn't return until the thread's signalled.
+  threads_[current_]->waiting_for = condition;
+  mutex->Unlock();
+  mutex->Lock();
+}
+
+void InterleavingExplorer::Signal(
+    const InterleavedConditionVariable* condition, bool all) {
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    if (threads_[i]->waiting_for == condition) {
+      threads_[i]->waiting_for = NULL;
+      if (!all)
+        break;
+    }
+  }
+}
+
+void InterleavingExplorer::ThreadMain() {
+  InterleavingExplorer* const explorer = active_explorer;
+  InterleavingThread* const thread = explorer->threads_[explorer->current_];
+  thread->body();
+  thread->finished = true;
+  // Returning resumes uc_link, the scheduler.
+}
+
+bool InterleavingExplorer::Runnable(int thread) const {
+  const InterleavingThread* const t = threads_[thread];
+  return !t->finished && t->waiting_for == NULL &&
+      (t->waiting_on == NULL || !t->waiting_on->is_locked());
+}
+
+int InterleavingExplorer::PickNext() {
+  std::vector<int> runnable;
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    if (Runnable(static_cast<int>(i)))
+      runnable.push_back(static_cast<int>(i));
+  }
+  if (runnable.empty())
+    return -1;
+
+  int next;
+  if (replay_position_ < replay_.size()) {
+    next = replay_[replay_position_++];
+    if (std::find(runnable.begin(), runnable.end(), next) == runnable.end()) {
+      ReportInterleavingFailure(
+          "The replayed schedule chose thread " + StreamableToString(next) +
+          " at step " + StreamableToString(steps_ + 1) + ", which can't "
+          "run; the test doesn't run the same way twice.");
+      replay_.clear();
+      next = runnable[0];
+    }
+  } else if (dfs_) {
+    next = PickDfs(runnable);
+  } else if (!replay_.empty() || schedule_seed_ == 0) {
+    // Past a replayed schedule, and in the first one, the thread that ran
+    // last goes on unless it yielded or can't.
+    next = runnable[0];
+    if (last_ >= 0 && last_ != yielded_ && Runnable(last_))
+      next = last_;
+    else if (runnable[0] == yielded_ && runnable.size() > 1)
+      next = runnable[1];
+  } else {
+    next = PickPct(runnable);
+  }
+  yielded_ = yielded_ == next ? yielded_ : -1;
+  return next;
+}
+
+int InterleavingExplorer::PickDfs(const std::vector<int>& runnable) {
+  if (decision_index_ == decisions_.size()) {
+    Decision decision;
+    // Going on with the last thread comes first, since it's no preemption;
+    // a thread that yielded comes last, since spinning on is no progress.
+    const bool goes_on = last_ >= 0 && last_ != yielded_ && Runnable(last_);
+    if (goes_on)
+      decision.alternatives.push_back(last_);
+    for (size_t i = 0; i < runnable.size(); ++i) {
+      if (runnable[i] != last_ && runnable[i] != yielded_)
+        decision.alternatives.push_back(runnable[i]);
+    }
+    if (yielded_ >= 0 && Runnable(yielded_))
+      decision.alternatives.push_back(yielded_);
+    decision.chosen = 0;
+    decision.preemptions = preemptions_;
+    decision.preempts = goes_on;
+    decisions_.push_back(decision);
+  }
+
+  const Decision& decision = decisions_[decision_index_++];
+  if (decision.preempts && decision.chosen > 0)
+    ++preemptions_;
+  return decision.alternatives[decision.chosen];
+}
+
+// Returns the runnable thread with the highest priority.
+static int HighestPriority(const std::vector<InterleavingThread*>& threads,
+                           const std::vector<int>& runnable) {
+  int next = runnable[0];
+  for (size_t i = 1; i < runnable.size(); ++i) {
+    if (threads[runnable[i]]->priority > threads[next]->priority)
+      next = runnable[i];
+  }
+  return next;
+}
+
+int InterleavingExplorer::PickPct(const std::vector<int>& runnable) {
+  int next = HighestPriority(threads_, runnable);
+  // At the i-th change point the thread about to run drops to priority
+  // preemption_bound - i, below every thread that hasn't dropped yet.
+  for (size_t i = 0; i < change_points_.size(); ++i) {
+    if (change_points_[i] == steps_ + 1) {
+      threads_[next]->priority = preemption_bound_ - static_cast<int>(i);
+      next = HighestPriority(threads_, runnable);
+    }
+  }
+  return next;
+}
+
+bool InterleavingExplorer::NextDfsSchedule() {
+  // Only the decisions this schedule reached count; a different choice
+  // earlier may have led elsewhere.
+  decisions_.resize(decision_index_);
+  while (!decisions_.empty()) {
+    Decision& decision = decisions_.back();
+    if (decision.chosen + 1 < decision.alternatives.size() &&
+        (!decision.preempts || decision.preemptions < preemption_bound_)) {
+      ++decision.chosen;
+      return true;
+    }
+    decisions_.pop_back();
+  }
+  return false;
+}
+
+void InterleavingExplorer::ReleaseThreads() {
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    free(threads_[i]->stack);
+    delete threads_[i];
+  }
+  threads_.clear();
+  current_ = last_ = yielded_ = -1;
+}
+
+void InterleavingExplorer::ParseReplay(const std::string& schedule) {
+  replay_.clear();
+  size_t start = 0;
+  while (start < schedule.size()) {
+    size_t end = schedule.find(',', start);
+    if (end == std::string::npos)
+      end = schedule.size();
+    const std::string choice = schedule.substr(start, end - start);
+    const size_t times = choice.find('x');
+    const int thread = atoi(choice.substr(0, times).c_str());
+    const int count = times == std::string::npos ? 1 :
+        atoi(choice.substr(times + 1).c_str());
+    replay_.insert(replay_.end(), std::max(count, 1), thread);
+    start = end + 1;
+  }
+}
+
+std::string InterleavingExplorer::FormatChoices() const {
+  std::string text;
+  for (size_t i = 0; i < choices_.size();) {
+    size_t run = 1;
+    while (i + run < choices_.size() && choices_[i + run] == choices_[i])
+      ++run;
+    if (!text.empty())
+      text += ",";
+    text += StreamableToString(choices_[i]);
+    if (run > 1)
+      text += "x" + StreamableToString(run);
+    i += run;
+  }
+  return text;
+}
+
+std::string InterleavingExplorer::DescribeThreads() const {
+  std::string text;
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    const InterleavingThread* const thread = threads_[i];
+    text += "  thread " + StreamableToString(i) + ": " +
+        (thread->finished ? "finished" :
+         thread->waiting_on != NULL ? "waiting on a mutex" :
+         thread->waiting_for != NULL ? "waiting on a condition variable" :
+         "runnable") +
+        "\n";
+  }
+  return text;
+}
+
+/************************************************
+ * end of InterleavingExplorer
+ ************************************************/
+
+void InterleavingPoint() {
+  InterleavingExplorer* const explorer = active_explorer;
+  if (explorer != NULL && explorer->current_thread() >= 0)
+    explorer->Point();
+}
+
+} // namespace internal
+
+void InterleavingYield() {
+  internal::InterleavingExplorer* const explorer = internal::active_explorer;
+  if (explorer != NULL && explorer->current_thread() >= 0)
+    explorer->Yield();
+  else
+    sched_yield();
+}
+
+
+/************************************************
+ * InterleavedMutex
+ * member function implentation
+ ************************************************/
+InterleavedMutex::InterleavedMutex() : owner_thread_(-1) {}
+
+InterleavedMutex::~InterleavedMutex() {
+  if (has_owner_)
+    MutexBase::Unlock();
+}
+
+void InterleavedMutex::Lock() {
+  internal::InterleavingExplorer* const explorer = internal::active_explorer;
+  if (explorer == NULL || explorer->current_thread() < 0) {
+    GTEST_CHECK_(!has_owner_)
+        << "An InterleavedMutex locked outside the interleaving threads "
+        << "would never be unlocked.";
+  } else {
+    explorer->Point();
+    while (has_owner_)
+      explorer->WaitFor(this);
+    owner_thread_ = explorer->current_thread();
+  }
+  MutexBase::Lock();
+}
+
+void InterleavedMutex::Unlock() {
+  GTEST_CHECK_(has_owner_) << "Unlocking an InterleavedMutex that's free.";
+  owner_thread_ = -1;
+  MutexBase::Unlock();
+  internal::InterleavingPoint();
+}
+
+bool InterleavedMutex::TryLock() {
+  internal::InterleavingPoint();
+  if (has_owner_)
+    return false;
+  internal::InterleavingExplorer* const explorer = internal::active_explorer;
+  owner_thread_ = explorer == NULL ? -1 : explorer->current_thread();
+  MutexBase::Lock();
+  return true;
+}
+
+// Every interleaving thread is the same pthread to MutexBase, so it's the
+// interleaving thread that's checked.
+void InterleavedMutex::AssertHeld() const {
+  const internal::InterleavingExplorer* const explorer =
+      internal::active_explorer;
+  MutexBase::AssertHeld();
+  GTEST_CHECK_(owner_thread_ ==
+               (explorer == NULL ? -1 : explorer->current_thread()))
+      << "The current thread is not holding the mutex @" << this;
+}
+
+/************************************************
+ * end of InterleavedMutex
+ ************************************************/
+
+
+/************************************************
+ * InterleavedConditionVariable
+ * member function implentation
+ ************************************************/
+void InterleavedConditionVariable::Wait(InterleavedMutex* mutex) {
+  internal::InterleavingExplorer* const explorer = internal::active_explorer;
+  GTEST_CHECK_(explorer != NULL && explorer->current_thread() >= 0)
+      << "Only interleaving threads can wait on an "
+      << "InterleavedConditionVariable; nothing else could signal it.";
+  mutex->AssertHeld();
+  explorer->WaitForSignal(this, mutex);
+}
+
+void InterleavedConditionVariable::Signal() {
+  internal::InterleavingPoint();
+  internal::InterleavingExplorer* const explorer = internal::active_explorer;
+  if (explorer != NULL)
+    explorer->Signal(this, false);
+}
+
+void InterleavedConditionVariable::Broadcast() {
+  internal::InterleavingPoint();
+  internal::InterleavingExplorer* const explorer = internal::active_explorer;
+  if (explorer != NULL)
+    explorer->Signal(this, true);
+}
+
+/************************************************
+ * end of InterleavedConditionVariable
+ ************************************************/
+
+
+/************************************************
+ * InterleavingTest
+ * member function implentation
+ ************************************************/
+void InterleavingTest::Spawn(const std::function<void()>& body) {
+  GTEST_CHECK_(internal::active_explorer != NULL)
+      << "Spawn() must be called from an interleaving test's body.";
+  internal::active_explorer->Spawn(body);
+}
+
+void InterleavingTest::Join() {
+  GTEST_CHECK_(internal::active_explorer != NULL)
+      << "Join() must be called from an interleaving test's body.";
+  internal::active_explorer->Join();
+}
+
+int InterleavingTest::interleaving_thread() {
+  return internal::active_explorer == NULL ? -1 :
+      internal::active_explorer->current_thread();
+}
+
+void InterleavingTest::TestBody() {
+  internal::InterleavingExplorer explorer(this);
+  explorer.Run();
+}
+
+/************************************************
+ * end of InterleavingTest
+ ************************************************/
+
+} // namespace testing
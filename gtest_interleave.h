@@ -0,0 +1,221 @@
+#ifndef GTEST_INTERLEAVE_H_
+#define GTEST_INTERLEAVE_H_
+
+#include <functional>
+#include <string>
+
+#include "gtest.h"
+#include "gtest_port.h"
+
+namespace testing {
+namespace internal {
+
+GTEST_DECLARE_string_(interleave_strategy);
+GTEST_DECLARE_int32_(interleave_schedules);
+GTEST_DECLARE_int32_(interleave_seed);
+GTEST_DECLARE_int32_(interleave_preemptions);
+GTEST_DECLARE_string_(interleave_replay);
+
+class InterleavingExplorer;
+
+// A point where the scheduler may switch to another thread.  Outside an
+// interleaving test's threads it does nothing.
+GTEST_API_ void InterleavingPoint();
+
+} // namespace internal
+
+// Lets the scheduler run other threads before this one again, as a spin
+// loop must for PCT to make progress.  Outside an interleaving test it
+// yields the CPU.
+GTEST_API_ void InterleavingYield();
+
+/************************************************
+ * InterleavedAtomic
+ ************************************************/
+// An atomic whose every operation is a scheduling point.  The scheduler
+// runs one thread at a time, so operations are sequentially consistent;
+// bugs that need a weaker memory order to show aren't found.
+template <typename T>
+class InterleavedAtomic {
+ public:
+  InterleavedAtomic() : value_() {}
+  explicit InterleavedAtomic(T value) : value_(value) {}
+
+  T load() const {
+    internal::InterleavingPoint();
+    return __atomic_load_n(&value_, __ATOMIC_SEQ_CST);
+  }
+
+  void store(T value) {
+    internal::InterleavingPoint();
+    __atomic_store_n(&value_, value, __ATOMIC_SEQ_CST);
+  }
+
+  T exchange(T value) {
+    internal::InterleavingPoint();
+    return __atomic_exchange_n(&value_, value, __ATOMIC_SEQ_CST);
+  }
+
+  bool compare_exchange_strong(T& expected, T desired) {
+    internal::InterleavingPoint();
+    return __atomic_compare_exchange_n(&value_, &expected, desired, false,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+  }
+
+  T fetch_add(T delta) {
+    internal::InterleavingPoint();
+    return __atomic_fetch_add(&value_, delta, __ATOMIC_SEQ_CST);
+  }
+
+  T fetch_sub(T delta) {
+    internal::InterleavingPoint();
+    return __atomic_fetch_sub(&value_, delta, __ATOMIC_SEQ_CST);
+  }
+
+ private:
+  T value_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(InterleavedAtomic);
+};
+
+/************************************************
+ * InterleavedMutex
+ ************************************************/
+// A Mutex whose Lock and Unlock are scheduling points, and whose Lock
+// lets the scheduler run other threads instead of blocking the process.
+// A thread waiting for it isn't scheduled until it's unlocked, and threads
+// that all wait on each other are reported as a deadlock.  The interleaving
+// threads all run on the test's thread, so the pthread mutex underneath is
+// only locked once the scheduler has found it free.  Lock and Unlock hide
+// MutexBase's rather than override them: wait on it with an
+// InterleavedConditionVariable, not a ConditionVariable, which would block
+// the process.
+class GTEST_API_ InterleavedMutex : public internal::Mutex {
+ public:
+  InterleavedMutex();
+  // Unlocks a mutex a thread abandoned at a deadlock or failure, so the
+  // Mutex can be destroyed.
+  ~InterleavedMutex();
+
+  void Lock();
+  void Unlock();
+  bool TryLock();
+  void AssertHeld() const;
+
+  bool is_locked() const { return has_owner_; }
+
+ private:
+  // The interleaving thread holding the mutex, or -1.
+  int owner_thread_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(InterleavedMutex);
+};
+
+class GTEST_API_ InterleavedMutexLock {
+ public:
+  explicit InterleavedMutexLock(InterleavedMutex* mutex) : mutex_(mutex) {
+    mutex_->Lock();
+  }
+
+  ~InterleavedMutexLock() { mutex_->Unlock(); }
+
+ private:
+  InterleavedMutex* const mutex_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(InterleavedMutexLock);
+};
+
+/************************************************
+ * InterleavedConditionVariable
+ ************************************************/
+// A condition variable for InterleavedMutex.  A waiting thread isn't
+// scheduled until it's signalled, so a lost wakeup is reported as a
+// deadlock instead of hanging.  Wait, Signal and Broadcast are scheduling
+// points, and Signal wakes the waiter spawned first.
+class GTEST_API_ InterleavedConditionVariable {
+ public:
+  InterleavedConditionVariable() {}
+
+  // Unlocks mutex, which the calling interleaving thread holds, until the
+  // thread is signalled, and locks it again.
+  void Wait(InterleavedMutex* mutex);
+
+  void Signal();
+  void Broadcast();
+
+ private:
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(InterleavedConditionVariable);
+};
+
+/************************************************
+ * InterleavingTest
+ ************************************************/
+// The base of TEST_INTERLEAVE tests.  The body spawns a few threads, joins
+// them and checks what they did.  It's run once per schedule, up to
+// --gtest_interleave_schedules times, with the threads run one at a time
+// as cooperative threads on the test's own thread.  A scheduler picks the
+// thread to run at every InterleavedAtomic or InterleavedMutex operation:
+//
+//   pct  PCT (probabilistic concurrency testing): random thread
+//        priorities, lowered at --gtest_interleave_preemptions random
+//        steps.  Each schedule's seed follows from --gtest_interleave_seed.
+//   dfs  Every schedule with at most --gtest_interleave_preemptions
+//        preemptions, depth first, until they're all tried.
+//
+// Exploring stops at the first schedule with a failure, which is reported
+// with the flag that replays it alone.  Same schedule, same run: the body
+// must not depend on anything else that varies, such as the time.  State
+// a schedule changes belongs in the body, since the fixture isn't remade.
+class GTEST_API_ InterleavingTest : public Test {
+ protected:
+  InterleavingTest() {}
+
+  // Adds a thread to run body when Join is called.
+  static void Spawn(const std::function<void()>& body);
+
+  // Runs the spawned threads to completion under the scheduler.
+  static void Join();
+
+  // The running interleaving thread's index, from 0 in spawn order, or -1.
+  static int interleaving_thread();
+
+ private:
+  friend class internal::InterleavingExplorer;
+
+  virtual void TestBody();
+
+  virtual void InterleavingBody() = 0;
+};
+
+} // namespace testing
+
+#define GTEST_INTERLEAVE_(test_case, test_name, parent) \
+class GTEST_API_ GTEST_TEST_CLASS_NAME_(test_case, test_name) : public parent {\
+ public:\
+  GTEST_TEST_CLASS_NAME_(test_case, test_name)() {}\
+ private:\
+  virtual void InterleavingBody();\
+  static testing::TestInfo* test_info_;\
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(GTEST_TEST_CLASS_NAME_(test_case, test_name));\
+};\
+\
+testing::TestInfo* GTEST_TEST_CLASS_NAME_(test_case, test_name)\
+  ::test_info_ = testing::internal::ExcludeFromStress(\
+      testing::internal::MakeAndRegisterTestInfo(\
+          #test_case, #test_name,\
+          ::testing::internal::CodeLocation(__FILE__, __LINE__), \
+          parent::SetUpTestCase, parent::TearDownTestCase, \
+          new testing::internal::TestFactoryImpl<\
+              GTEST_TEST_CLASS_NAME_(test_case, test_name)>));\
+\
+void GTEST_TEST_CLASS_NAME_(test_case, test_name)::InterleavingBody()
+
+#define TEST_INTERLEAVE(test_case, test_name) \
+  GTEST_INTERLEAVE_(test_case, test_name, ::testing::InterleavingTest)
+
+// Likewise with a fixture, which must derive from
+// ::testing::InterleavingTest.
+#define TEST_F_INTERLEAVE(test_case, test_name) \
+  GTEST_INTERLEAVE_(test_case, test_name, test_case)
+
+#endif
@@ -0,0 +1,58 @@
+#include "gtest_internal.h"
+
+namespace testing {
+namespace internal {
+
+static inline UInt64 RotateLeft(UInt64 x, int bits) {
+  return (x << bits) | (x >> (64 - bits));
+}
+
+UInt64 MixBits(UInt64 x) {
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+int TestRandomSeed(int run_seed, int test_id) {
+  // Offset as splitmix64 does, since MixBits(0) is 0.
+  const UInt64 key =
+      (static_cast<UInt64>(static_cast<UInt32>(run_seed)) << 32) |
+      static_cast<UInt32>(test_id);
+  return static_cast<int>(MixBits(key + 0x9e3779b97f4a7c15ULL) >> 33);
+}
+
+/**** Random member function implentation ****/
+
+void Random::Reseed(UInt64 seed) {
+  // The four words can't all be 0, which xoshiro would never leave.
+  for (int i = 0; i < 4; ++i) {
+    seed += 0x9e3779b97f4a7c15ULL;
+    state_[i] = MixBits(seed);
+  }
+}
+
+UInt64 Random::Next() {
+  const UInt64 result = RotateLeft(state_[1] * 5, 7) * 9;
+  const UInt64 t = state_[1] << 17;
+  state_[2] ^= state_[0];
+  state_[3] ^= state_[1];
+  state_[1] ^= state_[2];
+  state_[0] ^= state_[3];
+  state_[2] ^= t;
+  state_[3] = RotateLeft(state_[3], 45);
+  return result;
+}
+
+UInt32 Random::Generate(UInt32 range) {
+  GTEST_CHECK_(range > 0) << "Cannot generate a number in the range [0, 0).";
+  // The high bits times range, over 2^32: no division, and a bias of at
+  // most range / 2^32.
+  return static_cast<UInt32>(((Next() >> 32) * range) >> 32);
+}
+
+/************************************************
+ * end of Random
+ ************************************************/
+
+} // namespace internal
+} // namespace testing
@@ -161,8 +161,18 @@ TestInfo* MakeAndRegisterTestInfo (
       const char* test_case_name,
       const char* name,
       CodeLocation code_location,
+      SetUpTestCaseFunc set_up_tc,
+      TearDownTestCaseFunc tear_down_tc,
       TestFactoryBase* factory);
 
+// Gives test_info a timeout of its own, overriding --gtest_test_timeout;
+// 0 means none.  Returns test_info.
+GTEST_API_ TestInfo* SetTestTimeout(TestInfo* test_info, int timeout_ms);
+
+// Keeps --gtest_stress_threads from repeating test_info, for tests that
+// already run their own threads or measure.  Returns test_info.
+GTEST_API_ TestInfo* ExcludeFromStress(TestInfo* test_info);
+
 
 
 
@@ -173,7 +183,31 @@ TestInfo* MakeAndRegisterTestInfo (
 /************************************************
  * Random
  ************************************************/
-class GTEST_API_ Random;
+// xoshiro256** seeded through splitmix64: a few cycles a number, and
+// nearby seeds give unrelated streams.
+class GTEST_API_ Random {
+ public:
+  explicit Random(UInt64 seed) { Reseed(seed); }
+
+  void Reseed(UInt64 seed);
+
+  UInt64 Next();
+
+  // Returns a number in [0, range), which must be positive.
+  UInt32 Generate(UInt32 range);
+
+ private:
+  UInt64 state_[4];
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(Random);
+};
+
+// splitmix64's finalizer.  Distinct inputs give distinct outputs.
+GTEST_API_ UInt64 MixBits(UInt64 x);
+
+// A test's seed, from the run's and the test's id alone, so it's the same
+// whatever order or process the test runs in.
+GTEST_API_ int TestRandomSeed(int run_seed, int test_id);
 
 
 
@@ -11,11 +11,49 @@ inline T GetElementOr(const std::vector<T>& v, int i, T default_value) {
   return (i < 0 || i >= static_cast<int>(v.size())) ? default_value : v[i];
 }
 
+// Shuffles v[begin, end) in place, Fisher-Yates.
+template <typename E>
+void ShuffleRange(Random* random, int begin, int end, std::vector<E>* v) {
+  for (int range_width = end - begin; range_width >= 2; --range_width) {
+    const int last_in_range = begin + range_width - 1;
+    const int selected = begin + static_cast<int>(
+        random->Generate(static_cast<UInt32>(range_width)));
+    std::swap((*v)[selected], (*v)[last_in_range]);
+  }
+}
+
+template <typename E>
+inline void Shuffle(Random* random, std::vector<E>* v) {
+  ShuffleRange(random, 0, static_cast<int>(v->size()), v);
+}
+
+// The largest --gtest_random_seed.
+const int kMaxRandomSeed = 99999;
+
+// Returns the run's seed for a --gtest_random_seed: the flag itself, or one
+// picked from the time for 0.
+inline int GetRandomSeedFromFlag(Int32 random_seed_flag) {
+  const unsigned int raw_seed = (random_seed_flag == 0) ?
+      static_cast<unsigned int>(GetTimeInMillis()) :
+      static_cast<unsigned int>(random_seed_flag);
+  return static_cast<int>((raw_seed - 1U) %
+                          static_cast<unsigned int>(kMaxRandomSeed)) + 1;
+}
+
+// The seed of the iteration after one with seed.
+inline int GetNextRandomSeed(int seed) {
+  return (seed >= kMaxRandomSeed) ? 1 : seed + 1;
+}
+
 /************************************************
  * OsStackTraceGetterInterface
  ************************************************/
 class OsStackTraceGetterInterface;
 
+class OutputCapture;
+class TestWatchdog;
+class WorkerSupervisor;
+
 
 /************************************************
  * TraceInfo
@@ -101,19 +139,20 @@ class GTEST_API_ UnitTestImpl {
 
   int test_to_run_count() const;
 
-  TimeInMillis start_timestamp() const;
+  TimeInMillis start_timestamp() const { return start_timestamp_; }
 
-  TimeInMillis elapsed_time() const;
+  TimeInMillis elapsed_time() const { return elapsed_time_; }
 
   bool Passed() const { return !Failed(); }
 
+  // A failure in an environment fails the run.
   bool Failed() const {
-    return failed_test_case_count() > 0;
+    return failed_test_case_count() > 0 || ad_hoc_test_result()->Failed();
   }
 
   const TestCase* GetTestCase(int i) const {
     const int index = GetElementOr(test_case_indices_, i, -1);
-    return index < 0 ? NULL : test_cases_[i];
+    return index < 0 ? NULL : test_cases_[index];
   }
 
   TestCase* GetMutableTestCase(int i) {
@@ -125,7 +164,7 @@ class GTEST_API_ UnitTestImpl {
 
   TestResult* current_test_result();
 
-  const TestResult* ad_hoc_test_result() const;
+  const TestResult* ad_hoc_test_result() const { return &ad_hoc_test_result_; }
 
   void set_os_stack_trace_getter(OsStackTraceGetterInterface* getter);
 
@@ -133,10 +172,18 @@ class GTEST_API_ UnitTestImpl {
 
   std::string CurrentOsStackTraceExceptTop(int skip_count);
 
-  TestCase* GetTestCase(const char* test_case_name);
-
-  void AddTestInfo(TestInfo* test_info) {
-    GetTestCase(test_info->test_case_name())->AddTestInfo(test_info);
+  // Finds the named test case, adding it with the given set-up and
+  // tear-down functions if there's none.
+  TestCase* GetTestCase(const char* test_case_name,
+                        Test::SetUpTestCaseFunc set_up_tc,
+                        Test::TearDownTestCaseFunc tear_down_tc);
+
+  void AddTestInfo(Test::SetUpTestCaseFunc set_up_tc,
+                   Test::TearDownTestCaseFunc tear_down_tc,
+                   TestInfo* test_info) {
+    test_info->id_ = registered_test_count_++;
+    GetTestCase(test_info->test_case_name(), set_up_tc, tear_down_tc)
+        ->AddTestInfo(test_info);
   }
 
   void set_current_test_case(TestCase* a_current_test_case) {
@@ -147,6 +194,18 @@ class GTEST_API_ UnitTestImpl {
     current_test_info_ = a_current_test_info;
   }
 
+  // Returns NULL unless tests' output is being captured.
+  OutputCapture* output_capture() { return output_capture_.get(); }
+
+  // Returns NULL unless tests run in a worker process.
+  WorkerSupervisor* worker_supervisor() { return worker_supervisor_.get(); }
+
+  // The watchdog for tests with a timeout, started on first use.
+  TestWatchdog* watchdog();
+
+  // Ends the run after hung_test has timed out.  Never returns.
+  void EndHungRun(TestInfo* hung_test, TimeInMillis elapsed);
+
   void RegisterParameterizedTests();
 
   bool RunAllTests();
@@ -172,19 +231,21 @@ class GTEST_API_ UnitTestImpl {
   TestInfo* current_test_info() { return current_test_info_; }
   const TestInfo* current_test_info() const { return current_test_info_; }
 
-  std::vector<Environment*>& environments();
+  std::vector<Environment*>& environments() { return environments_; }
 
   std::vector<TraceInfo>& gtest_trace_stack();
   const std::vector<TraceInfo>& gtest_trace_stack() const;
 
   void PostFlagParsingInit();
 
-  int random_seed() const;
+  int random_seed() const { return random_seed_; }
 
-  internal::Random* random();
+  internal::Random* random() { return &random_; }
 
+  // Shuffles the test cases, and the tests within each.
   void ShuffleTests();
 
+  // Restores the order the tests were registered in.
   void UnshuffleTests();
 
   bool catch_exceptions() const;
@@ -194,6 +255,8 @@ class GTEST_API_ UnitTestImpl {
 
   void set_catch_exceptions(bool value);
 
+  void ConfigureXmlOutput();
+
   UnitTest* const parent_;
 
   DefaultGlobalTestPartResultReporter default_global_test_part_result_reporter_;
@@ -207,14 +270,31 @@ class GTEST_API_ UnitTestImpl {
   internal::ThreadLocal<TestPartResultReporterInterface*>
       per_thread_test_part_result_reporter_;
 
+  std::vector<Environment*> environments_;
   std::vector<TestCase*> test_cases_;
   std::vector<int> test_case_indices_;
+  int registered_test_count_;
+
+  // The current iteration's seed, and the generator that shuffles it.
+  int random_seed_;
+  internal::Random random_;
 
   TestCase* current_test_case_;
   TestInfo* current_test_info_;
 
   TestEventListeners listeners_;
 
+  bool post_flag_parse_init_performed_;
+
+  TimeInMillis start_timestamp_;
+  TimeInMillis elapsed_time_;
+
+  TestResult ad_hoc_test_result_;
+
+  scoped_ptr<OutputCapture> output_capture_;
+  scoped_ptr<TestWatchdog> watchdog_;
+  scoped_ptr<WorkerSupervisor> worker_supervisor_;
+
   GTEST_DISALLOW_COPY_AND_ASSIGN_(UnitTestImpl);
 };
 
@@ -222,6 +302,16 @@ inline UnitTestImpl* GetUnitTestImpl() {
   return UnitTest::GetInstance()->impl();
 }
 
+// Gives the framework's own tests the parts of a TestResult only the
+// framework sets, to check how a result is reported.
+class TestResultAccessor {
+ public:
+  static void set_captured_output(TestResult* result,
+                                  const std::string& output) {
+    result->set_captured_output(output);
+  }
+};
+
 }
 }
 
@@ -0,0 +1,437 @@
+#include <errno.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "gtest_internal_impl.h"
+#include "gtest_isolation.h"
+#include "gtest_output.h"
+#include "gtest_watchdog.h"
+
+namespace testing {
+namespace internal {
+
+GTEST_DEFINE_string_(
+    isolation,
+    internal::StringFromGTestEnv("isolation", "none"),
+    "How tests are kept apart: none; worker, to run them in a worker "
+    "process that's replaced when a test crashes; or fork, to run each "
+    "batch of --gtest_fork_batch tests in a fresh process.");
+
+GTEST_DEFINE_int32_(
+    fork_batch,
+    internal::Int32FromGTestEnv("fork_batch", 1),
+    "The number of tests each process runs with --gtest_isolation=fork.");
+
+static const int kCrashSignals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+static const int kMaxCrashFrames = 64;
+// The crash handler's frame and the kernel's signal trampoline.
+static const int kHandlerFrames = 2;
+// How long past the test's own timeout the supervisor waits before it
+// gives up on a worker whose watchdog didn't answer either.
+static const int kWorkerGraceMillis = 10000;
+
+// Where the worker's crash handler writes.
+static int worker_result_fd = -1;
+
+// Reads exactly size bytes.  Returns false on EOF or an error.
+static bool ReadAll(int fd, char* data, size_t size) {
+  while (size > 0) {
+    const ssize_t got = read(fd, data, size);
+    if (got < 0 && errno == EINTR)
+      continue;
+    if (got <= 0)
+      return false;
+    data += got;
+    size -= static_cast<size_t>(got);
+  }
+  return true;
+}
+
+// Reads one frame, waiting at most timeout_ms for it to begin, or for
+// ever if it's negative.  Returns false on EOF, an error or the timeout,
+// setting *timed_out in the last case.
+static bool ReadFrame(int fd, int timeout_ms, UInt32* type,
+                      std::string* payload, bool* timed_out) {
+  *timed_out = false;
+  struct pollfd polled = { fd, POLLIN, 0 };
+  int ready;
+  do {
+    ready = poll(&polled, 1, timeout_ms);
+  } while (ready < 0 && errno == EINTR);
+  if (ready == 0)
+    *timed_out = true;
+  if (ready <= 0)
+    return false;
+
+  StreamFrameHeader header;
+  if (!ReadAll(fd, reinterpret_cast<char*>(&header), sizeof(header)))
+    return false;
+  payload->resize(header.payload_size);
+  *type = header.type;
+  return header.payload_size == 0 ||
+      ReadAll(fd, &(*payload)[0], header.payload_size);
+}
+
+static bool SendFrame(int fd, StreamFrame* frame) {
+  const std::string& data = frame->data();
+  return WriteAll(fd, data.data(), data.size());
+}
+
+// Writes a kWorkerCrash frame and lets the signal take its course.  Only
+// async-signal-safe calls from here on.
+static void ReportCrash(int signal_number) {
+  void* frames[kMaxCrashFrames];
+  const int depth =
+      std::max(backtrace(frames, kMaxCrashFrames) - kHandlerFrames, 0);
+
+  struct {
+    StreamFrameHeader header;
+    Int64 fields[2 + kMaxCrashFrames];
+  } message;
+  message.header.type = kWorkerCrash;
+  message.header.payload_size =
+      static_cast<UInt32>(sizeof(Int64) * (2 + depth));
+  message.fields[0] = signal_number;
+  message.fields[1] = depth;
+  for (int i = 0; i < depth; ++i)
+    message.fields[2 + i] =
+        reinterpret_cast<Int64>(frames[kHandlerFrames + i]);
+  WriteAll(worker_result_fd, reinterpret_cast<const char*>(&message),
+           sizeof(message.header) + message.header.payload_size);
+
+  // SA_RESETHAND restored the default action, which the re-raised signal
+  // now takes.
+  raise(signal_number);
+}
+
+// Runs first when a test calls exit(): the worker's at-exit handlers
+// belong to the supervisor, and some wait on threads the fork didn't copy.
+static void ExitWorkerNow(int status, void* /*unused*/) {
+  fflush(NULL);
+  _exit(status);
+}
+
+// The worker's global reporter: records parts as usual and sends them to
+// the supervisor.
+class WorkerResultReporter : public TestPartResultReporterInterface {
+ public:
+  explicit WorkerResultReporter(int fd) : fd_(fd) {}
+
+  virtual void ReportTestPartResult(const TestPartResult& result) {
+    StreamFrame frame(kWorkerTestPartResult);
+    frame.Add(static_cast<Int64>(result.type()))
+        .Add(result.file_name() == NULL ? "" : result.file_name())
+        .Add(result.line_number())
+        .Add(result.message());
+    MutexLock lock(&mutex_);
+    GetUnitTestImpl()->current_test_result()->AddTestPartResult(result);
+    SendFrame(fd_, &frame);
+  }
+
+ private:
+  const int fd_;
+  Mutex mutex_;
+};
+
+/**** WorkerSupervisor member function implentation ****/
+
+WorkerSupervisor* WorkerSupervisor::Create(const std::string& mode) {
+  if (mode == "worker")
+    return new WorkerSupervisor(0);
+  if (mode == "fork")
+    return new WorkerSupervisor(std::max(GTEST_FLAG(fork_batch), 1));
+  if (mode != "none" && !mode.empty()) {
+    fprintf(stderr, "WARNING: unknown --gtest_isolation mode \"%s\"; "
+            "running tests without isolation.\n", mode.c_str());
+    fflush(stderr);
+  }
+  return NULL;
+}
+
+WorkerSupervisor::WorkerSupervisor(int tests_per_worker)
+    : tests_per_worker_(tests_per_worker),
+      worker_pid_(-1),
+      command_fd_(-1),
+      result_fd_(-1),
+      in_worker_(false) {}
+
+WorkerSupervisor::~WorkerSupervisor() {
+  if (!in_worker_)
+    Stop();
+}
+
+void WorkerSupervisor::RunTest(TestInfo* test_info,
+                               WorkerTestOutcome* outcome) {
+  UnitTestImpl* const impl = GetUnitTestImpl();
+  TestPartResultReporterInterface* const reporter =
+      impl->GetGlobalTestPartResultReporter();
+  const Int64 start = GetTimeInNanos();
+  outcome->elapsed_time = 0;
+  outcome->captured_output.clear();
+
+  StreamFrame command(kWorkerRunTest);
+  command.Add(test_info->id());
+  if ((worker_pid_ < 0 && !StartWorker()) || !SendCommand(&command)) {
+    if (worker_pid_ >= 0)
+      ReapWorker();
+    reporter->ReportTestPartResult(TestPartResult(
+        TestPartResult::kFatalFailure, test_info->file(), test_info->line(),
+        "Unable to start a worker process to run the test."));
+    return;
+  }
+
+  const int timeout_ms = test_info->timeout_to_apply();
+  std::vector<void*> crash_frames;
+  int crash_signal = 0;
+  bool timed_out = false;
+  UInt32 type;
+  std::string payload;
+  while (ReadFrame(result_fd_, timeout_ms > 0 ?
+                       timeout_ms + kWorkerGraceMillis : -1,
+                   &type, &payload, &timed_out)) {
+    StreamFrameReader reader(payload.data(), payload.size());
+    Int64 a = 0, b = 0, c = 0;
+    std::string file, text;
+    switch (type) {
+      case kWorkerTestPartResult:
+        if (reader.Read(&a) && reader.Read(&file) && reader.Read(&b) &&
+            reader.Read(&text)) {
+          reporter->ReportTestPartResult(TestPartResult(
+              static_cast<TestPartResult::Type>(a),
+              file.empty() ? NULL : file.c_str(), static_cast<int>(b),
+              text.c_str()));
+        }
+        break;
+      case kWorkerTestEnd:
+        if (reader.Read(&a) && reader.Read(&outcome->captured_output) &&
+            reader.Read(&b)) {
+          outcome->elapsed_time = a;
+          while (reader.Read(&file) && reader.Read(&text))
+            impl->RecordProperty(TestProperty(file, text));
+          // The worker exits after its last test, or one its watchdog gave
+          // up on.
+          if (b)
+            ReapWorker();
+          return;
+        }
+        break;
+      case kWorkerCrash:
+        if (reader.Read(&a) && reader.Read(&b)) {
+          crash_signal = static_cast<int>(a);
+          for (Int64 i = 0; i < b && reader.Read(&c); ++i)
+            crash_frames.push_back(reinterpret_cast<void*>(c));
+        }
+        break;
+      default:
+        break;
+    }
+  }
+
+  // The worker died, or hung beyond its own watchdog, before the test
+  // ended.
+  if (timed_out)
+    kill(worker_pid_, SIGKILL);
+  const int status = ReapWorker();
+  Message message;
+  if (timed_out) {
+    message << "The test's worker stopped answering and was killed after "
+            << timeout_ms + kWorkerGraceMillis << " ms.";
+  } else if (crash_signal != 0) {
+    message << "The test crashed with signal " << crash_signal << " ("
+            << strsignal(crash_signal) << ").  Its stack:\n"
+            << FormatStack(&crash_frames[0],
+                           static_cast<int>(crash_frames.size()));
+  } else if (WIFSIGNALED(status)) {
+    message << "The test's worker was killed by signal " << WTERMSIG(status)
+            << " (" << strsignal(WTERMSIG(status)) << ").";
+  } else {
+    message << "The test's worker exited with status "
+            << WEXITSTATUS(status) << " before the test ended.";
+  }
+  reporter->ReportTestPartResult(TestPartResult(
+      TestPartResult::kFatalFailure, test_info->file(), test_info->line(),
+      message.GetString().c_str()));
+  outcome->elapsed_time = (GetTimeInNanos() - start) / 1000000;
+}
+
+void WorkerSupervisor::Stop() {
+  if (worker_pid_ >= 0)
+    ReapWorker();
+}
+
+void WorkerSupervisor::EndHungTest(TestInfo* test_info,
+                                   TimeInMillis elapsed) {
+  OutputCapture* const capture = GetUnitTestImpl()->output_capture();
+  const std::string captured_output = capture == NULL ? "" :
+      capture->End(true, GTEST_FLAG(capture_limit));
+  SendTestEnd(*test_info, elapsed, captured_output, true);
+  _exit(1);
+}
+
+bool WorkerSupervisor::StartWorker() {
+  if (tests_by_id_.empty()) {
+    UnitTestImpl* const impl = GetUnitTestImpl();
+    for (int i = 0; i < impl->total_test_case_count(); ++i) {
+      TestCase* const test_case = impl->GetMutableTestCase(i);
+      for (int j = 0; j < test_case->total_test_count(); ++j) {
+        TestInfo* const test_info = test_case->GetMutableTestInfo(j);
+        if (test_info->id() >= static_cast<int>(tests_by_id_.size()))
+          tests_by_id_.resize(test_info->id() + 1);
+        tests_by_id_[test_info->id()] = test_info;
+      }
+    }
+  }
+
+  int commands[2];
+  int results[2];
+  if (pipe2(commands, O_CLOEXEC) != 0)
+    return false;
+  if (pipe2(results, O_CLOEXEC) != 0) {
+    close(commands[0]);
+    close(commands[1]);
+    return false;
+  }
+
+  // Otherwise the worker would write out whatever is buffered once more.
+  fflush(NULL);
+  const pid_t pid = fork();
+  if (pid == 0) {
+    close(commands[1]);
+    close(results[0]);
+    command_fd_ = commands[0];
+    result_fd_ = results[1];
+    in_worker_ = true;
+    WorkerMain();
+  }
+
+  close(commands[0]);
+  close(results[1]);
+  if (pid < 0) {
+    close(commands[1]);
+    close(results[0]);
+    return false;
+  }
+  worker_pid_ = pid;
+  command_fd_ = commands[1];
+  result_fd_ = results[0];
+  return true;
+}
+
+int WorkerSupervisor::ReapWorker() {
+  // Closing the command pipe tells a live worker to exit.
+  close(command_fd_);
+  close(result_fd_);
+  command_fd_ = result_fd_ = -1;
+  int status = 0;
+  while (waitpid(worker_pid_, &status, 0) < 0 && errno == EINTR) {}
+  worker_pid_ = -1;
+  return status;
+}
+
+bool WorkerSupervisor::SendCommand(StreamFrame* frame) {
+  sigset_t pipe_signal;
+  sigset_t old_mask;
+  sigemptyset(&pipe_signal);
+  sigaddset(&pipe_signal, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &pipe_signal, &old_mask);
+  const bool sent = SendFrame(command_fd_, frame);
+  if (!sent && errno == EPIPE) {
+    // Consumes the SIGPIPE the write raised before it's unblocked.
+    const struct timespec no_wait = { 0, 0 };
+    sigtimedwait(&pipe_signal, NULL, &no_wait);
+  }
+  pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+  return sent;
+}
+
+void WorkerSupervisor::WorkerMain() {
+  UnitTestImpl* const impl = GetUnitTestImpl();
+  impl->SetGlobalTestPartResultReporter(new WorkerResultReporter(result_fd_));
+
+  // Crashes are reported from an alternate stack, so a stack overflow is
+  // reported too.
+  worker_result_fd = result_fd_;
+  void* frame;
+  backtrace(&frame, 1);
+  stack_t alternate_stack;
+  alternate_stack.ss_sp = malloc(SIGSTKSZ * 4);
+  alternate_stack.ss_size = SIGSTKSZ * 4;
+  alternate_stack.ss_flags = 0;
+  sigaltstack(&alternate_stack, NULL);
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = &ReportCrash;
+  action.sa_flags = SA_RESETHAND | SA_ONSTACK;
+  sigemptyset(&action.sa_mask);
+  for (size_t i = 0; i < sizeof(kCrashSignals) / sizeof(kCrashSignals[0]);
+       ++i)
+    sigaction(kCrashSignals[i], &action, NULL);
+
+  on_exit(&ExitWorkerNow, NULL);
+
+  int tests_run = 0;
+  UInt32 type;
+  std::string payload;
+  bool timed_out;
+  while (ReadFrame(command_fd_, -1, &type, &payload, &timed_out)) {
+    StreamFrameReader reader(payload.data(), payload.size());
+    Int64 id = -1;
+    if (type == kWorkerRunTest && reader.Read(&id) && id >= 0 &&
+        id < static_cast<Int64>(tests_by_id_.size()) &&
+        tests_by_id_[id] != NULL) {
+      RunTestInWorker(tests_by_id_[id],
+                      ++tests_run == tests_per_worker_);
+      if (tests_run == tests_per_worker_)
+        break;
+    }
+  }
+  fflush(NULL);
+  _exit(0);
+}
+
+void WorkerSupervisor::RunTestInWorker(TestInfo* test_info, bool last) {
+  StreamFrame start(kWorkerTestStart);
+  start.Add(test_info->id());
+  SendFrame(result_fd_, &start);
+
+  UnitTestImpl* const impl = GetUnitTestImpl();
+  TestInfo::ClearTestResult(test_info);
+  impl->set_current_test_info(test_info);
+  test_info->Execute();
+  impl->set_current_test_info(NULL);
+  // _exit skips stdio's buffers, and a crash in a later test would lose
+  // them, so what the test printed goes out now, ahead of its end.
+  fflush(NULL);
+
+  const TestResult& result = *test_info->result();
+  SendTestEnd(*test_info, result.elapsed_time(), result.captured_output(),
+              last);
+}
+
+void WorkerSupervisor::SendTestEnd(const TestInfo& test_info,
+                                   TimeInMillis elapsed,
+                                   const std::string& captured_output,
+                                   bool exiting) {
+  StreamFrame end(kWorkerTestEnd);
+  end.Add(elapsed).Add(captured_output).Add(exiting ? 1 : 0);
+  const TestResult& result = *test_info.result();
+  for (int i = 0; i < result.test_property_count(); ++i) {
+    end.Add(result.GetTestProperty(i).key())
+        .Add(result.GetTestProperty(i).value());
+  }
+  SendFrame(result_fd_, &end);
+}
+
+/************************************************
+ * end of WorkerSupervisor
+ ************************************************/
+
+} // namespace internal
+} // namespace testing
@@ -0,0 +1,116 @@
+#ifndef GTEST_ISOLATION_H_
+#define GTEST_ISOLATION_H_
+
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+#include "gtest.h"
+#include "gtest_port.h"
+#include "gtest_stream.h"
+
+namespace testing {
+namespace internal {
+
+GTEST_DECLARE_string_(isolation);
+GTEST_DECLARE_int32_(fork_batch);
+
+/************************************************
+ * Worker protocol
+ ************************************************/
+// The supervisor and its worker talk in StreamFrames over a pair of pipes,
+// with fields in the order listed.  The worker acknowledges each test it's
+// asked to run, so a crash is always pinned on the right one.
+enum WorkerMessageType {
+  kWorkerRunTest = 1,     // id; to the worker, the rest from it
+  kWorkerTestStart,       // id
+  kWorkerTestPartResult,  // type, file, line, message
+  kWorkerTestEnd,         // elapsed_ms, captured_output, exiting, then a
+                          // key and value per property
+  kWorkerCrash            // signal, frame count, return addresses
+};
+
+// What the supervisor learns about a test besides its parts and
+// properties, which it records as they arrive.
+struct WorkerTestOutcome {
+  TimeInMillis elapsed_time;
+  std::string captured_output;
+};
+
+/************************************************
+ * WorkerSupervisor
+ ************************************************/
+// Runs each test in a worker process forked from this one, so a test that
+// crashes only takes the worker down.  The crash is recorded as a fatal
+// failure with the signal and the worker's stack, and the next test gets a
+// fresh worker.
+//
+// Workers are forked within a test case, after its SetUpTestCase, and
+// don't outlive it.  In "worker" mode the worker runs the case's tests one
+// after another until it crashes, so they still share a process as they
+// would without isolation.  In "fork" mode each worker runs
+// --gtest_fork_batch tests and exits, so every test or batch starts from
+// the state SetUpTestCase left: registration, static initialization and
+// the fixture's costly set-up are done once, and a test's isolation costs
+// a fork instead of an exec.
+class GTEST_API_ WorkerSupervisor {
+ public:
+  // Returns the supervisor for an --gtest_isolation mode, or NULL for
+  // "none" or an unknown mode, which gets a warning.
+  static WorkerSupervisor* Create(const std::string& mode);
+  ~WorkerSupervisor();
+
+  // Runs test_info in the worker, starting one if need be, and reports its
+  // parts and properties as they arrive.
+  void RunTest(TestInfo* test_info, WorkerTestOutcome* outcome);
+
+  // Lets the worker exit and waits for it.
+  void Stop();
+
+  // True in the worker process.
+  bool in_worker() const { return in_worker_; }
+
+  // In the worker: reports the end of a test the watchdog gave up on and
+  // exits, so the supervisor carries on with a new worker.
+  void EndHungTest(TestInfo* test_info, TimeInMillis elapsed);
+
+ private:
+  // A worker exits after tests_per_worker tests, or never if it's 0.
+  explicit WorkerSupervisor(int tests_per_worker);
+
+  bool StartWorker();
+
+  // Waits for the worker to exit and returns its status.
+  int ReapWorker();
+
+  // Sends a command, without letting SIGPIPE kill the supervisor if the
+  // worker is gone.
+  bool SendCommand(StreamFrame* frame);
+
+  // The worker's side.  Never returns.
+  void WorkerMain();
+  // Runs a test; last says the worker exits after it.
+  void RunTestInWorker(TestInfo* test_info, bool last);
+  void SendTestEnd(const TestInfo& test_info, TimeInMillis elapsed,
+                   const std::string& captured_output, bool exiting);
+
+  const int tests_per_worker_;
+  // Every test by id, made before the first fork so workers inherit it.
+  std::vector<TestInfo*> tests_by_id_;
+  pid_t worker_pid_;
+  int command_fd_;
+  int result_fd_;
+  bool in_worker_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(WorkerSupervisor);
+};
+
+/************************************************
+ * end of WorkerSupervisor
+ ************************************************/
+
+} // namespace internal
+} // namespace testing
+
+#endif
@@ -0,0 +1,770 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio_ext.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gtest_output.h"
+
+namespace testing {
+namespace internal {
+
+GTEST_DEFINE_string_(
+    output,
+    internal::StringFromGTestEnv("output", ""),
+    "A format (\"xml\", \"jsonl\" or \"bin\"), optionally followed by a colon and "
+    "an output file name or directory.  A directory is indicated by a "
+    "trailing slash.  jsonl also takes fd:N, an already open descriptor.  "
+    "The report is written as the tests run.");
+
+GTEST_DEFINE_bool_(
+    capture_output,
+    internal::BoolFromGTestEnv("capture_output", false),
+    "Captures what each test writes to stdout and stderr, and prints it "
+    "only if the test fails.");
+
+GTEST_DEFINE_int32_(
+    capture_limit,
+    internal::Int32FromGTestEnv("capture_limit", 0),
+    "With --gtest_capture_output, the most bytes of a failed test's output "
+    "to keep, counted from the end.  0 keeps all of it.");
+
+bool WriteAll(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    const ssize_t written = write(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+static const int kCrashSignals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+
+// The writer thread lets a batch build up for this long, or until it
+// reaches kBatchBytes.
+static const long kBatchDelayMillis = 10;
+static const size_t kBatchBytes = 64 * 1024;
+
+// How long a crash handler waits for the queue, in 1 ms steps.
+static const int kCrashFlushAttempts = 1000;
+
+// The writer flushed on exit and on a crash.
+static AsyncFdWriter* volatile crash_writer = NULL;
+static struct sigaction previous_actions[NSIG];
+
+// Every writer gets a serial number so that a thread can cache its buffer
+// without mistaking a new writer at a freed one's address for the old one.
+static Mutex serial_mutex;
+static UInt64 next_serial = 1;
+static __thread UInt64 cached_serial = 0;
+static __thread std::string* cached_buffer = NULL;
+
+static UInt64 NextSerial() {
+  MutexLock lock(&serial_mutex);
+  return next_serial++;
+}
+
+
+/************************************************
+ * AsyncFdWriter
+ * member function implentation
+ ************************************************/
+// Writes go to a copy of the stream's descriptor, so that they aren't
+// captured along with a test's output when the original is redirected.
+static int DuplicateFd(int fd) {
+  const int copy = fcntl(fd, F_DUPFD_CLOEXEC, 3);
+  return copy < 0 ? fd : copy;
+}
+
+AsyncFdWriter::AsyncFdWriter(FILE* stream)
+    : stream_(stream),
+      fd_(DuplicateFd(fileno(stream))),
+      serial_(NextSerial()),
+      writing_(false),
+      batch_in_flight_(0),
+      writer_idle_(false),
+      stopping_(false) {
+  thread_.reset(new ThreadWithParam<AsyncFdWriter*>(&ThreadMain, this));
+  InstallCrashHandlers(this);
+}
+
+AsyncFdWriter::~AsyncFdWriter() {
+  if (crash_writer == this)
+    crash_writer = NULL;
+  Flush();
+  {
+    MutexLock lock(&mutex_);
+    stopping_ = true;
+    queued_.Signal();
+  }
+  thread_->Join();
+  if (fd_ != fileno(stream_))
+    close(fd_);
+}
+
+void AsyncFdWriter::Printf(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  VPrintf(format, args);
+  va_end(args);
+}
+
+void AsyncFdWriter::VPrintf(const char* format, va_list args) {
+  std::string* const buffer = thread_buffer();
+  char chunk[256];
+  va_list copy;
+  va_copy(copy, args);
+  const int length = vsnprintf(chunk, sizeof(chunk), format, copy);
+  va_end(copy);
+  if (length < 0)
+    return;
+
+  if (static_cast<size_t>(length) < sizeof(chunk)) {
+    buffer->append(chunk, length);
+  } else {
+    const size_t start = buffer->size();
+    buffer->resize(start + length + 1);
+    vsnprintf(&(*buffer)[start], length + 1, format, args);
+    buffer->resize(start + length);
+  }
+}
+
+void AsyncFdWriter::Write(const char* data, size_t size) {
+  thread_buffer()->append(data, size);
+}
+
+std::string* AsyncFdWriter::thread_buffer() {
+  if (cached_serial != serial_) {
+    cached_buffer = buffer_.pointer();
+    cached_serial = serial_;
+  }
+  return cached_buffer;
+}
+
+void AsyncFdWriter::Commit() {
+  std::string* const buffer = thread_buffer();
+  if (buffer->empty())
+    return;
+
+  MutexLock lock(&mutex_);
+  // Whatever the program wrote to the stream since the last commit goes
+  // after the queue and before this buffer.
+  if (__fpending(stream_) > 0) {
+    while (!queue_.empty() || writing_)
+      WriteBatchLocked();
+    fflush(stream_);
+  }
+  const bool was_empty = queue_.empty();
+  queue_.append(*buffer);
+  buffer->clear();
+  if ((was_empty && writer_idle_) || queue_.size() >= kBatchBytes)
+    queued_.Signal();
+}
+
+void AsyncFdWriter::Flush() {
+  Commit();
+  MutexLock lock(&mutex_);
+  while (!queue_.empty() || writing_)
+    WriteBatchLocked();
+}
+
+void AsyncFdWriter::ThreadMain(AsyncFdWriter* writer) {
+  MutexLock lock(&writer->mutex_);
+  for (;;) {
+    writer->writer_idle_ = true;
+    while (writer->queue_.empty() && !writer->stopping_)
+      writer->queued_.Wait(&writer->mutex_);
+    writer->writer_idle_ = false;
+    if (writer->queue_.empty())
+      return;
+
+    const Int64 deadline =
+        GetTimeInNanos() + kBatchDelayMillis * 1000 * 1000;
+    while (!writer->stopping_ && !writer->queue_.empty() &&
+           writer->queue_.size() < kBatchBytes) {
+      const Int64 remaining = deadline - GetTimeInNanos();
+      if (remaining <= 0)
+        break;
+      writer->queued_.WaitFor(&writer->mutex_,
+                               static_cast<long>(remaining / 1000000) + 1);
+    }
+    writer->WriteBatchLocked();
+  }
+}
+
+void AsyncFdWriter::WriteBatchLocked() {
+  // Only one batch is written at a time, so that batches stay in order.
+  if (writing_) {
+    written_.Wait(&mutex_);
+    return;
+  }
+
+  // The two buffers trade places so that neither is reallocated.
+  batch_.swap(queue_);
+  writing_ = true;
+  batch_in_flight_ = 1;
+  mutex_.Unlock();
+  WriteAll(fd_, batch_.data(), batch_.size());
+  batch_.clear();
+  batch_in_flight_ = 0;
+  mutex_.Lock();
+  writing_ = false;
+  written_.Broadcast();
+}
+
+void AsyncFdWriter::InstallCrashHandlers(AsyncFdWriter* writer) {
+  static bool installed = false;
+  crash_writer = writer;
+  if (installed)
+    return;
+  installed = true;
+
+  atexit(&FlushAtExit);
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = &HandleCrash;
+  sigemptyset(&action.sa_mask);
+  for (size_t i = 0; i < sizeof(kCrashSignals) / sizeof(int); ++i)
+    sigaction(kCrashSignals[i], &action, &previous_actions[kCrashSignals[i]]);
+}
+
+void AsyncFdWriter::FlushAtExit() {
+  if (crash_writer != NULL)
+    crash_writer->Flush();
+}
+
+void AsyncFdWriter::HandleCrash(int signal) {
+  if (crash_writer != NULL)
+    crash_writer->FlushAfterCrash();
+
+  // The signal is blocked until the handler returns, and is then delivered
+  // to whatever handled it before.
+  sigaction(signal, &previous_actions[signal], NULL);
+  raise(signal);
+}
+
+void AsyncFdWriter::FlushAfterCrash() {
+  // The crashing thread may hold the lock halfway through an update, in
+  // which case the queue is left alone.
+  const struct timespec pause = { 0, 1000000 };
+  int attempts = 0;
+  while (!mutex_.TryLock()) {
+    if (++attempts == kCrashFlushAttempts)
+      return;
+    nanosleep(&pause, NULL);
+  }
+
+  // A batch taken off the queue is finished by whoever is writing it.
+  for (attempts = 0; batch_in_flight_ && attempts < kCrashFlushAttempts;
+       ++attempts) {
+    nanosleep(&pause, NULL);
+  }
+  WriteAll(fd_, queue_.data(), queue_.size());
+  queue_.clear();
+}
+
+/************************************************
+ * end of AsyncFdWriter
+ ************************************************/
+
+/**** OutputCapture member function implentation ****/
+
+OutputCapture* OutputCapture::Create() {
+  const int fd = memfd_create("mygtest-output", MFD_CLOEXEC);
+  if (fd < 0) {
+    fprintf(stderr, "WARNING: output isn't captured, memfd_create failed: "
+            "%s\n", strerror(errno));
+    fflush(stderr);
+    return NULL;
+  }
+  return new OutputCapture(fd, fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 3),
+                           fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 3));
+}
+
+OutputCapture::OutputCapture(int fd, int saved_stdout, int saved_stderr)
+    : fd_(fd),
+      saved_stdout_(saved_stdout),
+      saved_stderr_(saved_stderr) {}
+
+OutputCapture::~OutputCapture() {
+  close(fd_);
+  close(saved_stdout_);
+  close(saved_stderr_);
+}
+
+void OutputCapture::Begin() {
+  fflush(stdout);
+  fflush(stderr);
+  // Both descriptors share the file's offset, so their output interleaves
+  // as it was written.
+  dup2(fd_, STDOUT_FILENO);
+  dup2(fd_, STDERR_FILENO);
+}
+
+std::string OutputCapture::End(bool keep, Int32 limit) {
+  fflush(stdout);
+  fflush(stderr);
+  dup2(saved_stdout_, STDOUT_FILENO);
+  dup2(saved_stderr_, STDERR_FILENO);
+
+  std::string output;
+  struct stat status;
+  if (keep && fstat(fd_, &status) == 0 && status.st_size > 0) {
+    off_t offset = 0;
+    if (limit > 0 && status.st_size > limit) {
+      offset = status.st_size - limit;
+      output = "[... " + StreamableToString(static_cast<Int64>(offset)) +
+          " bytes of output omitted ...]\n";
+    }
+    const size_t header = output.size();
+    output.resize(header + static_cast<size_t>(status.st_size - offset));
+    size_t done = header;
+    while (done < output.size()) {
+      const ssize_t got = pread(fd_, &output[done], output.size() - done,
+                                offset + static_cast<off_t>(done - header));
+      if (got < 0 && errno == EINTR)
+        continue;
+      if (got <= 0)
+        break;
+      done += static_cast<size_t>(got);
+    }
+    output.resize(done);
+  }
+
+  ftruncate(fd_, 0);
+  lseek(fd_, 0, SEEK_SET);
+  return output;
+}
+
+/************************************************
+ * end of OutputCapture
+ ************************************************/
+
+/**** StreamingXmlPrinter member function implentation ****/
+
+// Wide enough for the largest counts and a time of over 30 years.
+static const size_t kSummaryWidth = 96;
+
+static std::string FormatSeconds(TimeInMillis millis) {
+  char text[32];
+  snprintf(text, sizeof(text), "%lld.%03d",
+           static_cast<long long>(millis / 1000),
+           static_cast<int>(millis % 1000));
+  return text;
+}
+
+static std::string FormatTimestamp(TimeInMillis millis) {
+  const time_t seconds = static_cast<time_t>(millis / 1000);
+  struct tm local;
+  char text[32];
+  if (localtime_r(&seconds, &local) == NULL ||
+      strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%S", &local) == 0)
+    return "";
+  return text;
+}
+
+StreamingXmlPrinter* StreamingXmlPrinter::Create(const std::string& path) {
+  const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                      0666);
+  if (fd < 0) {
+    fprintf(stderr, "WARNING: unable to open \"%s\" for XML output: %s\n",
+            path.c_str(), strerror(errno));
+    fflush(stderr);
+    return NULL;
+  }
+  return new StreamingXmlPrinter(fd);
+}
+
+StreamingXmlPrinter::StreamingXmlPrinter(int fd)
+    : fd_(fd),
+      offset_(0),
+      program_summary_offset_(-1),
+      case_summary_offset_(-1) {}
+
+StreamingXmlPrinter::~StreamingXmlPrinter() {
+  WriteBuffer();
+  close(fd_);
+}
+
+void StreamingXmlPrinter::OnTestProgramStart(const UnitTest& unit_test) {
+  buffer_ += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<testsuites";
+  program_summary_offset_ = AppendSummary(unit_test.test_to_run_count(), 0, 0);
+  buffer_ += " timestamp=\"";
+  buffer_ += FormatTimestamp(GetTimeInMillis());
+  buffer_ += "\" name=\"AllTests\">\n";
+  WriteBuffer();
+}
+
+void StreamingXmlPrinter::OnTestCaseStart(const TestCase& test_case) {
+  buffer_ += "  <testsuite name=\"";
+  AppendEscaped(&buffer_, test_case.name(), true);
+  buffer_ += '"';
+  case_summary_offset_ = AppendSummary(test_case.test_to_run_count(), 0, 0);
+  buffer_ += ">\n";
+}
+
+void StreamingXmlPrinter::OnTestEnd(const TestInfo& test_info) {
+  const TestResult& result = *test_info.result();
+  buffer_ += "    <testcase name=\"";
+  AppendEscaped(&buffer_, test_info.name(), true);
+  buffer_ += "\" status=\"run\" time=\"";
+  buffer_ += FormatSeconds(result.elapsed_time());
+  buffer_ += "\" classname=\"";
+  AppendEscaped(&buffer_, test_info.test_case_name(), true);
+  buffer_ += '"';
+  for (int i = 0; i < result.test_property_count(); ++i) {
+    const TestProperty& property = result.GetTestProperty(i);
+    buffer_ += ' ';
+    AppendEscaped(&buffer_, property.key(), true);
+    buffer_ += "=\"";
+    AppendEscaped(&buffer_, property.value(), true);
+    buffer_ += '"';
+  }
+
+  // The start tag ends before the first child element, or as an empty
+  // element if there's none.
+  bool has_children = false;
+  for (int i = 0; i < result.total_part_count(); ++i) {
+    const TestPartResult& part = result.GetTestPartResult(i);
+    if (!part.failed())
+      continue;
+    if (!has_children)
+      buffer_ += ">\n";
+    has_children = true;
+    std::string location = part.file_name() == NULL ? "unknown file" :
+        part.file_name();
+    if (part.line_number() >= 0)
+      location += ":" + StreamableToString(part.line_number());
+    buffer_ += "      <failure message=\"";
+    AppendEscaped(&buffer_, location.c_str(), true);
+    buffer_ += "&#x0A;";
+    AppendEscaped(&buffer_, part.summary(), true);
+    buffer_ += "\" type=\"\"><![CDATA[";
+    AppendCData(&buffer_, (location + "\n" + part.message()).c_str());
+    buffer_ += "]]></failure>\n";
+  }
+  if (!result.captured_output().empty()) {
+    if (!has_children)
+      buffer_ += ">\n";
+    has_children = true;
+    buffer_ += "      <system-out><![CDATA[";
+    AppendCData(&buffer_, result.captured_output().c_str());
+    buffer_ += "]]></system-out>\n";
+  }
+  buffer_ += has_children ? "    </testcase>\n" : " />\n";
+  WriteBuffer();
+}
+
+void StreamingXmlPrinter::OnTestCaseEnd(const TestCase& test_case) {
+  buffer_ += "  </testsuite>\n";
+  WriteBuffer();
+  PatchSummary(case_summary_offset_, test_case.test_to_run_count(),
+               test_case.failed_test_count(), test_case.elapsed_time());
+}
+
+void StreamingXmlPrinter::OnTestProgramEnd(const UnitTest& unit_test) {
+  buffer_ += "</testsuites>\n";
+  WriteBuffer();
+  PatchSummary(program_summary_offset_, unit_test.test_to_run_count(),
+               unit_test.failed_test_count(), unit_test.elapsed_time());
+}
+
+void StreamingXmlPrinter::AppendEscaped(std::string* out, const char* text,
+                                        bool is_attribute) {
+  // Runs of characters that need no escaping are appended in one go.
+  const char* run = text;
+  for (const char* p = text; ; ++p) {
+    const unsigned char ch = static_cast<unsigned char>(*p);
+    const char* replacement = NULL;
+    switch (ch) {
+      case '\0':
+        out->append(run, p);
+        return;
+      case '<': replacement = is_attribute ? "&lt;" : NULL; break;
+      case '>': replacement = is_attribute ? "&gt;" : NULL; break;
+      case '&': replacement = is_attribute ? "&amp;" : NULL; break;
+      case '"': replacement = is_attribute ? "&quot;" : NULL; break;
+      case '\'': replacement = is_attribute ? "&apos;" : NULL; break;
+      case '\t': replacement = is_attribute ? "&#x09;" : NULL; break;
+      case '\n': replacement = is_attribute ? "&#x0A;" : NULL; break;
+      case '\r': replacement = is_attribute ? "&#x0D;" : NULL; break;
+      default:
+        // Other control characters aren't allowed in XML 1.0 at all.
+        replacement = ch < 0x20 ? "" : NULL;
+        break;
+    }
+    if (replacement != NULL) {
+      out->append(run, p);
+      *out += replacement;
+      run = p + 1;
+    }
+  }
+}
+
+// The section can't contain its own terminator, so it's ended and
+// restarted in the middle of one.
+void StreamingXmlPrinter::AppendCData(std::string* out, const char* text) {
+  for (const char* end; (end = strstr(text, "]]>")) != NULL; text = end + 2) {
+    AppendEscaped(out, std::string(text, end + 2).c_str(), false);
+    *out += "]]><![CDATA[";
+  }
+  AppendEscaped(out, text, false);
+}
+
+Int64 StreamingXmlPrinter::AppendSummary(int tests, int failures,
+                                         TimeInMillis elapsed) {
+  const Int64 offset = offset_ + static_cast<Int64>(buffer_.size());
+  const std::string summary = " tests=\"" + StreamableToString(tests) +
+      "\" failures=\"" + StreamableToString(failures) +
+      "\" disabled=\"0\" errors=\"0\" time=\"" + FormatSeconds(elapsed) + "\"";
+  buffer_ += summary;
+  buffer_.append(kSummaryWidth - summary.size(), ' ');
+  return offset;
+}
+
+void StreamingXmlPrinter::PatchSummary(Int64 offset, int tests, int failures,
+                                       TimeInMillis elapsed) {
+  if (offset < 0)
+    return;
+
+  const size_t mark = buffer_.size();
+  AppendSummary(tests, failures, elapsed);
+  // Fails harmlessly with ESPIPE on pipes and terminals.
+  ssize_t written = 0;
+  do {
+    written = pwrite(fd_, buffer_.data() + mark, kSummaryWidth, offset);
+  } while (written < 0 && errno == EINTR);
+  buffer_.resize(mark);
+}
+
+void StreamingXmlPrinter::WriteBuffer() {
+  WriteAll(fd_, buffer_.data(), buffer_.size());
+  offset_ += static_cast<Int64>(buffer_.size());
+  buffer_.clear();
+}
+
+/************************************************
+ * end of StreamingXmlPrinter
+ ************************************************/
+
+/**** JsonLinesPrinter member function implentation ****/
+
+// Builds one event's line.  Members are appended in call order.
+class JsonLine {
+ public:
+  JsonLine(std::string* out, const char* event) : out_(out) {
+    *out_ += "{\"event\":\"";
+    *out_ += event;
+    *out_ += '"';
+  }
+
+  ~JsonLine() { *out_ += "}\n"; }
+
+  JsonLine& Add(const char* key, const char* value) {
+    AppendKey(key);
+    JsonLinesPrinter::AppendString(out_, value);
+    return *this;
+  }
+
+  JsonLine& Add(const char* key, const std::string& value) {
+    AppendKey(key);
+    JsonLinesPrinter::AppendString(out_, value.data(), value.size());
+    return *this;
+  }
+
+  JsonLine& Add(const char* key, Int64 value) {
+    char text[24];
+    snprintf(text, sizeof(text), "%lld", static_cast<long long>(value));
+    AppendKey(key);
+    *out_ += text;
+    return *this;
+  }
+
+ private:
+  void AppendKey(const char* key) {
+    *out_ += ",\"";
+    *out_ += key;
+    *out_ += "\":";
+  }
+
+  std::string* const out_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(JsonLine);
+};
+
+static const char* PartTypeName(TestPartResult::Type type) {
+  switch (type) {
+    case TestPartResult::kSuccess: return "success";
+    case TestPartResult::kNonFatalFailure: return "nonfatal_failure";
+    case TestPartResult::kFatalFailure: return "fatal_failure";
+  }
+  return "unknown";
+}
+
+JsonLinesPrinter* JsonLinesPrinter::Create(const std::string& target) {
+  if (target.compare(0, 3, "fd:") == 0) {
+    Int32 fd = -1;
+    if (!ParseInt32("The descriptor in --gtest_output", target.c_str() + 3,
+                    &fd) || fd < 0)
+      return NULL;
+    return new JsonLinesPrinter(fd, false);
+  }
+
+  const int fd = open(target.c_str(),
+                      O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  if (fd < 0) {
+    fprintf(stderr, "WARNING: unable to open \"%s\" for JSON output: %s\n",
+            target.c_str(), strerror(errno));
+    fflush(stderr);
+    return NULL;
+  }
+  return new JsonLinesPrinter(fd, true);
+}
+
+JsonLinesPrinter::JsonLinesPrinter(int fd, bool owns_fd)
+    : fd_(fd),
+      owns_fd_(owns_fd) {}
+
+JsonLinesPrinter::~JsonLinesPrinter() {
+  if (owns_fd_)
+    close(fd_);
+}
+
+void JsonLinesPrinter::OnTestProgramStart(const UnitTest& unit_test) {
+  MutexLock lock(&mutex_);
+  JsonLine(&buffer_, "program_start")
+      .Add("timestamp", GetTimeInMillis())
+      .Add("test_cases", unit_test.test_case_to_run_count())
+      .Add("tests", unit_test.test_to_run_count());
+  WriteBuffer();
+}
+
+void JsonLinesPrinter::OnTestCaseStart(const TestCase& test_case) {
+  MutexLock lock(&mutex_);
+  JsonLine(&buffer_, "case_start")
+      .Add("case", test_case.name())
+      .Add("tests", test_case.test_to_run_count());
+  WriteBuffer();
+}
+
+void JsonLinesPrinter::OnTestStart(const TestInfo& test_info) {
+  MutexLock lock(&mutex_);
+  JsonLine(&buffer_, "test_start")
+      .Add("case", test_info.test_case_name())
+      .Add("test", test_info.name())
+      .Add("file", test_info.file())
+      .Add("line", test_info.line());
+  WriteBuffer();
+}
+
+void JsonLinesPrinter::OnTestPartResult(const TestPartResult& result) {
+  MutexLock lock(&mutex_);
+  JsonLine(&buffer_, "part")
+      .Add("type", PartTypeName(result.type()))
+      .Add("file", result.file_name() == NULL ? "" : result.file_name())
+      .Add("line", result.line_number())
+      .Add("message", result.message());
+  WriteBuffer();
+}
+
+void JsonLinesPrinter::OnTestEnd(const TestInfo& test_info) {
+  const TestResult& result = *test_info.result();
+  MutexLock lock(&mutex_);
+  AppendProperties(result);
+  {
+    JsonLine line(&buffer_, "test_end");
+    line.Add("case", test_info.test_case_name())
+        .Add("test", test_info.name())
+        .Add("status", result.Passed() ? "passed" : "failed")
+        .Add("time_ms", result.elapsed_time());
+    if (!result.captured_output().empty())
+      line.Add("output", result.captured_output());
+  }
+  WriteBuffer();
+}
+
+void JsonLinesPrinter::OnTestCaseEnd(const TestCase& test_case) {
+  MutexLock lock(&mutex_);
+  AppendProperties(test_case.ad_hoc_test_result());
+  JsonLine(&buffer_, "case_end")
+      .Add("case", test_case.name())
+      .Add("passed", test_case.successful_test_count())
+      .Add("failed", test_case.failed_test_count())
+      .Add("time_ms", test_case.elapsed_time());
+  WriteBuffer();
+}
+
+void JsonLinesPrinter::OnTestProgramEnd(const UnitTest& unit_test) {
+  MutexLock lock(&mutex_);
+  AppendProperties(unit_test.ad_hoc_test_result());
+  JsonLine(&buffer_, "program_end")
+      .Add("passed", unit_test.successful_test_count())
+      .Add("failed", unit_test.failed_test_count())
+      .Add("time_ms", unit_test.elapsed_time());
+  WriteBuffer();
+}
+
+void JsonLinesPrinter::AppendString(std::string* out, const char* text) {
+  AppendString(out, text, strlen(text));
+}
+
+void JsonLinesPrinter::AppendString(std::string* out, const char* text,
+                                    size_t length) {
+  static const char kHexDigits[] = "0123456789abcdef";
+  const char* const end = text + length;
+  *out += '"';
+  const char* run = text;
+  for (const char* p = text; p != end; ++p) {
+    const unsigned char ch = static_cast<unsigned char>(*p);
+    if (ch >= 0x20 && ch != '"' && ch != '\\')
+      continue;
+
+    out->append(run, p);
+    run = p + 1;
+    switch (ch) {
+      case '"': *out += "\\\""; break;
+      case '\\': *out += "\\\\"; break;
+      case '\n': *out += "\\n"; break;
+      case '\r': *out += "\\r"; break;
+      case '\t': *out += "\\t"; break;
+      default:
+        *out += "\\u00";
+        *out += kHexDigits[ch >> 4];
+        *out += kHexDigits[ch & 0xf];
+        break;
+    }
+  }
+  out->append(run, end);
+  *out += '"';
+}
+
+void JsonLinesPrinter::AppendProperties(const TestResult& result) {
+  for (int i = 0; i < result.test_property_count(); ++i) {
+    const TestProperty& property = result.GetTestProperty(i);
+    JsonLine(&buffer_, "property")
+        .Add("key", property.key())
+        .Add("value", property.value());
+  }
+}
+
+void JsonLinesPrinter::WriteBuffer() {
+  WriteAll(fd_, buffer_.data(), buffer_.size());
+  buffer_.clear();
+}
+
+/************************************************
+ * end of JsonLinesPrinter
+ ************************************************/
+
+} // namespace internal
+} // namespace testing
@@ -0,0 +1,236 @@
+#ifndef GTEST_OUTPUT_H_
+#define GTEST_OUTPUT_H_
+
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+#include <string>
+
+#include "gtest.h"
+#include "gtest_port.h"
+
+namespace testing {
+namespace internal {
+
+GTEST_DECLARE_string_(output);
+GTEST_DECLARE_bool_(capture_output);
+GTEST_DECLARE_int32_(capture_limit);
+
+// Writes data to fd in full, retrying short writes and EINTR.  Returns
+// false on any other error.
+GTEST_API_ bool WriteAll(int fd, const char* data, size_t size);
+
+/************************************************
+ * AsyncFdWriter
+ ************************************************/
+// Writes text to a stdio stream's file descriptor from a background
+// thread.  Each thread formats into its own buffer and Commit() queues it
+// behind everything committed before, so lines keep their order.  The
+// thread waits briefly for a batch to build up before each write(2).
+//
+// Text the program writes to the stream itself stays in order too: it's
+// flushed after the queue when a commit finds it buffered.  The queue is
+// written out at exit and, through a handler for fatal signals, when the
+// program crashes.
+class GTEST_API_ AsyncFdWriter {
+ public:
+  explicit AsyncFdWriter(FILE* stream);
+  ~AsyncFdWriter();
+
+  // Formats into the calling thread's buffer.
+  void Printf(const char* format, ...);
+  void VPrintf(const char* format, va_list args);
+
+  // Appends to the calling thread's buffer as is.
+  void Write(const char* data, size_t size);
+
+  // Queues the calling thread's buffer for writing.
+  void Commit();
+
+  // Commits, and returns once everything queued has been written.
+  void Flush();
+
+ private:
+  static void ThreadMain(AsyncFdWriter* writer);
+
+  std::string* thread_buffer();
+
+  // Writes the queue in one batch.  Called with mutex_ held, which is
+  // released during the write.
+  void WriteBatchLocked();
+
+  static void InstallCrashHandlers(AsyncFdWriter* writer);
+  static void FlushAtExit();
+  static void HandleCrash(int signal);
+
+  // Writes the queue from a signal handler, giving up on it if it can't be
+  // locked safely.
+  void FlushAfterCrash();
+
+  FILE* const stream_;
+  const int fd_;
+  const UInt64 serial_;
+  ThreadLocal<std::string> buffer_;
+  Mutex mutex_;
+  ConditionVariable queued_;
+  ConditionVariable written_;
+  std::string queue_;
+  std::string batch_;
+  bool writing_;
+  volatile sig_atomic_t batch_in_flight_;
+  bool writer_idle_;
+  bool stopping_;
+  scoped_ptr<ThreadWithParam<AsyncFdWriter*> > thread_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(AsyncFdWriter);
+};
+
+/************************************************
+ * end of AsyncFdWriter
+ ************************************************/
+
+/************************************************
+ * OutputCapture
+ ************************************************/
+// Sends whatever is written to fds 1 and 2 into an in-memory file while a
+// test runs.  Only the output of a failed test is read back; the rest is
+// thrown away, so noisy passing tests cost no terminal or log I/O.
+class GTEST_API_ OutputCapture {
+ public:
+  // Returns NULL if memfd_create(2) isn't available.
+  static OutputCapture* Create();
+  ~OutputCapture();
+
+  void Begin();
+
+  // Restores fds 1 and 2.  If keep is true, returns what was written, or
+  // only the last limit bytes of it when limit is positive.
+  std::string End(bool keep, Int32 limit);
+
+ private:
+  OutputCapture(int fd, int saved_stdout, int saved_stderr);
+
+  const int fd_;
+  const int saved_stdout_;
+  const int saved_stderr_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(OutputCapture);
+};
+
+/************************************************
+ * end of OutputCapture
+ ************************************************/
+
+/************************************************
+ * StreamingXmlPrinter
+ ************************************************/
+// Writes a JUnit XML report as the tests run.  Each <testcase> is written
+// when its test ends, so memory use doesn't grow with the suite and a
+// crash leaves every finished test on disk.
+//
+// Totals aren't known until the end: the <testsuites> and <testsuite>
+// elements get a fixed-width run of attributes that is rewritten in place
+// with pwrite(2) once they are.  On a pipe the first values stay.
+class GTEST_API_ StreamingXmlPrinter
+    : public SelectiveTestEventListener<kOnTestProgramStart | kOnTestCaseStart |
+                                        kOnTestEnd | kOnTestCaseEnd |
+                                        kOnTestProgramEnd> {
+ public:
+  // Returns a printer for path, or NULL if it can't be opened.
+  static StreamingXmlPrinter* Create(const std::string& path);
+  virtual ~StreamingXmlPrinter();
+
+  virtual void OnTestProgramStart(const UnitTest& unit_test);
+  virtual void OnTestCaseStart(const TestCase& test_case);
+  virtual void OnTestEnd(const TestInfo& test_info);
+  virtual void OnTestCaseEnd(const TestCase& test_case);
+  virtual void OnTestProgramEnd(const UnitTest& unit_test);
+
+  // Appends text, escaped for an attribute value or element content.
+  static void AppendEscaped(std::string* out, const char* text,
+                            bool is_attribute);
+
+  // Appends text to an open CDATA section.
+  static void AppendCData(std::string* out, const char* text);
+
+ private:
+  explicit StreamingXmlPrinter(int fd);
+
+  // Appends a fixed-width attribute run, returning its file offset.
+  Int64 AppendSummary(int tests, int failures, TimeInMillis elapsed);
+  void PatchSummary(Int64 offset, int tests, int failures,
+                    TimeInMillis elapsed);
+
+  void WriteBuffer();
+
+  const int fd_;
+  Int64 offset_;
+  Int64 program_summary_offset_;
+  Int64 case_summary_offset_;
+  std::string buffer_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(StreamingXmlPrinter);
+};
+
+/************************************************
+ * end of StreamingXmlPrinter
+ ************************************************/
+
+/************************************************
+ * JsonLinesPrinter
+ ************************************************/
+// Writes one JSON object per line for each event, as it happens, so a
+// collector can follow a run that is still going.  Every object has an
+// "event" member: program_start, case_start, test_start, part, property,
+// test_end, case_end or program_end.  End events carry the elapsed time.
+class GTEST_API_ JsonLinesPrinter
+    : public SelectiveTestEventListener<kOnTestProgramStart | kOnTestCaseStart |
+                                        kOnTestStart | kOnTestPartResult |
+                                        kOnTestEnd | kOnTestCaseEnd |
+                                        kOnTestProgramEnd> {
+ public:
+  // Returns a printer for a path or an open "fd:N", or NULL if the path
+  // can't be opened.
+  static JsonLinesPrinter* Create(const std::string& target);
+  virtual ~JsonLinesPrinter();
+
+  virtual void OnTestProgramStart(const UnitTest& unit_test);
+  virtual void OnTestCaseStart(const TestCase& test_case);
+  virtual void OnTestStart(const TestInfo& test_info);
+  virtual void OnTestPartResult(const TestPartResult& result);
+  virtual void OnTestEnd(const TestInfo& test_info);
+  virtual void OnTestCaseEnd(const TestCase& test_case);
+  virtual void OnTestProgramEnd(const UnitTest& unit_test);
+
+  // Appends text as a quoted JSON string.
+  static void AppendString(std::string* out, const char* text);
+  // Likewise for length bytes, NULs included, which become \u0000.
+  static void AppendString(std::string* out, const char* text,
+                           size_t length);
+
+ private:
+  JsonLinesPrinter(int fd, bool owns_fd);
+
+  void AppendProperties(const TestResult& result);
+
+  // Writes the buffered lines.  Called with mutex_ held.
+  void WriteBuffer();
+
+  const int fd_;
+  const bool owns_fd_;
+  // Part results can arrive from any thread.
+  Mutex mutex_;
+  std::string buffer_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(JsonLinesPrinter);
+};
+
+/************************************************
+ * end of JsonLinesPrinter
+ ************************************************/
+
+} // namespace internal
+} // namespace testing
+
+#endif
@@ -1,3 +1,4 @@
+#include <ctype.h>
 #include <stdlib.h>
 #include <utility>
 
@@ -37,19 +38,57 @@ GTestLog::~GTestLog() {
   }
 }
 
+bool ParseInt32(const char* src_text, const char* str, Int32* value) {
+  char* end = NULL;
+  const long long_value = strtol(str, &end, 10);
+  if (*end != '\0') {
+    GTEST_LOG_(WARNING) << src_text << " is expected to be a 32-bit integer, "
+                        << "but actually has value \"" << str << "\".";
+    return false;
+  }
+
+  const Int32 result = static_cast<Int32>(long_value);
+  if (long_value != result) {
+    GTEST_LOG_(WARNING) << src_text << " is expected to be a 32-bit integer, "
+                        << "but actually has value " << str
+                        << ", which overflows.";
+    return false;
+  }
+
+  *value = result;
+  return true;
+}
+
+// Returns the name of the environment variable for --gtest_<flag>, e.g.
+// GTEST_PRINT_SYNC for print_sync.
+static std::string FlagToEnvVar(const char* flag) {
+  std::string env_var = "GTEST_";
+  for (const char* p = flag; *p != '\0'; ++p)
+    env_var += static_cast<char>(toupper(static_cast<unsigned char>(*p)));
+  return env_var;
+}
+
 bool BoolFromGTestEnv(const char* flag, bool default_value) {
-  // TODO
-  return false;
+  const char* const value = getenv(FlagToEnvVar(flag).c_str());
+  return value == NULL ? default_value : strcmp(value, "0") != 0;
 }
 
 Int32 Int32FromGTestEnv(const char* flag, Int32 default_value) {
-  // TODO
-  return 1;
+  const std::string env_var = FlagToEnvVar(flag);
+  const char* const value = getenv(env_var.c_str());
+  if (value == NULL)
+    return default_value;
+
+  Int32 result = default_value;
+  if (!ParseInt32(("Environment variable " + env_var).c_str(), value,
+                  &result))
+    return default_value;
+  return result;
 }
 
 std::string StringFromGTestEnv(const char* flag, const char* default_value) {
-  // TODO
-  return default_value;
+  const char* const value = getenv(FlagToEnvVar(flag).c_str());
+  return value == NULL ? default_value : value;
 }
 
 } // namespace internal
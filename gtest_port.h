@@ -2,7 +2,10 @@
 #define GTEST_PORT_H_
 
 #include <iostream>
+#include <errno.h>
 #include <pthread.h>
+#include <sched.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -165,12 +168,23 @@ class MutexBase {
     GTEST_CHECK_POSIX_SUCCESS_(pthread_mutex_unlock(&mutex_));
   }
 
+  // Returns false instead of blocking if another thread holds the mutex.
+  bool TryLock() {
+    if (pthread_mutex_trylock(&mutex_) != 0)
+      return false;
+    owner_ = pthread_self();
+    has_owner_ = true;
+    return true;
+  }
+
   void AssertHeld() const {
     GTEST_CHECK_(has_owner_ && pthread_equal(owner_, pthread_self()))
         << "The current thread is not holding the mutex @" << this;
   }
 
  protected:
+  friend class ConditionVariable;
+
   pthread_mutex_t mutex_;
   bool has_owner_;
   pthread_t owner_;
@@ -205,6 +219,174 @@ class GTestMutexLock {
 
 typedef GTestMutexLock MutexLock;
 
+class GTEST_API_ ConditionVariable {
+ public:
+  ConditionVariable() {
+    pthread_condattr_t attributes;
+    GTEST_CHECK_POSIX_SUCCESS_(pthread_condattr_init(&attributes));
+    GTEST_CHECK_POSIX_SUCCESS_(
+        pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC));
+    GTEST_CHECK_POSIX_SUCCESS_(pthread_cond_init(&cond_, &attributes));
+    pthread_condattr_destroy(&attributes);
+  }
+  ~ConditionVariable() {
+    GTEST_CHECK_POSIX_SUCCESS_(pthread_cond_destroy(&cond_));
+  }
+
+  // Unlocks mutex, which the caller holds, until signalled.
+  void Wait(MutexBase* mutex) {
+    mutex->has_owner_ = false;
+    GTEST_CHECK_POSIX_SUCCESS_(pthread_cond_wait(&cond_, &mutex->mutex_));
+    mutex->owner_ = pthread_self();
+    mutex->has_owner_ = true;
+  }
+
+  // Like Wait, but returns false if timeout_ms pass without a signal.
+  bool WaitFor(MutexBase* mutex, long timeout_ms) {
+    timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+      ++deadline.tv_sec;
+      deadline.tv_nsec -= 1000000000;
+    }
+
+    mutex->has_owner_ = false;
+    const int result =
+        pthread_cond_timedwait(&cond_, &mutex->mutex_, &deadline);
+    mutex->owner_ = pthread_self();
+    mutex->has_owner_ = true;
+    GTEST_CHECK_(result == 0 || result == ETIMEDOUT)
+        << "pthread_cond_timedwait failed with error " << result;
+    return result == 0;
+  }
+
+  void Signal() { GTEST_CHECK_POSIX_SUCCESS_(pthread_cond_signal(&cond_)); }
+  void Broadcast() {
+    GTEST_CHECK_POSIX_SUCCESS_(pthread_cond_broadcast(&cond_));
+  }
+
+ private:
+  pthread_cond_t cond_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(ConditionVariable);
+};
+
+class GTEST_API_ Barrier {
+ public:
+  explicit Barrier(unsigned int count) {
+    GTEST_CHECK_POSIX_SUCCESS_(pthread_barrier_init(&barrier_, NULL, count));
+  }
+  ~Barrier() {
+    GTEST_CHECK_POSIX_SUCCESS_(pthread_barrier_destroy(&barrier_));
+  }
+
+  // Blocks until count threads have called Wait().
+  void Wait() {
+    const int result = pthread_barrier_wait(&barrier_);
+    GTEST_CHECK_(result == 0 || result == PTHREAD_BARRIER_SERIAL_THREAD)
+        << "pthread_barrier_wait failed with error " << result;
+  }
+
+ private:
+  pthread_barrier_t barrier_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(Barrier);
+};
+
+// Like Barrier, but waiters spin instead of sleeping in the kernel, so
+// they're released within nanoseconds of each other.  A waiter yields
+// after spinning a while, in case there are more threads than CPUs.
+class GTEST_API_ SpinBarrier {
+ public:
+  explicit SpinBarrier(int count)
+      : count_(count), waiting_(0), generation_(0) {}
+
+  // Blocks until count threads have called Wait().
+  void Wait() {
+    const int generation = __atomic_load_n(&generation_, __ATOMIC_ACQUIRE);
+    if (__atomic_add_fetch(&waiting_, 1, __ATOMIC_ACQ_REL) == count_) {
+      // Reset before the release, so no early waiter of the next round
+      // counts against this one.
+      __atomic_store_n(&waiting_, 0, __ATOMIC_RELAXED);
+      __atomic_store_n(&generation_, generation + 1, __ATOMIC_RELEASE);
+      return;
+    }
+    for (int spins = 0;
+         __atomic_load_n(&generation_, __ATOMIC_ACQUIRE) == generation;
+         ++spins) {
+      if (spins >= kSpinsBeforeYield)
+        sched_yield();
+    }
+  }
+
+ private:
+  static const int kSpinsBeforeYield = 1 << 14;
+
+  const int count_;
+  int waiting_;
+  int generation_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(SpinBarrier);
+};
+
+class ThreadWithParamBase {
+ public:
+  virtual ~ThreadWithParamBase() {}
+  virtual void Run() = 0;
+};
+
+extern "C" inline void* ThreadFuncWithCLinkage(void* thread) {
+  static_cast<ThreadWithParamBase*>(thread)->Run();
+  return NULL;
+}
+
+template <typename T>
+class ThreadWithParam : public ThreadWithParamBase {
+ public:
+  typedef void UserThreadFunc(T);
+
+  ThreadWithParam(UserThreadFunc* func, T param)
+      : func_(func), param_(param), finished_(false) {
+    ThreadWithParamBase* const base = this;
+    GTEST_CHECK_POSIX_SUCCESS_(
+        pthread_create(&thread_, NULL, &ThreadFuncWithCLinkage, base));
+  }
+  ~ThreadWithParam() { Join(); }
+
+  void Join() {
+    if (!finished_) {
+      GTEST_CHECK_POSIX_SUCCESS_(pthread_join(thread_, NULL));
+      finished_ = true;
+    }
+  }
+
+  virtual void Run() { func_(param_); }
+
+ private:
+  UserThreadFunc* const func_;
+  const T param_;
+  pthread_t thread_;
+  bool finished_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(ThreadWithParam);
+};
+
+// Returns the number of online CPUs, at least 1.
+inline int GetCpuCount() {
+  const long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? static_cast<int>(count) : 1;
+}
+
+// Pins the calling thread to the given CPU.  Returns false on failure.
+inline bool PinCurrentThreadToCpu(int cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
 class ThreadLocalValueHolderBase {
  public:
   virtual ~ThreadLocalValueHolderBase() {}
@@ -354,6 +536,20 @@ typedef TypeWithSize<8>::Int Int64;
 typedef TypeWithSize<8>::UInt UInt64;
 typedef TypeWithSize<8>::Int TimeInMillis;  // Represents time in milliseconds.
 
+// Returns the wall-clock time in milliseconds since the epoch.
+inline TimeInMillis GetTimeInMillis() {
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return static_cast<TimeInMillis>(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+}
+
+// Reads the monotonic clock.  Used for benchmark timing.
+inline Int64 GetTimeInNanos() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<Int64>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
 #if !defined(GTEST_FLAG)
 #define GTEST_FLAG(name) FLAGS_gtest_##name
 #endif
@@ -371,6 +567,10 @@ typedef TypeWithSize<8>::Int TimeInMillis;  // Represents time in milliseconds.
 #define GTEST_DEFINE_string_(name, default_val, doc) \
     GTEST_API_ ::std::string GTEST_FLAG(name) = (default_val)
 
+// Parses str as a decimal Int32.  On failure prints a warning naming
+// src_text and returns false without touching value.
+GTEST_API_ bool ParseInt32(const char* src_text, const char* str, Int32* value);
+
 bool BoolFromGTestEnv(const char* flag, bool default_val);
 GTEST_API_ Int32 Int32FromGTestEnv(const char* flag, Int32 default_val);
 std::string StringFromGTestEnv(const char* flag, const char* default_val);
@@ -0,0 +1,221 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "gtest_output.h"
+#include "gtest_result_file.h"
+
+namespace testing {
+namespace internal {
+
+/**** Binary result format function implentation ****/
+
+static UInt64 HashString(UInt64 hash, const char* text) {
+  // FNV-1a, including the terminator so that "ab","c" differs from "a","bc".
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(text);
+  do {
+    hash = (hash ^ *p) * 1099511628211ULL;
+  } while (*p++ != '\0');
+  return hash;
+}
+
+UInt64 HashTestRegistry(const UnitTest& unit_test) {
+  // Summed per test, so that the order tests run in doesn't matter.
+  UInt64 sum = 0;
+  for (int i = 0; i < unit_test.total_test_case_count(); ++i) {
+    const TestCase* const test_case = unit_test.GetTestCase(i);
+    for (int j = 0; j < test_case->total_test_count(); ++j) {
+      const TestInfo* const test_info = test_case->GetTestInfo(j);
+      UInt64 hash = 14695981039346656037ULL;
+      hash = (hash ^ static_cast<UInt64>(test_info->id())) * 1099511628211ULL;
+      hash = HashString(hash, test_info->test_case_name());
+      sum += HashString(hash, test_info->name());
+    }
+  }
+  return sum;
+}
+
+/**** BinaryResultPrinter member function implentation ****/
+
+BinaryResultPrinter* BinaryResultPrinter::Create(const std::string& path) {
+  const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                      0666);
+  if (fd < 0) {
+    fprintf(stderr, "WARNING: unable to open \"%s\" for binary output: %s\n",
+            path.c_str(), strerror(errno));
+    fflush(stderr);
+    return NULL;
+  }
+  return new BinaryResultPrinter(fd);
+}
+
+BinaryResultPrinter::BinaryResultPrinter(int fd) : fd_(fd) {
+  // Offset 0 is the empty string.
+  Intern("");
+}
+
+BinaryResultPrinter::~BinaryResultPrinter() {
+  close(fd_);
+}
+
+void BinaryResultPrinter::OnTestEnd(const TestInfo& test_info) {
+  const TestResult& result = *test_info.result();
+  BinaryTestRecord record;
+  record.id = static_cast<UInt32>(test_info.id());
+  record.case_name = Intern(test_info.test_case_name());
+  record.name = Intern(test_info.name());
+  record.file = Intern(test_info.file());
+  record.line = test_info.line();
+  record.failed = result.Failed() ? 1 : 0;
+  record.elapsed_time = result.elapsed_time();
+  record.first_part = static_cast<UInt32>(parts_.size());
+  for (int i = 0; i < result.total_part_count(); ++i) {
+    const TestPartResult& part = result.GetTestPartResult(i);
+    if (!part.failed())
+      continue;
+    BinaryPartRecord part_record;
+    part_record.type = static_cast<UInt32>(part.type());
+    part_record.file = Intern(part.file_name() == NULL ? "" : part.file_name());
+    part_record.line = part.line_number();
+    part_record.message = Intern(part.message());
+    parts_.push_back(part_record);
+  }
+  record.part_count = static_cast<UInt32>(parts_.size()) - record.first_part;
+  tests_.push_back(record);
+}
+
+void BinaryResultPrinter::OnTestProgramEnd(const UnitTest& unit_test) {
+  BinaryResultHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kBinaryResultMagic, sizeof(header.magic));
+  header.version = kBinaryResultVersion;
+  header.registered_test_count =
+      static_cast<UInt32>(unit_test.total_test_count());
+  header.record_count = static_cast<UInt32>(tests_.size());
+  header.part_count = static_cast<UInt32>(parts_.size());
+  header.registry_hash = HashTestRegistry(unit_test);
+  header.strings_size = strings_.size();
+  header.start_timestamp = unit_test.start_timestamp();
+  header.elapsed_time = unit_test.elapsed_time();
+
+  WriteAll(fd_, reinterpret_cast<const char*>(&header), sizeof(header));
+  WriteAll(fd_, reinterpret_cast<const char*>(tests_.data()),
+           tests_.size() * sizeof(BinaryTestRecord));
+  WriteAll(fd_, reinterpret_cast<const char*>(parts_.data()),
+           parts_.size() * sizeof(BinaryPartRecord));
+  WriteAll(fd_, strings_.data(), strings_.size());
+}
+
+UInt32 BinaryResultPrinter::Intern(const char* text) {
+  const std::pair<std::unordered_map<std::string, UInt32>::iterator, bool>
+      inserted = string_offsets_.insert(
+          std::make_pair(std::string(text),
+                         static_cast<UInt32>(strings_.size())));
+  if (inserted.second)
+    strings_.append(text, strlen(text) + 1);
+  return inserted.first->second;
+}
+
+/**** BinaryResultFile member function implentation ****/
+
+BinaryResultFile::BinaryResultFile()
+    : data_(NULL),
+      size_(0),
+      header_(NULL),
+      tests_(NULL),
+      parts_(NULL),
+      strings_(NULL) {}
+
+BinaryResultFile::~BinaryResultFile() {
+  if (data_ != NULL)
+    munmap(data_, size_);
+}
+
+bool BinaryResultFile::Open(const std::string& path, std::string* error) {
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat status;
+  if (fd < 0 || fstat(fd, &status) != 0) {
+    *error = path + ": " + strerror(errno);
+    if (fd >= 0)
+      close(fd);
+    return false;
+  }
+
+  const size_t size = static_cast<size_t>(status.st_size);
+  void* const data = size < sizeof(BinaryResultHeader) ? MAP_FAILED :
+      mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    *error = path + ": not a results file";
+    return false;
+  }
+
+  data_ = data;
+  size_ = size;
+  const char* const bytes = static_cast<const char*>(data);
+  header_ = static_cast<const BinaryResultHeader*>(data);
+  tests_ = reinterpret_cast<const BinaryTestRecord*>(
+      bytes + sizeof(BinaryResultHeader));
+  parts_ = reinterpret_cast<const BinaryPartRecord*>(
+      tests_ + header_->record_count);
+  strings_ = reinterpret_cast<const char*>(parts_ + header_->part_count);
+  if (!Validate(size, error)) {
+    *error = path + ": " + *error;
+    return false;
+  }
+  return true;
+}
+
+bool BinaryResultFile::Validate(size_t size, std::string* error) const {
+  const BinaryResultHeader& header = *header_;
+  if (memcmp(header.magic, kBinaryResultMagic, sizeof(header.magic)) != 0) {
+    *error = "not a results file";
+    return false;
+  }
+  if (header.version != kBinaryResultVersion) {
+    *error = "unsupported version " + StreamableToString(header.version);
+    return false;
+  }
+
+  // The counts are 32 bits, so the sizes can't overflow.
+  const UInt64 expected_size = sizeof(BinaryResultHeader) +
+      static_cast<UInt64>(header.record_count) * sizeof(BinaryTestRecord) +
+      static_cast<UInt64>(header.part_count) * sizeof(BinaryPartRecord) +
+      header.strings_size;
+  if (header.strings_size > size || expected_size != size ||
+      header.strings_size == 0 || strings_[header.strings_size - 1] != '\0') {
+    *error = "truncated or corrupt";
+    return false;
+  }
+
+  for (UInt32 i = 0; i < header.record_count; ++i) {
+    const BinaryTestRecord& record = tests_[i];
+    if (record.id >= header.registered_test_count ||
+        record.case_name >= header.strings_size ||
+        record.name >= header.strings_size ||
+        record.file >= header.strings_size ||
+        static_cast<UInt64>(record.first_part) + record.part_count >
+            header.part_count) {
+      *error = "corrupt test record " + StreamableToString(i);
+      return false;
+    }
+  }
+  for (UInt32 i = 0; i < header.part_count; ++i) {
+    const BinaryPartRecord& part = parts_[i];
+    if (part.file >= header.strings_size ||
+        part.message >= header.strings_size) {
+      *error = "corrupt part record " + StreamableToString(i);
+      return false;
+    }
+  }
+  return true;
+}
+
+/************************************************
+ * end of Binary result format
+ ************************************************/
+
+} // namespace internal
+} // namespace testing
@@ -0,0 +1,136 @@
+#ifndef GTEST_RESULT_FILE_H_
+#define GTEST_RESULT_FILE_H_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "gtest.h"
+#include "gtest_port.h"
+
+namespace testing {
+namespace internal {
+
+/************************************************
+ * Binary result format
+ ************************************************/
+// A results file is meant to be mapped and read in place.  In the host's
+// byte order it holds:
+//
+//   BinaryResultHeader
+//   BinaryTestRecord[record_count]
+//   BinaryPartRecord[part_count]
+//   a string table of NUL-terminated strings, referred to by offset
+//
+// Tests are identified by TestInfo::id(); registry_hash tells whether two
+// files came from the same set of registered tests, so that their ids
+// can be matched up.
+const char kBinaryResultMagic[8] = "MYGTRES";
+const UInt32 kBinaryResultVersion = 1;
+
+struct BinaryResultHeader {
+  char magic[8];
+  UInt32 version;
+  UInt32 registered_test_count;
+  UInt32 record_count;
+  UInt32 part_count;
+  UInt64 registry_hash;
+  UInt64 strings_size;
+  Int64 start_timestamp;
+  Int64 elapsed_time;
+};
+
+struct BinaryTestRecord {
+  UInt32 id;
+  UInt32 case_name;
+  UInt32 name;
+  UInt32 file;
+  Int32 line;
+  UInt32 failed;
+  Int64 elapsed_time;
+  UInt32 first_part;
+  UInt32 part_count;
+};
+
+struct BinaryPartRecord {
+  UInt32 type;
+  UInt32 file;
+  Int32 line;
+  UInt32 message;
+};
+
+// Returns a hash of the registered tests' ids and names.
+GTEST_API_ UInt64 HashTestRegistry(const UnitTest& unit_test);
+
+/************************************************
+ * BinaryResultPrinter
+ ************************************************/
+// Collects fixed-size records for each test and its failures, and writes
+// them with the string table when the program ends.  Names and messages
+// are interned, so each is stored once.
+class GTEST_API_ BinaryResultPrinter
+    : public SelectiveTestEventListener<kOnTestEnd | kOnTestProgramEnd> {
+ public:
+  // Returns a printer for path, or NULL if it can't be opened.
+  static BinaryResultPrinter* Create(const std::string& path);
+  virtual ~BinaryResultPrinter();
+
+  virtual void OnTestEnd(const TestInfo& test_info);
+  virtual void OnTestProgramEnd(const UnitTest& unit_test);
+
+ private:
+  explicit BinaryResultPrinter(int fd);
+
+  UInt32 Intern(const char* text);
+
+  const int fd_;
+  std::vector<BinaryTestRecord> tests_;
+  std::vector<BinaryPartRecord> parts_;
+  std::string strings_;
+  std::unordered_map<std::string, UInt32> string_offsets_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(BinaryResultPrinter);
+};
+
+/************************************************
+ * BinaryResultFile
+ ************************************************/
+// A results file mapped into memory.  Open() checks that every record and
+// string offset lies within the file, so the accessors don't.
+class GTEST_API_ BinaryResultFile {
+ public:
+  BinaryResultFile();
+  ~BinaryResultFile();
+
+  // Returns false, with the reason in *error, if path isn't a valid file.
+  bool Open(const std::string& path, std::string* error);
+
+  const BinaryResultHeader& header() const { return *header_; }
+
+  const BinaryTestRecord& test(UInt32 i) const { return tests_[i]; }
+
+  const BinaryPartRecord& part(UInt32 i) const { return parts_[i]; }
+
+  const char* string(UInt32 offset) const { return strings_ + offset; }
+
+ private:
+  bool Validate(size_t size, std::string* error) const;
+
+  void* data_;
+  size_t size_;
+  const BinaryResultHeader* header_;
+  const BinaryTestRecord* tests_;
+  const BinaryPartRecord* parts_;
+  const char* strings_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(BinaryResultFile);
+};
+
+/************************************************
+ * end of Binary result format
+ ************************************************/
+
+} // namespace internal
+} // namespace testing
+
+#endif
@@ -0,0 +1,125 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "gtest_stats.h"
+
+namespace testing {
+namespace internal {
+
+GTEST_DEFINE_string_(
+    stats_file,
+    internal::StringFromGTestEnv("stats_file", ""),
+    "A file to publish live run statistics in, for a monitor such as "
+    "mygtest-top to read while the tests run.");
+
+/**** LiveStatsPublisher member function implentation ****/
+
+LiveStatsPublisher* LiveStatsPublisher::Create(const std::string& path) {
+  const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                      0666);
+  void* data = MAP_FAILED;
+  if (fd >= 0 && ftruncate(fd, sizeof(LiveStatsFile)) == 0) {
+    data = mmap(NULL, sizeof(LiveStatsFile), PROT_READ | PROT_WRITE,
+                MAP_SHARED, fd, 0);
+  }
+  const int saved_errno = errno;
+  if (fd >= 0)
+    close(fd);
+  if (data == MAP_FAILED) {
+    fprintf(stderr, "WARNING: unable to create the stats file \"%s\": %s\n",
+            path.c_str(), strerror(saved_errno));
+    fflush(stderr);
+    return NULL;
+  }
+  return new LiveStatsPublisher(static_cast<LiveStatsFile*>(data));
+}
+
+LiveStatsPublisher::LiveStatsPublisher(LiveStatsFile* file) : file_(file) {
+  // The file was truncated, so everything else is zero.
+  file_->version = kLiveStatsVersion;
+  file_->worker_slots = kLiveStatsWorkers;
+  file_->counters.pid = getpid();
+  // The magic goes last, so a monitor never sees a half-made file as valid.
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(file_->magic, kLiveStatsMagic, sizeof(file_->magic));
+}
+
+LiveStatsPublisher::~LiveStatsPublisher() {
+  munmap(file_, sizeof(LiveStatsFile));
+}
+
+void LiveStatsPublisher::BeginWrite(UInt64* sequence) {
+  __atomic_store_n(sequence, *sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void LiveStatsPublisher::EndWrite(UInt64* sequence) {
+  __atomic_store_n(sequence, *sequence + 1, __ATOMIC_RELEASE);
+}
+
+void LiveStatsPublisher::OnTestProgramStart(const UnitTest& unit_test) {
+  LiveStatsCounters& counters = file_->counters;
+  BeginWrite(&counters.sequence);
+  counters.start_timestamp = GetTimeInMillis();
+  counters.start_nanos = GetTimeInNanos();
+  counters.update_nanos = counters.start_nanos;
+  counters.total_test_count =
+      static_cast<UInt32>(unit_test.test_to_run_count());
+  counters.worker_count = 1;
+  EndWrite(&counters.sequence);
+}
+
+void LiveStatsPublisher::OnTestStart(const TestInfo& test_info) {
+  LiveStatsWorker& worker = file_->workers[0];
+  BeginWrite(&worker.sequence);
+  worker.test_start_nanos = GetTimeInNanos();
+  snprintf(worker.current_test, sizeof(worker.current_test), "%s.%s",
+           test_info.test_case_name(), test_info.name());
+  EndWrite(&worker.sequence);
+}
+
+void LiveStatsPublisher::OnTestEnd(const TestInfo& test_info) {
+  const Int64 now = GetTimeInNanos();
+  LiveStatsWorker& worker = file_->workers[0];
+  BeginWrite(&worker.sequence);
+  worker.test_start_nanos = 0;
+  worker.current_test[0] = '\0';
+  EndWrite(&worker.sequence);
+
+  LiveStatsCounters& counters = file_->counters;
+  BeginWrite(&counters.sequence);
+  ++counters.tests_run;
+  if (test_info.result()->Passed())
+    ++counters.tests_passed;
+  else
+    ++counters.tests_failed;
+
+  // Buckets skipped since the last test are emptied before they're reused.
+  const Int64 second = (now - counters.start_nanos) / 1000000000;
+  for (Int64 s = counters.throughput_second + 1;
+       s <= second && s <= counters.throughput_second +
+           kLiveStatsThroughputSeconds; ++s) {
+    counters.throughput[s % kLiveStatsThroughputSeconds] = 0;
+  }
+  counters.throughput_second = second;
+  ++counters.throughput[second % kLiveStatsThroughputSeconds];
+  counters.update_nanos = now;
+  EndWrite(&counters.sequence);
+}
+
+void LiveStatsPublisher::OnTestProgramEnd(const UnitTest& /*unit_test*/) {
+  LiveStatsCounters& counters = file_->counters;
+  BeginWrite(&counters.sequence);
+  counters.finished = 1;
+  counters.update_nanos = GetTimeInNanos();
+  EndWrite(&counters.sequence);
+}
+
+/************************************************
+ * end of Live statistics
+ ************************************************/
+
+} // namespace internal
+} // namespace testing
@@ -0,0 +1,114 @@
+#ifndef GTEST_STATS_H_
+#define GTEST_STATS_H_
+
+#include <string>
+
+#include "gtest.h"
+#include "gtest_port.h"
+
+namespace testing {
+namespace internal {
+
+GTEST_DECLARE_string_(stats_file);
+
+/************************************************
+ * Live statistics layout
+ ************************************************/
+// --gtest_stats_file maps a small file shared with monitors such as
+// tools/mygtest-top.  Each part has a single writer and a seqlock: the
+// writer makes sequence odd, updates the fields and makes it even again,
+// and a reader retries a copy that saw an odd or changed sequence.  So
+// updating it takes no locks and no system calls.
+const char kLiveStatsMagic[8] = "MYGTSTS";
+const UInt32 kLiveStatsVersion = 1;
+const int kLiveStatsWorkers = 64;
+const int kLiveStatsThroughputSeconds = 64;
+const int kLiveStatsNameSize = 256;
+
+struct LiveStatsCounters {
+  UInt64 sequence;
+  Int64 pid;
+  Int64 start_timestamp;  // Wall clock, in milliseconds.
+  Int64 start_nanos;      // Monotonic clock.
+  Int64 update_nanos;
+  UInt32 total_test_count;
+  UInt32 worker_count;
+  UInt64 tests_run;
+  UInt64 tests_passed;
+  UInt64 tests_failed;
+  UInt32 finished;
+  UInt32 reserved;
+  // Tests finished in each of the last seconds since start_nanos, indexed
+  // by second modulo kLiveStatsThroughputSeconds.
+  Int64 throughput_second;
+  UInt32 throughput[kLiveStatsThroughputSeconds];
+};
+
+struct LiveStatsWorker {
+  UInt64 sequence;
+  Int64 test_start_nanos;  // 0 while idle.
+  char current_test[kLiveStatsNameSize];
+};
+
+struct LiveStatsFile {
+  char magic[8];
+  UInt32 version;
+  UInt32 worker_slots;
+  LiveStatsCounters counters;
+  LiveStatsWorker workers[kLiveStatsWorkers];
+};
+
+// Copies *source into *copy consistently.  Returns false if the writer
+// kept it busy for too long.
+template <typename T>
+bool ReadSeqlocked(const T* source, T* copy) {
+  for (int attempt = 0; attempt < 1000; ++attempt) {
+    const UInt64 before = __atomic_load_n(&source->sequence, __ATOMIC_ACQUIRE);
+    if (before % 2 != 0) {
+      sched_yield();
+      continue;
+    }
+    memcpy(copy, source, sizeof(T));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&source->sequence, __ATOMIC_RELAXED) == before)
+      return true;
+  }
+  return false;
+}
+
+/************************************************
+ * LiveStatsPublisher
+ ************************************************/
+// Publishes the run's counters and the current test into the stats file.
+class GTEST_API_ LiveStatsPublisher
+    : public SelectiveTestEventListener<kOnTestProgramStart | kOnTestStart |
+                                        kOnTestEnd | kOnTestProgramEnd> {
+ public:
+  // Returns a publisher for path, or NULL if it can't be created.
+  static LiveStatsPublisher* Create(const std::string& path);
+  virtual ~LiveStatsPublisher();
+
+  virtual void OnTestProgramStart(const UnitTest& unit_test);
+  virtual void OnTestStart(const TestInfo& test_info);
+  virtual void OnTestEnd(const TestInfo& test_info);
+  virtual void OnTestProgramEnd(const UnitTest& unit_test);
+
+ private:
+  explicit LiveStatsPublisher(LiveStatsFile* file);
+
+  void BeginWrite(UInt64* sequence);
+  void EndWrite(UInt64* sequence);
+
+  LiveStatsFile* const file_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(LiveStatsPublisher);
+};
+
+/************************************************
+ * end of Live statistics
+ ************************************************/
+
+} // namespace internal
+} // namespace testing
+
+#endif
@@ -0,0 +1,345 @@
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "gtest_stream.h"
+
+namespace testing {
+namespace internal {
+
+GTEST_DEFINE_string_(
+    stream_to,
+    internal::StringFromGTestEnv("stream_to", ""),
+    "Streams every test event as it happens to a collector listening on "
+    "unix:path, a Unix domain socket, or tcp:port on localhost.");
+
+static const size_t kRingBytes = 1024 * 1024;
+static const size_t kBatchBytes = 64 * 1024;
+static const long kBatchDelayMillis = 5;
+// How long an event waits for room in a full ring before it's dropped.
+static const long kFullWaitMillis = 100;
+// How long the end of the program waits for the ring to be sent.
+static const long kDrainMillis = 5000;
+
+/**** StreamFrame member function implentation ****/
+
+StreamFrame::StreamFrame(UInt32 type) {
+  StreamFrameHeader header;
+  header.payload_size = 0;
+  header.type = type;
+  data_.append(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+StreamFrame& StreamFrame::Add(Int64 value) {
+  data_.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  return *this;
+}
+
+StreamFrame& StreamFrame::Add(const char* value) {
+  const UInt32 size = static_cast<UInt32>(strlen(value));
+  data_.append(reinterpret_cast<const char*>(&size), sizeof(size));
+  data_.append(value, size);
+  return *this;
+}
+
+StreamFrame& StreamFrame::Add(const std::string& value) {
+  const UInt32 size = static_cast<UInt32>(value.size());
+  data_.append(reinterpret_cast<const char*>(&size), sizeof(size));
+  data_.append(value.data(), size);
+  return *this;
+}
+
+const std::string& StreamFrame::data() {
+  const UInt32 payload_size =
+      static_cast<UInt32>(data_.size() - sizeof(StreamFrameHeader));
+  memcpy(&data_[0], &payload_size, sizeof(payload_size));
+  return data_;
+}
+
+bool StreamFrameReader::Read(Int64* value) {
+  if (static_cast<size_t>(end_ - next_) < sizeof(*value))
+    return false;
+  memcpy(value, next_, sizeof(*value));
+  next_ += sizeof(*value);
+  return true;
+}
+
+bool StreamFrameReader::Read(std::string* value) {
+  UInt32 size = 0;
+  if (static_cast<size_t>(end_ - next_) < sizeof(size))
+    return false;
+  memcpy(&size, next_, sizeof(size));
+  if (static_cast<size_t>(end_ - next_) - sizeof(size) < size)
+    return false;
+  next_ += sizeof(size);
+  value->assign(next_, size);
+  next_ += size;
+  return true;
+}
+
+/**** SocketStreamer member function implentation ****/
+
+SocketStreamer* SocketStreamer::Create(const std::string& target) {
+  int fd = -1;
+  if (target.compare(0, 5, "unix:") == 0) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    const std::string path = target.substr(5);
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+      fprintf(stderr, "WARNING: invalid socket path in --gtest_stream_to: "
+              "\"%s\"\n", path.c_str());
+      fflush(stderr);
+      return NULL;
+    }
+    memcpy(address.sun_path, path.c_str(), path.size());
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect(fd, reinterpret_cast<struct sockaddr*>(&address),
+                           sizeof(address)) != 0) {
+      close(fd);
+      fd = -1;
+    }
+  } else if (target.compare(0, 4, "tcp:") == 0) {
+    Int32 port = 0;
+    if (!ParseInt32("The port in --gtest_stream_to", target.c_str() + 4,
+                    &port) || port <= 0 || port > 65535)
+      return NULL;
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect(fd, reinterpret_cast<struct sockaddr*>(&address),
+                           sizeof(address)) != 0) {
+      close(fd);
+      fd = -1;
+    }
+  } else {
+    fprintf(stderr, "WARNING: --gtest_stream_to takes unix:path or tcp:port, "
+            "not \"%s\"\n", target.c_str());
+    fflush(stderr);
+    return NULL;
+  }
+
+  if (fd < 0) {
+    fprintf(stderr, "WARNING: unable to connect to \"%s\": %s\n",
+            target.c_str(), strerror(errno));
+    fflush(stderr);
+    return NULL;
+  }
+  return new SocketStreamer(fd);
+}
+
+SocketStreamer::SocketStreamer(int fd)
+    : fd_(fd),
+      ring_(kRingBytes),
+      head_(0),
+      tail_(0),
+      dropped_(0),
+      dropped_reported_(0),
+      sender_idle_(false),
+      disconnected_(false),
+      flushing_(false),
+      stopping_(false) {
+  thread_.reset(new ThreadWithParam<SocketStreamer*>(&ThreadMain, this));
+}
+
+SocketStreamer::~SocketStreamer() {
+  Drain();
+  {
+    MutexLock lock(&mutex_);
+    stopping_ = true;
+    queued_.Signal();
+  }
+  thread_->Join();
+  close(fd_);
+}
+
+void SocketStreamer::OnTestProgramStart(const UnitTest& unit_test) {
+  StreamFrame frame(kStreamProgramStart);
+  frame.Add(kStreamVersion)
+      .Add(static_cast<Int64>(getpid()))
+      .Add(GetTimeInMillis())
+      .Add(unit_test.test_to_run_count());
+  Send(&frame);
+}
+
+void SocketStreamer::OnTestCaseStart(const TestCase& test_case) {
+  StreamFrame frame(kStreamTestCaseStart);
+  frame.Add(test_case.name()).Add(test_case.test_to_run_count());
+  Send(&frame);
+}
+
+void SocketStreamer::OnTestStart(const TestInfo& test_info) {
+  StreamFrame frame(kStreamTestStart);
+  frame.Add(test_info.id())
+      .Add(test_info.test_case_name())
+      .Add(test_info.name());
+  Send(&frame);
+}
+
+void SocketStreamer::OnTestPartResult(const TestPartResult& result) {
+  StreamFrame frame(kStreamTestPartResult);
+  frame.Add(static_cast<Int64>(result.type()))
+      .Add(result.file_name() == NULL ? "" : result.file_name())
+      .Add(result.line_number())
+      .Add(result.message());
+  Send(&frame);
+}
+
+void SocketStreamer::OnTestEnd(const TestInfo& test_info) {
+  StreamFrame frame(kStreamTestEnd);
+  frame.Add(test_info.id())
+      .Add(test_info.test_case_name())
+      .Add(test_info.name())
+      .Add(test_info.result()->Passed() ? 1 : 0)
+      .Add(test_info.result()->elapsed_time());
+  Send(&frame);
+}
+
+void SocketStreamer::OnTestCaseEnd(const TestCase& test_case) {
+  StreamFrame frame(kStreamTestCaseEnd);
+  frame.Add(test_case.name())
+      .Add(test_case.successful_test_count())
+      .Add(test_case.failed_test_count())
+      .Add(test_case.elapsed_time());
+  Send(&frame);
+}
+
+void SocketStreamer::OnTestProgramEnd(const UnitTest& unit_test) {
+  StreamFrame frame(kStreamProgramEnd);
+  frame.Add(unit_test.successful_test_count())
+      .Add(unit_test.failed_test_count())
+      .Add(unit_test.elapsed_time());
+  Send(&frame);
+  Drain();
+}
+
+UInt64 SocketStreamer::dropped_count() const {
+  MutexLock lock(&mutex_);
+  return dropped_;
+}
+
+void SocketStreamer::ThreadMain(SocketStreamer* streamer) {
+  MutexLock lock(&streamer->mutex_);
+  for (;;) {
+    streamer->sender_idle_ = true;
+    while (streamer->head_ == streamer->tail_ && !streamer->stopping_)
+      streamer->queued_.Wait(&streamer->mutex_);
+    streamer->sender_idle_ = false;
+    if (streamer->head_ == streamer->tail_)
+      return;
+
+    // Lets a batch build up, unless it's big enough already or someone is
+    // waiting for it.
+    const Int64 deadline =
+        GetTimeInNanos() + kBatchDelayMillis * 1000 * 1000;
+    while (!streamer->stopping_ && !streamer->flushing_ &&
+           streamer->head_ - streamer->tail_ < kBatchBytes) {
+      const Int64 remaining = deadline - GetTimeInNanos();
+      if (remaining <= 0)
+        break;
+      streamer->queued_.WaitFor(&streamer->mutex_,
+                                static_cast<long>(remaining / 1000000) + 1);
+    }
+    streamer->SendBatchLocked();
+  }
+}
+
+void SocketStreamer::Send(StreamFrame* frame) {
+  const std::string& data = frame->data();
+  MutexLock lock(&mutex_);
+  if (disconnected_)
+    return;
+
+  // Room is needed for a report of earlier drops, too.
+  const size_t needed = data.size() + (dropped_ == dropped_reported_ ? 0 :
+      sizeof(StreamFrameHeader) + sizeof(Int64));
+  const Int64 deadline = GetTimeInNanos() + kFullWaitMillis * 1000 * 1000;
+  while (ring_.size() - (head_ - tail_) < needed && !disconnected_) {
+    const Int64 remaining = deadline - GetTimeInNanos();
+    if (remaining <= 0)
+      break;
+    queued_.Signal();
+    sent_.WaitFor(&mutex_, static_cast<long>(remaining / 1000000) + 1);
+  }
+  if (disconnected_)
+    return;
+  if (ring_.size() - (head_ - tail_) < needed) {
+    ++dropped_;
+    return;
+  }
+
+  if (dropped_ != dropped_reported_) {
+    StreamFrame report(kStreamDropped);
+    AppendLocked(report.Add(static_cast<Int64>(dropped_ - dropped_reported_))
+                     .data());
+    dropped_reported_ = dropped_;
+  }
+  AppendLocked(data);
+  if (sender_idle_ || head_ - tail_ >= kBatchBytes)
+    queued_.Signal();
+}
+
+void SocketStreamer::AppendLocked(const std::string& data) {
+  const size_t start = static_cast<size_t>(head_ % ring_.size());
+  const size_t first = std::min(data.size(), ring_.size() - start);
+  memcpy(&ring_[start], data.data(), first);
+  memcpy(&ring_[0], data.data() + first, data.size() - first);
+  head_ += data.size();
+}
+
+void SocketStreamer::SendBatchLocked() {
+  // Producers only append past head_, so the batch can be sent unlocked.
+  const UInt64 start = tail_;
+  const UInt64 end = head_;
+  mutex_.Unlock();
+
+  UInt64 sent = start;
+  bool failed = false;
+  while (sent < end) {
+    const size_t offset = static_cast<size_t>(sent % ring_.size());
+    const size_t size = static_cast<size_t>(
+        std::min<UInt64>(end - sent, ring_.size() - offset));
+    const ssize_t written = send(fd_, &ring_[offset], size, MSG_NOSIGNAL);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0) {
+      failed = true;
+      break;
+    }
+    sent += static_cast<UInt64>(written);
+  }
+
+  mutex_.Lock();
+  tail_ = failed ? head_ : end;
+  disconnected_ = disconnected_ || failed;
+  sent_.Broadcast();
+}
+
+void SocketStreamer::Drain() {
+  MutexLock lock(&mutex_);
+  flushing_ = true;
+  queued_.Signal();
+  const Int64 deadline = GetTimeInNanos() + kDrainMillis * 1000 * 1000;
+  while (tail_ != head_ && !disconnected_) {
+    const Int64 remaining = deadline - GetTimeInNanos();
+    if (remaining <= 0)
+      break;
+    sent_.WaitFor(&mutex_, static_cast<long>(remaining / 1000000) + 1);
+  }
+  flushing_ = false;
+}
+
+/************************************************
+ * end of SocketStreamer
+ ************************************************/
+
+} // namespace internal
+} // namespace testing
@@ -0,0 +1,145 @@
+#ifndef GTEST_STREAM_H_
+#define GTEST_STREAM_H_
+
+#include <string>
+#include <vector>
+
+#include "gtest.h"
+#include "gtest_port.h"
+
+namespace testing {
+namespace internal {
+
+GTEST_DECLARE_string_(stream_to);
+
+/************************************************
+ * Event stream framing
+ ************************************************/
+// Every event is a frame: a header, then payload_size bytes of fields in
+// the order listed for its type.  Integers are 64-bit and strings are a
+// 32-bit length and the bytes, all in the host's byte order, since both
+// ends are on the same machine.
+enum StreamEventType {
+  kStreamProgramStart = 1,  // version, pid, timestamp, total_test_count
+  kStreamTestCaseStart,     // test_case_name, test_count
+  kStreamTestStart,         // id, test_case_name, name
+  kStreamTestPartResult,    // type, file, line, message
+  kStreamTestEnd,           // id, test_case_name, name, passed, elapsed_ms
+  kStreamTestCaseEnd,       // test_case_name, passed, failed, elapsed_ms
+  kStreamProgramEnd,        // passed, failed, elapsed_ms
+  kStreamDropped            // count of frames dropped before this one
+};
+
+const Int64 kStreamVersion = 1;
+
+struct StreamFrameHeader {
+  UInt32 payload_size;
+  UInt32 type;
+};
+
+// Builds one frame.  Other pipes reuse the framing with types of their own.
+class GTEST_API_ StreamFrame {
+ public:
+  explicit StreamFrame(UInt32 type);
+
+  StreamFrame& Add(Int64 value);
+  StreamFrame& Add(const char* value);
+  // Unlike the above, keeps any NUL bytes in value.
+  StreamFrame& Add(const std::string& value);
+
+  // The finished frame.
+  const std::string& data();
+
+ private:
+  std::string data_;
+};
+
+// Reads one frame's fields in order.  Returns false once a field would run
+// past the payload.
+class GTEST_API_ StreamFrameReader {
+ public:
+  StreamFrameReader(const char* payload, size_t size)
+      : next_(payload), end_(payload + size) {}
+
+  bool Read(Int64* value);
+  bool Read(std::string* value);
+
+ private:
+  const char* next_;
+  const char* const end_;
+};
+
+/************************************************
+ * SocketStreamer
+ ************************************************/
+// Sends every event to a collector on a Unix domain socket or a TCP port
+// on localhost.  Frames are appended to a ring buffer and a background
+// thread sends them in batches, so a test never waits on the socket.
+//
+// A full ring pushes back: the event waits for room for a short while,
+// and is then dropped and counted so the collector knows.  Once the
+// collector goes away, events are discarded.
+class GTEST_API_ SocketStreamer
+    : public SelectiveTestEventListener<kOnTestProgramStart | kOnTestCaseStart |
+                                        kOnTestStart | kOnTestPartResult |
+                                        kOnTestEnd | kOnTestCaseEnd |
+                                        kOnTestProgramEnd> {
+ public:
+  // Connects to "unix:path" or "tcp:port" and returns the streamer, or NULL
+  // if the target is malformed or nothing is listening.
+  static SocketStreamer* Create(const std::string& target);
+  virtual ~SocketStreamer();
+
+  virtual void OnTestProgramStart(const UnitTest& unit_test);
+  virtual void OnTestCaseStart(const TestCase& test_case);
+  virtual void OnTestStart(const TestInfo& test_info);
+  virtual void OnTestPartResult(const TestPartResult& result);
+  virtual void OnTestEnd(const TestInfo& test_info);
+  virtual void OnTestCaseEnd(const TestCase& test_case);
+  virtual void OnTestProgramEnd(const UnitTest& unit_test);
+
+  // The number of frames dropped for want of room.
+  UInt64 dropped_count() const;
+
+ private:
+  explicit SocketStreamer(int fd);
+
+  static void ThreadMain(SocketStreamer* streamer);
+
+  void Send(StreamFrame* frame);
+
+  // Appends data to the ring.  Called with mutex_ held and room to spare.
+  void AppendLocked(const std::string& data);
+
+  // Sends up to the whole ring with mutex_ released meanwhile.
+  void SendBatchLocked();
+
+  // Waits for the ring to be sent, or the collector to go away.
+  void Drain();
+
+  const int fd_;
+  mutable Mutex mutex_;
+  ConditionVariable queued_;
+  ConditionVariable sent_;
+  std::vector<char> ring_;
+  UInt64 head_;  // Bytes ever appended.
+  UInt64 tail_;  // Bytes ever sent.
+  UInt64 dropped_;
+  UInt64 dropped_reported_;
+  bool sender_idle_;
+  bool disconnected_;
+  bool flushing_;
+  bool stopping_;
+  scoped_ptr<ThreadWithParam<SocketStreamer*> > thread_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(SocketStreamer);
+};
+
+/************************************************
+ * end of SocketStreamer
+ ************************************************/
+
+} // namespace internal
+} // namespace testing
+
+#endif
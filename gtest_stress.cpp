@@ -0,0 +1,282 @@
+#include <algorithm>
+#include <vector>
+
+#include "gtest_internal_impl.h"
+#include "gtest_stress.h"
+
+namespace testing {
+namespace internal {
+
+GTEST_DEFINE_int32_(
+    stress_threads,
+    internal::Int32FromGTestEnv("stress_threads", 0),
+    "The number of threads to run each test --gtest_stress_filter selects "
+    "on at once, or 0 to run tests normally.  Each such test then runs "
+    "--gtest_repeat times in all, but at least once per thread, split "
+    "among the threads, and the suite itself runs once.  With "
+    "--gtest_repeat_until_fail alone, each test repeats until it fails.  "
+    "Benchmarks, TEST_STRESS and TEST_INTERLEAVE tests run their own "
+    "threads and are never repeated.");
+
+GTEST_DEFINE_string_(
+    stress_filter,
+    internal::StringFromGTestEnv("stress_filter", "*"),
+    "The tests --gtest_stress_threads repeats, as a --gtest_filter "
+    "pattern; the others run once.");
+
+GTEST_DEFINE_int32_(
+    stress_rounds,
+    internal::Int32FromGTestEnv("stress_rounds", 100),
+    "The number of rounds a TEST_STRESS test runs its threads for.");
+
+// How many failed rounds a TEST_STRESS test lists by number.
+static const int kMaxListedRounds = 20;
+
+// What StressTest::stress_thread() and stress_round() return.
+static __thread int current_stress_thread = -1;
+static __thread int current_stress_round = -1;
+
+// Passes a stress thread's failures on to the global reporter, noting
+// that the test failed so the other threads stop taking repetitions.
+class StressRunner::FailureNotingReporter
+    : public TestPartResultReporterInterface {
+ public:
+  explicit FailureNotingReporter(StressRunner* runner) : runner_(runner) {}
+
+  virtual void ReportTestPartResult(const TestPartResult& result) {
+    if (result.failed())
+      __atomic_store_n(&runner_->failed_, true, __ATOMIC_RELAXED);
+    GetUnitTestImpl()->GetGlobalTestPartResultReporter()->
+        ReportTestPartResult(result);
+  }
+
+ private:
+  StressRunner* const runner_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(FailureNotingReporter);
+};
+
+/**** StressRunner member function implentation ****/
+
+StressRunner::StressRunner(TestFactoryBase* factory, int threads,
+                           int repetitions)
+    : factory_(factory),
+      threads_(threads),
+      repetitions_(repetitions),
+      next_repetition_(0),
+      completed_(0),
+      failed_(false) {}
+
+Int64 StressRunner::Run() {
+  std::vector<ThreadWithParam<StressRunner*>*> threads;
+  for (int i = 0; i < threads_; ++i)
+    threads.push_back(new ThreadWithParam<StressRunner*>(&ThreadMain, this));
+  for (size_t i = 0; i < threads.size(); ++i)
+    delete threads[i];
+  return completed_;
+}
+
+void StressRunner::ThreadMain(StressRunner* runner) {
+  UnitTestImpl* const impl = GetUnitTestImpl();
+  TestPartResultReporterInterface* const default_reporter =
+      impl->GetTestPartResultReporterForCurrentThread();
+  FailureNotingReporter reporter(runner);
+  impl->SetTestPartResultReporterForCurrentThread(&reporter);
+
+  while (!__atomic_load_n(&runner->failed_, __ATOMIC_RELAXED)) {
+    const Int64 repetition =
+        __atomic_fetch_add(&runner->next_repetition_, 1, __ATOMIC_RELAXED);
+    if (runner->repetitions_ >= 0 && repetition >= runner->repetitions_)
+      break;
+    Test* const test = runner->factory_->CreateTest();
+    if (test != NULL) {
+      test->Run();
+      delete test;
+    }
+    __atomic_fetch_add(&runner->completed_, 1, __ATOMIC_RELAXED);
+  }
+
+  // The thread's slot outlives the reporter.
+  impl->SetTestPartResultReporterForCurrentThread(default_reporter);
+}
+
+/************************************************
+ * end of StressRunner
+ ************************************************/
+
+
+/************************************************
+ * StressRoundRunner
+ ************************************************/
+// Runs a StressTest's rounds, with the test's thread as thread 0.
+class StressRoundRunner {
+ public:
+  explicit StressRoundRunner(StressTest* test);
+
+  void Run();
+
+ private:
+  class RoundReporter;
+
+  struct StressThread {
+    StressRoundRunner* runner;
+    int index;
+    int failures;
+  };
+
+  static void ThreadMain(StressThread* thread);
+
+  // Sums up failures per thread and round in the test's properties.
+  void RecordFailures() const;
+
+  StressTest* const test_;
+  const int rounds_;
+  std::vector<StressThread> threads_;
+  // One per round, set when any thread fails in it.
+  std::vector<char> failed_rounds_;
+  SpinBarrier barrier_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(StressRoundRunner);
+};
+
+// Tags a stress thread's failures with its thread and round and counts
+// them before passing them on.
+class StressRoundRunner::RoundReporter
+    : public TestPartResultReporterInterface {
+ public:
+  explicit RoundReporter(StressThread* thread) : thread_(thread) {}
+
+  virtual void ReportTestPartResult(const TestPartResult& result) {
+    if (!result.failed()) {
+      GetUnitTestImpl()->GetGlobalTestPartResultReporter()->
+          ReportTestPartResult(result);
+      return;
+    }
+
+    ++thread_->failures;
+    __atomic_store_n(&thread_->runner->failed_rounds_[current_stress_round],
+                     1, __ATOMIC_RELAXED);
+    const std::string message = "[stress thread " +
+        StreamableToString(thread_->index) + ", round " +
+        StreamableToString(current_stress_round) + "] " + result.message();
+    GetUnitTestImpl()->GetGlobalTestPartResultReporter()->
+        ReportTestPartResult(TestPartResult(result.type(), result.file_name(),
+                                            result.line_number(),
+                                            message.c_str()));
+  }
+
+ private:
+  StressThread* const thread_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(RoundReporter);
+};
+
+/**** StressRoundRunner member function implentation ****/
+
+StressRoundRunner::StressRoundRunner(StressTest* test)
+    : test_(test),
+      rounds_(std::max(GTEST_FLAG(stress_rounds), 1)),
+      threads_(std::max(test->stress_threads(), 1)),
+      failed_rounds_(rounds_, 0),
+      barrier_(static_cast<int>(threads_.size())) {
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    threads_[i].runner = this;
+    threads_[i].index = static_cast<int>(i);
+    threads_[i].failures = 0;
+  }
+}
+
+void StressRoundRunner::Run() {
+  std::vector<ThreadWithParam<StressThread*>*> threads;
+  for (size_t i = 1; i < threads_.size(); ++i) {
+    threads.push_back(
+        new ThreadWithParam<StressThread*>(&ThreadMain, &threads_[i]));
+  }
+  ThreadMain(&threads_[0]);
+  for (size_t i = 0; i < threads.size(); ++i)
+    delete threads[i];
+  RecordFailures();
+}
+
+void StressRoundRunner::ThreadMain(StressThread* thread) {
+  StressRoundRunner* const runner = thread->runner;
+  UnitTestImpl* const impl = GetUnitTestImpl();
+  TestPartResultReporterInterface* const default_reporter =
+      impl->GetTestPartResultReporterForCurrentThread();
+  RoundReporter reporter(thread);
+  impl->SetTestPartResultReporterForCurrentThread(&reporter);
+  current_stress_thread = thread->index;
+
+  for (int round = 0; round < runner->rounds_; ++round) {
+    current_stress_round = round;
+    runner->barrier_.Wait();
+    runner->test_->StressBody();
+    runner->barrier_.Wait();
+    // The others wait for thread 0 at the start of the next round.
+    if (thread->index == 0)
+      runner->test_->AfterRound();
+  }
+
+  current_stress_thread = current_stress_round = -1;
+  impl->SetTestPartResultReporterForCurrentThread(default_reporter);
+}
+
+void StressRoundRunner::RecordFailures() const {
+  Test::RecordProperty("stress_threads",
+                       StreamableToString(threads_.size()));
+  Test::RecordProperty("stress_rounds", rounds_);
+
+  std::string by_thread;
+  int failures = 0;
+  for (size_t i = 0; i < threads_.size(); ++i) {
+    by_thread += (i == 0 ? "" : " ") + StreamableToString(i) + ":" +
+        StreamableToString(threads_[i].failures);
+    failures += threads_[i].failures;
+  }
+  if (failures == 0)
+    return;
+
+  std::string rounds;
+  int failed_rounds = 0;
+  for (int i = 0; i < rounds_; ++i) {
+    if (!failed_rounds_[i])
+      continue;
+    if (++failed_rounds <= kMaxListedRounds)
+      rounds += (rounds.empty() ? "" : " ") + StreamableToString(i);
+  }
+  if (failed_rounds > kMaxListedRounds)
+    rounds += " and " + StreamableToString(failed_rounds - kMaxListedRounds) +
+        " more";
+  Test::RecordProperty("stress_failures_by_thread", by_thread);
+  Test::RecordProperty("stress_failed_rounds", rounds);
+}
+
+/************************************************
+ * end of StressRoundRunner
+ ************************************************/
+
+} // namespace internal
+
+
+/************************************************
+ * StressTest
+ * member function implentation
+ ************************************************/
+int StressTest::stress_thread() {
+  return internal::current_stress_thread;
+}
+
+int StressTest::stress_round() {
+  return internal::current_stress_round;
+}
+
+void StressTest::TestBody() {
+  internal::StressRoundRunner runner(this);
+  runner.Run();
+}
+
+/************************************************
+ * end of StressTest
+ ************************************************/
+
+} // namespace testing
@@ -0,0 +1,127 @@
+#ifndef GTEST_STRESS_H_
+#define GTEST_STRESS_H_
+
+#include "gtest.h"
+#include "gtest_port.h"
+
+namespace testing {
+namespace internal {
+
+GTEST_DECLARE_int32_(stress_threads);
+GTEST_DECLARE_int32_(stress_rounds);
+GTEST_DECLARE_string_(stress_filter);
+
+class StressRoundRunner;
+
+/************************************************
+ * StressRunner
+ ************************************************/
+// Runs one test's body over and over on several threads at once, each
+// repetition on a fixture of its own, for --gtest_stress_threads.  The
+// threads take repetitions from a shared counter until there are none
+// left or the test fails, so a slow repetition doesn't hold the others
+// back and a failing test isn't repeated to the end.  Failures reach the
+// running test's result through each thread's part result reporter.
+class GTEST_API_ StressRunner {
+ public:
+  // A negative repetitions repeats until the test fails.
+  StressRunner(TestFactoryBase* factory, int threads, int repetitions);
+
+  // Returns the number of repetitions that ran to the end.
+  Int64 Run();
+
+ private:
+  class FailureNotingReporter;
+
+  static void ThreadMain(StressRunner* runner);
+
+  TestFactoryBase* const factory_;
+  const int threads_;
+  const Int64 repetitions_;
+  Int64 next_repetition_;
+  Int64 completed_;
+  bool failed_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(StressRunner);
+};
+
+/************************************************
+ * end of StressRunner
+ ************************************************/
+
+} // namespace internal
+
+
+/************************************************
+ * StressTest
+ ************************************************/
+// The base of TEST_STRESS tests.  The test runs --gtest_stress_rounds
+// rounds on one fixture.  Each round releases all its threads together
+// from a spin barrier to run StressBody, and AfterRound runs once they've
+// all returned.  A failure is reported with the thread and round it
+// happened on.  The test's properties sum up the failures per thread and
+// list the rounds that failed.
+class GTEST_API_ StressTest : public Test {
+ public:
+  // The calling thread's index and the round it's in, both counted from
+  // 0, or -1 outside StressBody and AfterRound.
+  static int stress_thread();
+  static int stress_round();
+
+  int stress_threads() const { return threads_; }
+
+ protected:
+  StressTest() : threads_(1) {}
+
+  void set_stress_threads(int threads) { threads_ = threads; }
+
+  // Runs on thread 0 after every thread has finished the round and before
+  // any starts the next, e.g. to check invariants.
+  virtual void AfterRound() {}
+
+ private:
+  friend class internal::StressRoundRunner;
+
+  virtual void TestBody();
+
+  // Called concurrently on every thread, once a round.
+  virtual void StressBody() = 0;
+
+  int threads_;
+};
+
+} // namespace testing
+
+#define GTEST_STRESS_(test_case, test_name, parent, threads) \
+class GTEST_API_ GTEST_TEST_CLASS_NAME_(test_case, test_name) : public parent {\
+ public:\
+  GTEST_TEST_CLASS_NAME_(test_case, test_name)() {\
+    set_stress_threads(threads);\
+  }\
+ private:\
+  virtual void StressBody();\
+  static testing::TestInfo* test_info_;\
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(GTEST_TEST_CLASS_NAME_(test_case, test_name));\
+};\
+\
+testing::TestInfo* GTEST_TEST_CLASS_NAME_(test_case, test_name)\
+  ::test_info_ = testing::internal::ExcludeFromStress(\
+      testing::internal::MakeAndRegisterTestInfo(\
+          #test_case, #test_name,\
+          ::testing::internal::CodeLocation(__FILE__, __LINE__), \
+          parent::SetUpTestCase, parent::TearDownTestCase, \
+          new testing::internal::TestFactoryImpl<\
+              GTEST_TEST_CLASS_NAME_(test_case, test_name)>));\
+\
+void GTEST_TEST_CLASS_NAME_(test_case, test_name)::StressBody()
+
+// Runs the body on the given number of threads at once, round after
+// round.  StressTest::stress_thread() tells the threads apart.
+#define TEST_STRESS(test_case, test_name, threads) \
+  GTEST_STRESS_(test_case, test_name, ::testing::StressTest, threads)
+
+// Likewise with a fixture, which must derive from ::testing::StressTest.
+#define TEST_F_STRESS(test_case, test_name, threads) \
+  GTEST_STRESS_(test_case, test_name, test_case, threads)
+
+#endif
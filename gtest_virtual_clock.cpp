@@ -0,0 +1,171 @@
+#include <limits>
+
+#include "gtest_virtual_clock.h"
+
+namespace testing {
+namespace internal {
+
+// A deadline now_ never reaches.
+static const Int64 kNoDeadline = std::numeric_limits<Int64>::max();
+
+static Int64 virtual_nanos_skipped = 0;
+
+Int64 VirtualNanosSkipped() {
+  return __atomic_load_n(&virtual_nanos_skipped, __ATOMIC_RELAXED);
+}
+
+} // namespace internal
+
+/************************************************
+ * VirtualClock
+ * member function implentation
+ ************************************************/
+
+VirtualClock::VirtualClock()
+    : now_(0), epoch_(0), blocked_(0) {}
+
+VirtualClock::time_point VirtualClock::now() const {
+  internal::MutexLock lock(&mutex_);
+  return time_point(duration(now_));
+}
+
+void VirtualClock::sleep_until(time_point deadline) {
+  const internal::Int64 when = deadline.time_since_epoch().count();
+  internal::MutexLock lock(&mutex_);
+  AddWaiter(when);
+  while (now_ < when)
+    BlockUntilWoken(when);
+  RemoveWaiter(when);
+}
+
+bool VirtualClock::wait_until(time_point deadline,
+                              const std::function<bool()>& ready) {
+  const internal::Int64 when = deadline.time_since_epoch().count();
+  {
+    internal::MutexLock lock(&mutex_);
+    AddWaiter(when);
+  }
+
+  bool satisfied;
+  for (;;) {
+    internal::Int64 epoch;
+    bool due;
+    {
+      internal::MutexLock lock(&mutex_);
+      due = now_ >= when;
+      epoch = epoch_;
+    }
+
+    // Without the lock, so ready() can take the caller's own, which the
+    // caller may hold when it calls notify_all.
+    satisfied = ready();
+    if (satisfied || due)
+      break;
+
+    internal::MutexLock lock(&mutex_);
+    // Otherwise a notify_all or a jump came in while ready() ran.
+    if (epoch_ == epoch)
+      BlockUntilWoken(when);
+  }
+
+  internal::MutexLock lock(&mutex_);
+  RemoveWaiter(when);
+  return satisfied;
+}
+
+void VirtualClock::notify_all() {
+  internal::MutexLock lock(&mutex_);
+  WakeAll();
+}
+
+void VirtualClock::advance(duration d) {
+  if (d <= duration::zero())
+    return;
+  internal::MutexLock lock(&mutex_);
+  now_ += d.count();
+  __atomic_fetch_add(&internal::virtual_nanos_skipped, d.count(),
+                     __ATOMIC_RELAXED);
+  WakeAll();
+}
+
+void VirtualClock::AddParticipant() {
+  internal::MutexLock lock(&mutex_);
+  GTEST_CHECK_(participants_.insert(std::this_thread::get_id()).second)
+      << "The thread is a participant already.";
+}
+
+void VirtualClock::RemoveParticipant() {
+  internal::MutexLock lock(&mutex_);
+  GTEST_CHECK_(participants_.erase(std::this_thread::get_id()) == 1)
+      << "The thread isn't a participant.";
+  // The others may all be waiting on the one that left.
+  AdvanceIfAllBlocked();
+}
+
+void VirtualClock::BlockUntilWoken(internal::Int64 deadline) {
+  const internal::Int64 epoch = epoch_;
+  if (IsParticipant()) {
+    ++blocked_;
+    if (deadline != internal::kNoDeadline)
+      deadlines_.insert(deadline);
+    AdvanceIfAllBlocked();
+  } else if (!participants_.empty()) {
+    // Anyone else waits for the participants to move time, but may find
+    // them all blocked already.  Its deadline is in waiter_deadlines_.
+    AdvanceIfAllBlocked();
+  }
+  while (epoch_ == epoch)
+    changed_.Wait(&mutex_);
+}
+
+void VirtualClock::AdvanceIfAllBlocked() {
+  if (blocked_ < participants_.size())
+    return;
+
+  // Woken participants leave the count until they block again, so one
+  // that's due but hasn't run yet can't be jumped past.  Other waiters
+  // keep their deadlines until they return, and those already due are
+  // skipped.
+  internal::Int64 next = deadlines_.empty() ? internal::kNoDeadline :
+      *deadlines_.begin();
+  const std::multiset<internal::Int64>::const_iterator waiter =
+      waiter_deadlines_.upper_bound(now_);
+  if (waiter != waiter_deadlines_.end() && *waiter < next)
+    next = *waiter;
+  if (next == internal::kNoDeadline)
+    return;
+
+  if (next > now_) {
+    __atomic_fetch_add(&internal::virtual_nanos_skipped, next - now_,
+                       __ATOMIC_RELAXED);
+    now_ = next;
+  }
+  WakeAll();
+}
+
+bool VirtualClock::IsParticipant() const {
+  return participants_.count(std::this_thread::get_id()) != 0;
+}
+
+void VirtualClock::AddWaiter(internal::Int64 deadline) {
+  if (deadline != internal::kNoDeadline && !IsParticipant())
+    waiter_deadlines_.insert(deadline);
+}
+
+void VirtualClock::RemoveWaiter(internal::Int64 deadline) {
+  if (deadline != internal::kNoDeadline && !IsParticipant())
+    waiter_deadlines_.erase(waiter_deadlines_.find(deadline));
+}
+
+void VirtualClock::WakeAll() {
+  ++epoch_;
+  blocked_ = 0;
+  deadlines_.clear();
+  changed_.Broadcast();
+}
+
+/************************************************
+ * end of VirtualClock
+ ************************************************/
+
+} // namespace testing
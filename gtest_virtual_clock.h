@@ -0,0 +1,125 @@
+#ifndef GTEST_VIRTUAL_CLOCK_H_
+#define GTEST_VIRTUAL_CLOCK_H_
+
+#include <chrono>
+#include <functional>
+#include <set>
+#include <thread>
+
+#include "gtest.h"
+#include "gtest_port.h"
+
+namespace testing {
+namespace internal {
+
+// The virtual time every VirtualClock in the process has skipped so far, in
+// nanoseconds.  A test's share of it is recorded as its "virtual_time_ms"
+// property, next to the real time it took.
+GTEST_API_ Int64 VirtualNanosSkipped();
+
+} // namespace internal
+
+/************************************************
+ * VirtualClock
+ ************************************************/
+// A clock for code that waits on timeouts and backoffs, so its tests don't
+// really sleep.  The code under test takes the clock in place of
+// std::chrono::steady_clock and std::this_thread, and calls the same
+// sleep_for, sleep_until and now on it.  A condition variable wait with a
+// timeout becomes wait_for with the predicate, and the notify that goes
+// with it becomes notify_all on the clock.
+//
+// Time stands still while any participant runs, and jumps to the earliest
+// deadline once every participant is blocked in the clock or has left.  A
+// thread is a participant from its call to AddParticipant until its call
+// to RemoveParticipant, and makes both itself.  Other threads, such as a
+// test thread checking on the participants, never move time while a
+// participant runs: their sleeps and waits end when a jump or advance
+// brings them due.  So a thread that isn't a participant needs one that's
+// live, or a call to advance, to wake it, and with none left it sleeps
+// until the test's timeout; a thread that sleeps on its own must be a
+// participant.  A thread that starts
+// participants can stay one, waiting outside the clock, until they've all
+// called AddParticipant, so time can't jump before they run.  Participants
+// that all wait without a deadline wait for good, as they would on a real
+// clock, until the test's timeout.
+class GTEST_API_ VirtualClock {
+ public:
+  typedef std::chrono::nanoseconds duration;
+  typedef duration::rep rep;
+  typedef duration::period period;
+  typedef std::chrono::time_point<VirtualClock, duration> time_point;
+  static const bool is_steady = true;
+
+  // Starts at the epoch.
+  VirtualClock();
+
+  time_point now() const;
+
+  void sleep_for(duration d) { sleep_until(now() + d); }
+  void sleep_until(time_point deadline);
+
+  // Block until ready() returns true or the deadline passes, and return
+  // ready()'s last answer.  ready() is called without the clock's lock
+  // held, again after every notify_all and every jump in time, and must
+  // guard the state it reads itself.
+  bool wait_until(time_point deadline, const std::function<bool()>& ready);
+  bool wait_for(duration timeout, const std::function<bool()>& ready) {
+    return wait_until(now() + timeout, ready);
+  }
+  void wait(const std::function<bool()>& ready) {
+    wait_until(time_point::max(), ready);
+  }
+
+  // Wakes every waiter to call its ready() again.
+  void notify_all();
+
+  // Moves time forward by d, as if it had been slept, and wakes every
+  // sleeper and waiter it brings due.
+  void advance(duration d);
+
+  // Make the calling thread a participant, or no longer one.
+  void AddParticipant();
+  void RemoveParticipant();
+
+ private:
+  // Blocks until everyone is woken, counted as blocked with deadline if
+  // the calling thread is a participant.  Called with mutex_ held.
+  void BlockUntilWoken(internal::Int64 deadline);
+
+  // Jumps to the earliest deadline if every participant is blocked.  Called
+  // with mutex_ held when a thread blocks while there are participants, or
+  // when a participant leaves.
+  void AdvanceIfAllBlocked();
+
+  // Called with mutex_ held, like the rest below.
+  bool IsParticipant() const;
+
+  // Keep the deadline of a thread that isn't a participant from when it
+  // starts to wait in the clock until it stops, so no jump passes it
+  // while the thread is awake between two blocks.
+  void AddWaiter(internal::Int64 deadline);
+  void RemoveWaiter(internal::Int64 deadline);
+
+  // Wakes every blocked thread, which no longer counts as blocked.
+  void WakeAll();
+
+  mutable internal::Mutex mutex_;
+  internal::ConditionVariable changed_;
+  internal::Int64 now_;
+  // Bumped by every WakeAll.
+  internal::Int64 epoch_;
+  std::set<std::thread::id> participants_;
+  // The participants blocked since the last WakeAll, and the deadlines of
+  // those that have one.
+  size_t blocked_;
+  std::multiset<internal::Int64> deadlines_;
+  // The deadlines of the other threads in the clock.
+  std::multiset<internal::Int64> waiter_deadlines_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(VirtualClock);
+};
+
+} // namespace testing
+
+#endif
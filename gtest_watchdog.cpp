@@ -0,0 +1,257 @@
+#include <cxxabi.h>
+#include <dirent.h>
+#include <errno.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <vector>
+
+#include "gtest_internal_impl.h"
+#include "gtest_watchdog.h"
+
+namespace testing {
+namespace internal {
+
+GTEST_DEFINE_int32_(
+    test_timeout,
+    internal::Int32FromGTestEnv("test_timeout", 0),
+    "The number of milliseconds a test may run before it fails and the run "
+    "ends, or 0 for no limit.  TEST_WITH_TIMEOUT overrides it.");
+
+// SIGURG is ignored by default, so a stray one harms nothing.
+static const int kStackSignal = SIGURG;
+static const int kMaxStackThreads = 256;
+static const int kMaxStackFrames = 64;
+// The collecting handler's frame and the kernel's signal trampoline.
+static const int kHandlerFrames = 2;
+static const long kStackWaitMillis = 1000;
+
+struct ThreadStack {
+  int thread_id;  // Written last; 0 until the stack is complete.
+  int depth;
+  void* frames[kMaxStackFrames];
+};
+
+static ThreadStack thread_stacks[kMaxStackThreads];
+static int thread_stacks_taken = 0;
+
+static int GetThreadId() {
+  return static_cast<int>(syscall(SYS_gettid));
+}
+
+static void CollectStack(int /*signal*/) {
+  const int saved_errno = errno;
+  const int slot =
+      __atomic_fetch_add(&thread_stacks_taken, 1, __ATOMIC_RELAXED);
+  if (slot < kMaxStackThreads) {
+    ThreadStack& stack = thread_stacks[slot];
+    stack.depth = backtrace(stack.frames, kMaxStackFrames);
+    __atomic_store_n(&stack.thread_id, GetThreadId(), __ATOMIC_RELEASE);
+  }
+  errno = saved_errno;
+}
+
+static int CountCollectedStacks() {
+  int count = 0;
+  for (int i = 0; i < kMaxStackThreads; ++i) {
+    if (__atomic_load_n(&thread_stacks[i].thread_id, __ATOMIC_ACQUIRE) != 0)
+      ++count;
+  }
+  return count;
+}
+
+// Turns "binary(mangled+0x1f) [0x...]" into "name+0x1f (binary)".
+static std::string FormatFrame(const char* symbol) {
+  const std::string text = symbol;
+  const size_t open = text.find('(');
+  const size_t plus = text.find('+', open);
+  const size_t close = text.find(')', open);
+  if (open == std::string::npos || plus == std::string::npos ||
+      close == std::string::npos || plus > close || plus == open + 1)
+    return text;
+
+  const std::string mangled = text.substr(open + 1, plus - open - 1);
+  int status = 0;
+  char* const demangled =
+      abi::__cxa_demangle(mangled.c_str(), NULL, NULL, &status);
+  const std::string name = status == 0 ? demangled : mangled;
+  free(demangled);
+  return name + text.substr(plus, close - plus) + " (" +
+      text.substr(0, open) + ")";
+}
+
+static std::string ThreadName(int thread_id) {
+  std::ifstream input(("/proc/self/task/" + StreamableToString(thread_id) +
+                       "/comm").c_str());
+  std::string name;
+  std::getline(input, name);
+  return name;
+}
+
+std::string FormatStack(void* const* frames, int depth) {
+  std::string text;
+  char** const symbols = backtrace_symbols(frames, depth);
+  for (int i = 0; i < depth; ++i) {
+    text += "  #" + StreamableToString(i) + " " +
+        (symbols == NULL ? "?" : FormatFrame(symbols[i])) + "\n";
+  }
+  free(symbols);
+  return text;
+}
+
+std::string DumpAllThreadStacks(int test_thread_id) {
+  // The first backtrace() loads the unwinder, which mustn't happen inside
+  // the handler.
+  void* frame;
+  backtrace(&frame, 1);
+  memset(thread_stacks, 0, sizeof(thread_stacks));
+  __atomic_store_n(&thread_stacks_taken, 0, __ATOMIC_RELAXED);
+
+  struct sigaction action;
+  struct sigaction old_action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = &CollectStack;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  sigaction(kStackSignal, &action, &old_action);
+
+  std::vector<int> thread_ids;
+  int signaled = 0;
+  const int self = GetThreadId();
+  DIR* const tasks = opendir("/proc/self/task");
+  if (tasks != NULL) {
+    while (const struct dirent* entry = readdir(tasks)) {
+      const int thread_id = atoi(entry->d_name);
+      if (thread_id <= 0 || thread_id == self)
+        continue;
+      thread_ids.push_back(thread_id);
+      if (syscall(SYS_tgkill, getpid(), thread_id, kStackSignal) == 0)
+        ++signaled;
+    }
+    closedir(tasks);
+  }
+
+  const Int64 deadline = GetTimeInNanos() + kStackWaitMillis * 1000000;
+  const struct timespec pause = { 0, 1000000 };
+  while (CountCollectedStacks() < signaled && GetTimeInNanos() < deadline)
+    nanosleep(&pause, NULL);
+  sigaction(kStackSignal, &old_action, NULL);
+
+  std::string dump;
+  for (size_t i = 0; i < thread_ids.size(); ++i) {
+    const int thread_id = thread_ids[i];
+    dump += "Thread " + StreamableToString(thread_id) + " (" +
+        ThreadName(thread_id) + ")";
+    if (thread_id == test_thread_id)
+      dump += ", running the test";
+    dump += ":\n";
+
+    const ThreadStack* stack = NULL;
+    for (int j = 0; j < kMaxStackThreads && stack == NULL; ++j) {
+      if (__atomic_load_n(&thread_stacks[j].thread_id, __ATOMIC_ACQUIRE) ==
+          thread_id)
+        stack = &thread_stacks[j];
+    }
+    if (stack == NULL || stack->depth <= kHandlerFrames) {
+      dump += "  (no stack; the thread didn't answer)\n";
+      continue;
+    }
+
+    dump += FormatStack(stack->frames + kHandlerFrames,
+                        stack->depth - kHandlerFrames);
+  }
+  return dump;
+}
+
+/**** TestWatchdog member function implentation ****/
+
+TestWatchdog::TestWatchdog()
+    : test_info_(NULL),
+      timeout_ms_(0),
+      start_nanos_(0),
+      test_thread_id_(0),
+      firing_(false),
+      stopping_(false) {
+  thread_.reset(new ThreadWithParam<TestWatchdog*>(&ThreadMain, this));
+}
+
+TestWatchdog::~TestWatchdog() {
+  {
+    MutexLock lock(&mutex_);
+    stopping_ = true;
+    armed_.Signal();
+  }
+  thread_->Join();
+}
+
+void TestWatchdog::Arm(TestInfo* test_info, int timeout_ms) {
+  MutexLock lock(&mutex_);
+  test_info_ = test_info;
+  timeout_ms_ = timeout_ms;
+  start_nanos_ = GetTimeInNanos();
+  test_thread_id_ = GetThreadId();
+  armed_.Signal();
+}
+
+void TestWatchdog::Disarm() {
+  MutexLock lock(&mutex_);
+  // Once firing, the watchdog ends the process.
+  while (firing_)
+    armed_.Wait(&mutex_);
+  test_info_ = NULL;
+}
+
+void TestWatchdog::ThreadMain(TestWatchdog* watchdog) {
+  TestInfo* test_info;
+  int timeout_ms;
+  Int64 start_nanos;
+  int test_thread_id;
+  {
+    MutexLock lock(&watchdog->mutex_);
+    for (;;) {
+      if (watchdog->stopping_)
+        return;
+      if (watchdog->test_info_ == NULL) {
+        watchdog->armed_.Wait(&watchdog->mutex_);
+        continue;
+      }
+      const Int64 remaining = watchdog->start_nanos_ +
+          watchdog->timeout_ms_ * static_cast<Int64>(1000000) -
+          GetTimeInNanos();
+      if (remaining <= 0)
+        break;
+      watchdog->armed_.WaitFor(&watchdog->mutex_,
+                               static_cast<long>(remaining / 1000000) + 1);
+    }
+    watchdog->firing_ = true;
+    test_info = watchdog->test_info_;
+    timeout_ms = watchdog->timeout_ms_;
+    start_nanos = watchdog->start_nanos_;
+    test_thread_id = watchdog->test_thread_id_;
+  }
+  watchdog->Fire(test_info, timeout_ms, start_nanos, test_thread_id);
+}
+
+void TestWatchdog::Fire(TestInfo* test_info, int timeout_ms,
+                        Int64 start_nanos, int test_thread_id) {
+  const std::string message = "The test timed out after " +
+      StreamableToString(timeout_ms) + " ms.  The stacks of all threads:\n" +
+      DumpAllThreadStacks(test_thread_id);
+  UnitTestImpl* const impl = GetUnitTestImpl();
+  impl->GetGlobalTestPartResultReporter()->ReportTestPartResult(
+      TestPartResult(TestPartResult::kFatalFailure, test_info->file(),
+                     test_info->line(), message.c_str()));
+  impl->EndHungRun(test_info, (GetTimeInNanos() - start_nanos) / 1000000);
+}
+
+/************************************************
+ * end of TestWatchdog
+ ************************************************/
+
+} // namespace internal
+} // namespace testing
@@ -0,0 +1,68 @@
+#ifndef GTEST_WATCHDOG_H_
+#define GTEST_WATCHDOG_H_
+
+#include <string>
+
+#include "gtest.h"
+#include "gtest_port.h"
+
+namespace testing {
+namespace internal {
+
+GTEST_DECLARE_int32_(test_timeout);
+
+// Symbolizes the return addresses from backtrace(), one frame per line.
+GTEST_API_ std::string FormatStack(void* const* frames, int depth);
+
+// Returns a backtrace of every thread in the process but the caller's,
+// symbolized and one frame per line.  The thread with the given id is
+// marked as running the test.  Threads that block the collecting signal
+// or don't answer within a second are listed without frames.
+GTEST_API_ std::string DumpAllThreadStacks(int test_thread_id);
+
+/************************************************
+ * TestWatchdog
+ ************************************************/
+// Watches the running test from a thread of its own.  A test that runs
+// past its timeout gets a fatal failure holding every thread's stack, and
+// the run is then ended through UnitTestImpl::EndHungRun, since the test's
+// thread can't be got back.
+class GTEST_API_ TestWatchdog {
+ public:
+  TestWatchdog();
+  ~TestWatchdog();
+
+  // Starts timing test_info, which must time out after timeout_ms.
+  void Arm(TestInfo* test_info, int timeout_ms);
+
+  // Stops timing the test.  Never returns if it has timed out already.
+  void Disarm();
+
+ private:
+  static void ThreadMain(TestWatchdog* watchdog);
+
+  // Reports the timed-out test and ends the run.
+  void Fire(TestInfo* test_info, int timeout_ms, Int64 start_nanos,
+            int test_thread_id);
+
+  Mutex mutex_;
+  ConditionVariable armed_;
+  TestInfo* test_info_;
+  int timeout_ms_;
+  Int64 start_nanos_;
+  int test_thread_id_;
+  bool firing_;
+  bool stopping_;
+  scoped_ptr<ThreadWithParam<TestWatchdog*> > thread_;
+
+  GTEST_DISALLOW_COPY_AND_ASSIGN_(TestWatchdog);
+};
+
+/************************************************
+ * end of TestWatchdog
+ ************************************************/
+
+} // namespace internal
+} // namespace testing
+
+#endif
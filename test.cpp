@@ -1,6 +1,23 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+
 #include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "gtest.h"
+#include "gtest_benchmark.h"
+#include "gtest_interleave.h"
+#include "gtest_internal_impl.h"
+#include "gtest_output.h"
+#include "gtest_stats.h"
+#include "gtest_stress.h"
+#include "gtest_virtual_clock.h"
 
 TEST(MyTest, first) {
   // std::cout << "MyTest: first test" << std::endl;
@@ -17,6 +34,8 @@ TEST(Hello, first) {
 
 TEST(Hello, second) {
   // std::cout << "Hello: second test" << std::endl;
+  RecordProperty("greeting", "hello, \"world\"");
+  RecordProperty("answer", 42);
 }
 
 class World : public testing::Test {
@@ -31,3 +50,828 @@ TEST_F(World, second) {
   // std::cout << "World: second test" << std::endl;
   EXPECT_EQ(1, 2);
 }
+
+static testing::internal::Mutex counter_mutex;
+static long long counter = 0;
+
+BENCHMARK_WITH(Counter, LockedIncrement,
+               testing::BenchmarkOptions().Threads(4).MinTimeMillis(20)) {
+  while (state.KeepRunning()) {
+    testing::internal::MutexLock lock(&counter_mutex);
+    ++counter;
+  }
+}
+
+BENCHMARK_WITH(Counter, IncrementLatency,
+               testing::BenchmarkOptions().Latency().MinTimeMillis(20)) {
+  while (state.KeepRunning()) {
+    testing::internal::MutexLock lock(&counter_mutex);
+    ++counter;
+  }
+}
+
+TEST(Counter, IncrementTailLatency) {
+  testing::LatencyHistogram histogram = testing::MeasureLatency(10000, [] {
+    testing::internal::MutexLock lock(&counter_mutex);
+    ++counter;
+  });
+  EXPECT_P99_LT(histogram, std::chrono::milliseconds(1));
+}
+
+// Every thread adds one each round, and AfterRound checks none was lost.
+class LockedCounter : public testing::StressTest {
+ protected:
+  LockedCounter() : count_(0), rounds_(0) {}
+
+  virtual void AfterRound() {
+    ++rounds_;
+    EXPECT_EQ(rounds_ * stress_threads(), count_);
+  }
+
+  testing::internal::Mutex mutex_;
+  int count_;
+  int rounds_;
+};
+
+TEST_F_STRESS(LockedCounter, LosesNoIncrement, 4) {
+  testing::internal::MutexLock lock(&mutex_);
+  ++count_;
+}
+
+static int Seconds(const testing::VirtualClock& clock) {
+  return static_cast<int>(std::chrono::duration_cast<std::chrono::seconds>(
+      clock.now().time_since_epoch()).count());
+}
+
+TEST(VirtualClock, ParticipantSleepsWithoutWaiting) {
+  testing::VirtualClock clock;
+  clock.AddParticipant();
+  const std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  clock.sleep_for(std::chrono::hours(1));
+  EXPECT_EQ(false, clock.wait_for(std::chrono::hours(1), [] { return false; }));
+  const std::chrono::steady_clock::duration took =
+      std::chrono::steady_clock::now() - start;
+  clock.RemoveParticipant();
+  EXPECT_EQ(2 * 3600, Seconds(clock));
+  EXPECT_EQ(true, took < std::chrono::seconds(1));
+}
+
+TEST(VirtualClock, NonParticipantWaitsForParticipants) {
+  testing::VirtualClock clock;
+  std::vector<int> woke_at;
+  bool test_woke = false;
+  std::thread worker([&clock, &woke_at, &test_woke] {
+    clock.AddParticipant();
+    for (int i = 0; i < 3; ++i) {
+      clock.sleep_for(std::chrono::seconds(1));
+      woke_at.push_back(Seconds(clock));
+    }
+    // Stays live until the test thread has woken, which it needs to.
+    clock.wait([&test_woke] {
+      return __atomic_load_n(&test_woke, __ATOMIC_SEQ_CST);
+    });
+    clock.RemoveParticipant();
+  });
+  // The test thread's own sleep doesn't move time while the worker runs,
+  // so the worker's sleeps all end first, whenever it starts.
+  clock.sleep_until(
+      testing::VirtualClock::time_point(std::chrono::seconds(10)));
+  EXPECT_EQ(10, Seconds(clock));
+  EXPECT_EQ(3, static_cast<int>(woke_at.size()));
+  __atomic_store_n(&test_woke, true, __ATOMIC_SEQ_CST);
+  clock.notify_all();
+  worker.join();
+  if (woke_at.size() == 3) {
+    EXPECT_EQ(1, woke_at[0]);
+    EXPECT_EQ(2, woke_at[1]);
+    EXPECT_EQ(3, woke_at[2]);
+  }
+}
+
+TEST(VirtualClock, JumpsOnceEveryParticipantBlocks) {
+  testing::VirtualClock clock;
+  testing::internal::Mutex mutex;
+  std::string events;
+  int registered = 0;
+  const std::function<void(const char*, int, int)> sleeper =
+      [&](const char* name, int seconds, int times) {
+    clock.AddParticipant();
+    __atomic_fetch_add(&registered, 1, __ATOMIC_SEQ_CST);
+    for (int i = 0; i < times; ++i) {
+      clock.sleep_for(std::chrono::seconds(seconds));
+      testing::internal::MutexLock lock(&mutex);
+      events += std::string(name) + "@" + std::to_string(Seconds(clock)) + " ";
+    }
+    clock.RemoveParticipant();
+  };
+
+  // The test thread holds time still until both have registered.
+  clock.AddParticipant();
+  std::thread a(sleeper, "a", 3, 1);
+  std::thread b(sleeper, "b", 2, 2);
+  while (__atomic_load_n(&registered, __ATOMIC_SEQ_CST) < 2)
+    sched_yield();
+  clock.RemoveParticipant();
+  a.join();
+  b.join();
+  EXPECT_EQ("b@2 a@3 b@4 ", events);
+}
+
+// The tests below run this program's Child tests again in a child process,
+// with the flags they check, and look at what it printed.  MYGTEST_CHILD
+// names what the Child tests at the end of the file do there; they pass
+// trivially otherwise.
+static const char* ChildMode() {
+  const char* const mode = getenv("MYGTEST_CHILD");
+  return mode != NULL ? mode : "";
+}
+
+static bool InChild() { return ChildMode()[0] != '\0'; }
+
+static std::string ProgramPath() {
+  char path[4096];
+  const ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+  if (length <= 0)
+    return "";
+  path[length] = '\0';
+  return path;
+}
+
+// Runs command in the shell and returns what it printed on either stream.
+static std::string OutputOf(const std::string& command) {
+  FILE* const child = popen((command + " 2>&1").c_str(), "r");
+  if (child == NULL)
+    return "";
+  std::string output;
+  char buffer[4096];
+  size_t size;
+  while ((size = fread(buffer, 1, sizeof(buffer), child)) > 0)
+    output.append(buffer, size);
+  pclose(child);
+  return output;
+}
+
+// Killed after a minute, so a child that hangs fails the test instead.
+// A --gtest_filter in flags overrides the Child one.
+static std::string ChildCommand(const char* mode, const std::string& flags) {
+  return std::string("MYGTEST_CHILD=") + mode + " timeout -s KILL 60 " +
+      ProgramPath() + " --gtest_filter=Child.* " + flags;
+}
+
+static std::string RunChild(const char* mode, const char* flags) {
+  return OutputOf(ChildCommand(mode, flags));
+}
+
+// The command line of one of the tools built next to this program.
+static std::string ToolCommand(const char* tool, const std::string& args) {
+  const std::string program = ProgramPath();
+  return "timeout -s KILL 60 " + program.substr(0, program.rfind('/') + 1) +
+      "tools/" + tool + " " + args;
+}
+
+static std::string RunTool(const char* tool, const std::string& args) {
+  return OutputOf(ToolCommand(tool, args));
+}
+
+static int CountOf(const std::string& text, const char* what) {
+  int count = 0;
+  for (size_t pos = text.find(what); pos != std::string::npos;
+       pos = text.find(what, pos + 1)) {
+    ++count;
+  }
+  return count;
+}
+
+// Returns the lines of text that contain what, in order.
+static std::string LinesWith(const std::string& text, const char* what) {
+  std::string lines;
+  for (size_t pos = text.find(what); pos != std::string::npos;
+       pos = text.find(what, pos + 1)) {
+    const size_t start = text.rfind('\n', pos) + 1;
+    lines += text.substr(start, text.find('\n', pos) - start + 1);
+  }
+  return lines;
+}
+
+// A fresh file for a child's report, removed at the end of the test.
+class ScratchFile {
+ public:
+  ScratchFile() {
+    char path[] = "/tmp/mygtest_test_XXXXXX";
+    const int fd = mkstemp(path);
+    if (fd >= 0)
+      close(fd);
+    path_ = path;
+  }
+
+  ~ScratchFile() { unlink(path_.c_str()); }
+
+  const std::string& path() const { return path_; }
+
+  std::string Read() const {
+    std::string contents;
+    FILE* const file = fopen(path_.c_str(), "rb");
+    if (file == NULL)
+      return contents;
+    char buffer[4096];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+      contents.append(buffer, size);
+    fclose(file);
+    return contents;
+  }
+
+ private:
+  std::string path_;
+};
+
+// Returns true if xml has one root element and every element is closed,
+// in order.  Parses as much XML as the reports use: the declaration,
+// quoted attributes and CDATA sections.
+static bool IsWellFormedXml(const std::string& xml) {
+  std::vector<std::string> open;
+  int roots = 0;
+  size_t pos = 0;
+  while ((pos = xml.find('<', pos)) != std::string::npos) {
+    if (xml.compare(pos, 9, "<![CDATA[") == 0) {
+      pos = xml.find("]]>", pos);
+      if (pos == std::string::npos || open.empty())
+        return false;
+      pos += 3;
+      continue;
+    }
+    if (xml.compare(pos, 2, "<?") == 0) {
+      pos = xml.find("?>", pos);
+      if (pos == std::string::npos)
+        return false;
+      pos += 2;
+      continue;
+    }
+
+    size_t end = pos + 1;
+    char quote = '\0';
+    for (; end < xml.size(); ++end) {
+      if (quote != '\0') {
+        if (xml[end] == quote)
+          quote = '\0';
+      } else if (xml[end] == '"' || xml[end] == '\'') {
+        quote = xml[end];
+      } else if (xml[end] == '<') {
+        return false;
+      } else if (xml[end] == '>') {
+        break;
+      }
+    }
+    if (end >= xml.size())
+      return false;
+    const std::string tag = xml.substr(pos + 1, end - pos - 1);
+    pos = end + 1;
+
+    if (!tag.empty() && tag[0] == '/') {
+      if (open.empty() || open.back() != tag.substr(1))
+        return false;
+      open.pop_back();
+      continue;
+    }
+    const std::string name = tag.substr(0, tag.find_first_of(" \t\n/"));
+    if (name.empty() || (open.empty() && ++roots > 1))
+      return false;
+    if (tag[tag.size() - 1] != '/')
+      open.push_back(name);
+  }
+  return roots == 1 && open.empty();
+}
+
+TEST(AsyncListeners, DeliverEveryEvent) {
+  const std::string sync = RunChild("run", "");
+  const std::string async = RunChild("run", "--gtest_async_listeners");
+  EXPECT_EQ(CountOf(sync, "[ RUN      ]"), CountOf(async, "[ RUN      ]"));
+  EXPECT_EQ(CountOf(sync, "[       OK ]"), CountOf(async, "[       OK ]"));
+  EXPECT_EQ(CountOf(sync, "[  FAILED  ]"), CountOf(async, "[  FAILED  ]"));
+}
+
+TEST(AsyncListeners, DeliverQueuedEventsOnCrash) {
+  const std::string sync = RunChild("crash", "");
+  const std::string async = RunChild("crash", "--gtest_async_listeners");
+  EXPECT_EQ(1, CountOf(sync, "Child.Crashes"));
+  EXPECT_EQ(CountOf(sync, "[ RUN      ]"), CountOf(async, "[ RUN      ]"));
+}
+
+TEST(AsyncListeners, DeliverEventsOfHungRun) {
+  const std::string async = RunChild("hang", "--gtest_async_listeners");
+  EXPECT_EQ(1, CountOf(async, "The test timed out after"));
+  EXPECT_EQ(1, CountOf(async, "[  FAILED  ] \033[mChild.Hangs"));
+}
+
+TEST(TestTimeout, WorkerCarriesOnAfterHungTest) {
+  const std::string output = RunChild("hang", "--gtest_isolation=worker");
+  EXPECT_EQ(1, CountOf(output, "The test timed out after 200 ms."));
+  // The run goes on to the tests after it and to the summary, which lists
+  // the hung test again.
+  EXPECT_EQ(1, CountOf(output, "[       OK ] \033[mChild.Crashes"));
+  EXPECT_EQ(1, CountOf(output, "test case ran."));
+  EXPECT_EQ(2, CountOf(output, "[  FAILED  ] \033[mChild.Hangs"));
+}
+
+TEST(Isolation, WorkerKeepsTestOutput) {
+  // Through a pipe, so stdout is fully buffered in the worker.
+  const std::string output = RunChild("run", "--gtest_isolation=worker");
+  EXPECT_EQ(1, CountOf(output, "printed by Child.Prints"));
+}
+
+TEST(Isolation, ForkKeepsTestOutput) {
+  // Each worker runs one test and exits, so every test's output has to
+  // be flushed before its worker's _exit.
+  const std::string output = RunChild("run", "--gtest_isolation=fork");
+  EXPECT_EQ(1, CountOf(output, "printed by Child.Prints"));
+}
+
+TEST_INTERLEAVE(Interleave, MutexGuardsIncrement) {
+  testing::InterleavedMutex mutex;
+  testing::InterleavedAtomic<int> count(0);
+  for (int i = 0; i < 2; ++i) {
+    Spawn([&mutex, &count] {
+      testing::InterleavedMutexLock lock(&mutex);
+      count.store(count.load() + 1);
+    });
+  }
+  Join();
+  EXPECT_EQ(2, count.load());
+}
+
+TEST_INTERLEAVE(Interleave, ConditionVariableHandsOff) {
+  testing::InterleavedMutex mutex;
+  testing::InterleavedConditionVariable ready;
+  bool handed_off = false;
+  bool received = false;
+  Spawn([&] {
+    testing::InterleavedMutexLock lock(&mutex);
+    while (!handed_off)
+      ready.Wait(&mutex);
+    received = true;
+  });
+  Spawn([&] {
+    testing::InterleavedMutexLock lock(&mutex);
+    handed_off = true;
+    ready.Signal();
+  });
+  Join();
+  EXPECT_EQ(true, received);
+}
+
+TEST(Interleave, FindsAndReplaysLostUpdate) {
+  const char* const strategies[] = {
+    "--gtest_interleave_strategy=pct", "--gtest_interleave_strategy=dfs"
+  };
+  for (int i = 0; i < 2; ++i) {
+    const std::string output = RunChild("race", strategies[i]);
+    EXPECT_EQ(1, CountOf(output, "Interleaving schedule"));
+    EXPECT_EQ(2, CountOf(output, "[  FAILED  ] \033[mChild.LosesUpdate"));
+
+    // The schedule that lost the update loses it again on its own.
+    const size_t start = output.find("--gtest_interleave_replay=");
+    EXPECT_NE(std::string::npos, start);
+    if (start == std::string::npos)
+      continue;
+    const std::string replay =
+        output.substr(start, output.find_first_of(" \n", start) - start);
+    const std::string replayed = RunChild("race", replay.c_str());
+    EXPECT_EQ(1, CountOf(replayed, "Interleaving schedule"));
+    EXPECT_EQ(0, CountOf(replayed, "can't run"));
+    EXPECT_EQ(2, CountOf(replayed, "[  FAILED  ] \033[mChild.LosesUpdate"));
+  }
+}
+
+TEST(CaptureOutput, KeepsOnlyFailedTestsOutput) {
+  EXPECT_EQ(1, CountOf(RunChild("run", ""), "printed by Child.Prints"));
+  EXPECT_EQ(0, CountOf(RunChild("run", "--gtest_capture_output"),
+                       "printed by Child.Prints"));
+  EXPECT_EQ(1, CountOf(RunChild("fail", "--gtest_capture_output"),
+                       "printed by Child.Prints\n<b>"));
+
+  // The limit keeps the end of the output, "\n<b>\0</b>\n".
+  const std::string limited = RunChild("fail",
+      "--gtest_capture_output --gtest_capture_limit=10");
+  EXPECT_EQ(0, CountOf(limited, "printed by Child.Prints"));
+  EXPECT_EQ(1, CountOf(limited, "[... 23 bytes of output omitted ...]"));
+  EXPECT_EQ(1, CountOf(limited, "</b>\n"));
+}
+
+TEST(Listeners, GetOnlyTheEventsTheyHandle) {
+  const std::string output = RunChild("listen", "");
+  EXPECT_EQ(4, CountOf(output, "selective got OnTestStart\n"));
+  EXPECT_EQ(4, CountOf(output, "selective got OnTestEnd\n"));
+  EXPECT_EQ(8, CountOf(output, "selective got "));
+  EXPECT_EQ(1, CountOf(output, "masked got OnTestProgramEnd\n"));
+  EXPECT_EQ(1, CountOf(output, "masked got "));
+}
+
+TEST(TestCaseSetUp, RunsOnceAroundTheTests) {
+  // Each test sees what SetUpTestCase and the tests before it left.
+  const std::string plain = RunChild("fixture",
+      "--gtest_filter=ChildFixture.*");
+  EXPECT_EQ("fixture: environment SetUp\n"
+            "fixture: SetUpTestCase\n"
+            "fixture: first saw 1\n"
+            "fixture: second saw 2\n"
+            "fixture: TearDownTestCase\n"
+            "fixture: environment TearDown\n",
+            LinesWith(plain, "fixture: "));
+
+  // Forked, each test starts from what SetUpTestCase left.
+  const std::string forked = RunChild("fixture",
+      "--gtest_filter=ChildFixture.* --gtest_isolation=fork");
+  EXPECT_EQ("fixture: environment SetUp\n"
+            "fixture: SetUpTestCase\n"
+            "fixture: first saw 1\n"
+            "fixture: second saw 1\n"
+            "fixture: TearDownTestCase\n"
+            "fixture: environment TearDown\n",
+            LinesWith(forked, "fixture: "));
+}
+
+TEST(Environment, SetsUpOnceForEveryIterationAndProcess) {
+  const std::string output = RunChild("fixture",
+      "--gtest_filter=ChildFixture.* --gtest_isolation=fork --gtest_repeat=2");
+  EXPECT_EQ("fixture: environment SetUp\n"
+            "fixture: SetUpTestCase\n"
+            "fixture: first saw 1\n"
+            "fixture: second saw 1\n"
+            "fixture: TearDownTestCase\n"
+            "fixture: SetUpTestCase\n"
+            "fixture: first saw 1\n"
+            "fixture: second saw 1\n"
+            "fixture: TearDownTestCase\n"
+            "fixture: environment TearDown\n",
+            LinesWith(output, "fixture: "));
+}
+
+TEST(XmlOutput, ClosesStartTagBeforePassingTestsOutput) {
+  // Only a failed test's output is captured in a run, so this one's is
+  // handed to the printer directly.
+  ScratchFile file;
+  testing::internal::StreamingXmlPrinter* const printer =
+      testing::internal::StreamingXmlPrinter::Create(file.path());
+  const testing::TestInfo& test_info =
+      *testing::UnitTest::GetInstance()->current_test_info();
+  testing::TestResult* const result =
+      const_cast<testing::TestResult*>(test_info.result());
+  testing::internal::TestResultAccessor::set_captured_output(
+      result, "printed while passing\n");
+  printer->OnTestEnd(test_info);
+  testing::internal::TestResultAccessor::set_captured_output(result, "");
+  delete printer;
+
+  const std::string xml = file.Read();
+  EXPECT_EQ(true, IsWellFormedXml(xml));
+  EXPECT_EQ(1, CountOf(xml, "<system-out><![CDATA[printed while passing"));
+}
+
+TEST(XmlOutput, WritesWellFormedReport) {
+  ScratchFile file;
+  const std::string flags =
+      "--gtest_capture_output --gtest_output=xml:" + file.path();
+  RunChild("fail", flags.c_str());
+  const std::string xml = file.Read();
+  EXPECT_EQ(true, IsWellFormedXml(xml));
+  EXPECT_EQ(1, CountOf(xml, "<failure message="));
+  EXPECT_EQ(1, CountOf(xml, "<system-out><![CDATA[printed by Child.Prints"));
+  EXPECT_EQ(1, CountOf(xml, "<testcase name=\"Hangs\""));
+}
+
+TEST(JsonLinesOutput, KeepsNulsInOutput) {
+  ScratchFile file;
+  const std::string flags =
+      "--gtest_capture_output --gtest_output=jsonl:" + file.path();
+  RunChild("fail", flags.c_str());
+  EXPECT_EQ(1, CountOf(file.Read(), "\"output\":\"printed by Child.Prints\\n"
+                       "<b>\\u0000</b>\\n\""));
+}
+
+TEST(Stress, RepeatsOnlySelectedTests) {
+  const std::string selected = RunChild("run",
+      "--gtest_stress_threads=2 --gtest_repeat=3 "
+      "--gtest_stress_filter=Child.Prints");
+  EXPECT_EQ(3, CountOf(selected, "printed by Child.Prints"));
+  const std::string others = RunChild("run",
+      "--gtest_stress_threads=2 --gtest_repeat=3 "
+      "--gtest_stress_filter=-Child.Prints");
+  EXPECT_EQ(1, CountOf(others, "printed by Child.Prints"));
+
+  // Child.LosesUpdate runs its own threads, so it's never stressed.
+  ScratchFile file;
+  const std::string flags =
+      "--gtest_stress_threads=2 --gtest_output=jsonl:" + file.path();
+  RunChild("run", flags.c_str());
+  EXPECT_EQ(3, CountOf(file.Read(), "\"key\":\"stress_repetitions\""));
+}
+
+TEST(BinaryOutput, MergesShards) {
+  // Child.Hangs runs in both, and Child.Prints fails in the first.
+  ScratchFile first;
+  ScratchFile second;
+  RunChild("fail", ("--gtest_output=bin:" + first.path()).c_str());
+  RunChild("run", ("--gtest_filter=Child.Hangs:Hello.* --gtest_output=bin:" +
+                   second.path()).c_str());
+  const std::string files = first.path() + " " + second.path();
+
+  const std::string summary = RunTool("mygtest-merge", files);
+  EXPECT_EQ(1, CountOf(summary, "Merged 2 file(s): 6 of "));
+  EXPECT_EQ(1, CountOf(summary, "tests ran, 5 passed, 1 failed"));
+  EXPECT_EQ(1, CountOf(summary, "[  FAILED  ] Child.Prints\n"));
+
+  ScratchFile xml;
+  RunTool("mygtest-merge", "--xml=" + xml.path() + " " + files);
+  const std::string report = xml.Read();
+  EXPECT_EQ(true, IsWellFormedXml(report));
+  EXPECT_EQ(6, CountOf(report, "<testcase "));
+  EXPECT_EQ(1, CountOf(report, "<testcase name=\"Hangs\""));
+  EXPECT_EQ(1, CountOf(report, "<failure message="));
+  EXPECT_EQ(1, CountOf(report, "<testsuite name=\"Hello\" tests=\"2\""));
+}
+
+TEST(StatsFile, CountsTheFinishedRun) {
+  ScratchFile file;
+  RunChild("fail", ("--gtest_stats_file=" + file.path()).c_str());
+  const std::string contents = file.Read();
+  testing::internal::LiveStatsFile stats;
+  EXPECT_EQ(sizeof(stats), contents.size());
+  if (contents.size() != sizeof(stats))
+    return;
+  memcpy(&stats, contents.data(), sizeof(stats));
+  testing::internal::LiveStatsCounters counters;
+  EXPECT_EQ(true, testing::internal::ReadSeqlocked(&stats.counters,
+                                                   &counters));
+  EXPECT_EQ(0, strcmp(testing::internal::kLiveStatsMagic, stats.magic));
+  EXPECT_EQ(4, static_cast<int>(counters.total_test_count));
+  EXPECT_EQ(4, static_cast<int>(counters.tests_run));
+  EXPECT_EQ(3, static_cast<int>(counters.tests_passed));
+  EXPECT_EQ(1, static_cast<int>(counters.tests_failed));
+  EXPECT_EQ(1, static_cast<int>(counters.finished));
+  EXPECT_EQ(0, static_cast<int>(stats.workers[0].test_start_nanos));
+
+  const std::string top = RunTool("mygtest-top", "--once " + file.path());
+  EXPECT_EQ(1, CountOf(top, "tests   4 / 4 run, 3 passed, 1 failed"));
+  EXPECT_EQ(1, CountOf(top, "finished"));
+}
+
+TEST(StreamTo, DeliversEveryEventToTheCollector) {
+  // The collector prints the events it gets and exits once the child's
+  // stream ends; the child only connects once the socket exists.
+  ScratchFile file;
+  const std::string socket = file.path() + ".sock";
+  const std::string collected = OutputOf(
+      ToolCommand("mygtest-collect", "--exit-after=1 unix:" + socket) +
+      " & while [ ! -S " + socket + " ]; do sleep 0.01; done; " +
+      ChildCommand("fail", "--gtest_stream_to=unix:" + socket) +
+      " >/dev/null 2>&1; wait");
+  unlink(socket.c_str());
+  EXPECT_EQ(1, CountOf(collected, " start 4 tests\n"));
+  EXPECT_EQ(1, CountOf(collected, " part test.cpp:"));
+  EXPECT_EQ(1, CountOf(collected, " FAILED Child.Prints "));
+  EXPECT_EQ(3, CountOf(collected, " passed Child."));
+  EXPECT_EQ(1, CountOf(collected, " end: 3 passed, 1 failed, "));
+  EXPECT_EQ(1, CountOf(collected, ", 0 events dropped"));
+}
+
+TEST(Shuffle, RepeatsOrderAndSeedsFromRandomSeed) {
+  const std::string first = RunChild("seed",
+      "--gtest_shuffle --gtest_random_seed=1");
+  const std::string second = RunChild("seed",
+      "--gtest_shuffle --gtest_random_seed=1");
+  const std::string other = RunChild("seed",
+      "--gtest_shuffle --gtest_random_seed=2");
+  const std::string order = LinesWith(first, "[ RUN      ]");
+  const std::string seed = LinesWith(first, "random_seed() is");
+  EXPECT_EQ(4, CountOf(order, "Child."));
+  EXPECT_EQ(1, CountOf(seed, "random_seed() is"));
+  EXPECT_EQ(order, LinesWith(second, "[ RUN      ]"));
+  EXPECT_EQ(seed, LinesWith(second, "random_seed() is"));
+  EXPECT_NE(order, LinesWith(other, "[ RUN      ]"));
+  EXPECT_NE(seed, LinesWith(other, "random_seed() is"));
+}
+
+// Returns a benchmark baseline with every sample multiplied by factor.
+static std::string ScaleBaseline(const std::string& baseline, double factor) {
+  std::istringstream input(baseline);
+  std::ostringstream output;
+  std::string line;
+  while (std::getline(input, line)) {
+    std::istringstream words(line);
+    std::string keyword, key;
+    int count = 0;
+    if (words >> keyword >> key >> count && keyword == "bench") {
+      output << keyword << " " << key << " " << count;
+      double sample;
+      while (words >> sample)
+        output << " " << sample * factor;
+      output << "\n";
+    } else {
+      output << line << "\n";
+    }
+  }
+  return output.str();
+}
+
+TEST(BenchmarkBaseline, TellsFasterAndSlowerApart) {
+  ScratchFile file;
+  const std::string save = "--gtest_filter=ChildBenchmark.* "
+      "--gtest_benchmark_save_baseline=" + file.path();
+  RunChild("run", save.c_str());
+  const std::string baseline = file.Read();
+  EXPECT_EQ(1, CountOf(baseline, "bench ChildBenchmark.Spins"));
+
+  // Four samples a side that don't overlap give the smallest p-value,
+  // 2 / C(8, 4).
+  const std::string compare = "--gtest_filter=ChildBenchmark.* "
+      "--gtest_benchmark_fail_on_regression=5% "
+      "--gtest_benchmark_baseline=" + file.path();
+  FILE* const slow = fopen(file.path().c_str(), "w");
+  fputs(ScaleBaseline(baseline, 1000).c_str(), slow);
+  fclose(slow);
+  const std::string faster = RunChild("run", compare.c_str());
+  EXPECT_EQ(1, CountOf(faster, ": faster "));
+  EXPECT_EQ(1, CountOf(faster, "(p=0.029, 4 vs 4 samples)"));
+  EXPECT_EQ(0, CountOf(faster, "regressed"));
+
+  FILE* const fast = fopen(file.path().c_str(), "w");
+  fputs(ScaleBaseline(baseline, 0.001).c_str(), fast);
+  fclose(fast);
+  const std::string slower = RunChild("run", compare.c_str());
+  EXPECT_EQ(1, CountOf(slower, ": slower "));
+  EXPECT_EQ(1, CountOf(slower, "(p=0.029, 4 vs 4 samples)"));
+  EXPECT_EQ(1, CountOf(slower, "regressed by"));
+  EXPECT_EQ(2, CountOf(slower, "[  FAILED  ] \033[mChildBenchmark.Spins"));
+}
+
+TEST(BenchmarkNoise, NeedsTwoRepetitions) {
+  const std::string once = RunChild("run",
+      "--gtest_filter=Counter.IncrementLatency");
+  EXPECT_EQ(1, CountOf(once, "noise n/a (n=1)"));
+  const std::string repeated = RunChild("run",
+      "--gtest_filter=ChildBenchmark.*");
+  EXPECT_EQ(0, CountOf(repeated, "noise n/a"));
+  EXPECT_EQ(1, CountOf(repeated, "(n=4)"));
+}
+
+// Prints every event it gets, so a child run shows which reach it.
+template <int kEvents>
+class EventPrinter : public testing::SelectiveTestEventListener<kEvents> {
+ public:
+  explicit EventPrinter(const char* name) : name_(name) {}
+
+  virtual void OnTestProgramStart(const testing::UnitTest&) {
+    Print("OnTestProgramStart");
+  }
+  virtual void OnTestIterationStart(const testing::UnitTest&, int) {
+    Print("OnTestIterationStart");
+  }
+  virtual void OnEnvironmentsSetUpStart(const testing::UnitTest&) {
+    Print("OnEnvironmentsSetUpStart");
+  }
+  virtual void OnEnvironmentsSetUpEnd(const testing::UnitTest&) {
+    Print("OnEnvironmentsSetUpEnd");
+  }
+  virtual void OnTestCaseStart(const testing::TestCase&) {
+    Print("OnTestCaseStart");
+  }
+  virtual void OnTestStart(const testing::TestInfo&) { Print("OnTestStart"); }
+  virtual void OnTestPartResult(const testing::TestPartResult&) {
+    Print("OnTestPartResult");
+  }
+  virtual void OnTestEnd(const testing::TestInfo&) { Print("OnTestEnd"); }
+  virtual void OnTestCaseEnd(const testing::TestCase&) {
+    Print("OnTestCaseEnd");
+  }
+  virtual void OnEnvironmentsTearDownStart(const testing::UnitTest&) {
+    Print("OnEnvironmentsTearDownStart");
+  }
+  virtual void OnEnvironmentsTearDownEnd(const testing::UnitTest&) {
+    Print("OnEnvironmentsTearDownEnd");
+  }
+  virtual void OnTestIterationEnd(const testing::UnitTest&, int) {
+    Print("OnTestIterationEnd");
+  }
+  virtual void OnTestProgramEnd(const testing::UnitTest&) {
+    Print("OnTestProgramEnd");
+  }
+
+ private:
+  void Print(const char* event) { printf("%s got %s\n", name_, event); }
+
+  const char* const name_;
+};
+
+// In mode "listen", one printer says which events it handles and another
+// is appended with a mask narrower than what it says.
+static bool AppendEventPrinters() {
+  if (strcmp(ChildMode(), "listen") != 0)
+    return false;
+  testing::TestEventListeners& listeners =
+      testing::UnitTest::GetInstance()->listeners();
+  listeners.Append(
+      new EventPrinter<testing::kOnTestStart | testing::kOnTestEnd>(
+          "selective"));
+  listeners.Append(new EventPrinter<testing::kAllTestEvents>("masked"),
+                   testing::kOnTestProgramEnd);
+  return true;
+}
+
+static const bool event_printers_appended = AppendEventPrinters();
+
+TEST(Child, Prints) {
+  if (InChild())
+    printf("printed by Child.Prints\n");
+  if (strcmp(ChildMode(), "seed") == 0) {
+    printf("Child.Prints's random_seed() is %d\n",
+           testing::UnitTest::GetInstance()->current_test_info()->
+               random_seed());
+  }
+  // Fails with markup and a NUL in its output, for the reports that keep
+  // a failed test's output.
+  if (strcmp(ChildMode(), "fail") == 0) {
+    static const char kOutput[] = "<b>\0</b>\n";
+    fwrite(kOutput, 1, sizeof(kOutput) - 1, stdout);
+    EXPECT_EQ(0, 1);
+  }
+}
+
+TEST_WITH_TIMEOUT(Child, Hangs, 200) {
+  if (strcmp(ChildMode(), "hang") == 0) {
+    for (;;)
+      pause();
+  }
+}
+
+TEST(Child, Crashes) {
+  if (strcmp(ChildMode(), "crash") == 0)
+    abort();
+}
+
+// Two threads each add one with a load and a store, unguarded, so a
+// schedule that switches between one's load and its store loses an update.
+TEST_INTERLEAVE(Child, LosesUpdate) {
+  if (strcmp(ChildMode(), "race") != 0)
+    return;
+  testing::InterleavedAtomic<int> count(0);
+  for (int i = 0; i < 2; ++i)
+    Spawn([&count] { count.store(count.load() + 1); });
+  Join();
+  EXPECT_EQ(2, count.load());
+}
+
+// A benchmark for the baseline comparison, outside Child so the other
+// child runs skip it.
+BENCHMARK_WITH(ChildBenchmark, Spins,
+               testing::BenchmarkOptions().Iterations(1000).Repetitions(4)) {
+  int spins = 0;
+  while (state.KeepRunning())
+    __atomic_fetch_add(&spins, 1, __ATOMIC_RELAXED);
+}
+
+// Prints its setup and the shared state each test sees, in mode "fixture".
+// Outside Child, so the other child runs skip it.
+class ChildFixture : public testing::Test {
+ protected:
+  static void SetUpTestCase() {
+    shared_ = 1;
+    Print("SetUpTestCase");
+  }
+
+  static void TearDownTestCase() { Print("TearDownTestCase"); }
+
+  static void Print(const std::string& what) {
+    if (strcmp(ChildMode(), "fixture") == 0)
+      printf("fixture: %s\n", what.c_str());
+  }
+
+  // Sees the state SetUpTestCase set, changes it and says what it saw.
+  static void Use(const char* test) {
+    Print(std::string(test) + " saw " + std::to_string(shared_++));
+  }
+
+  static int shared_;
+};
+
+int ChildFixture::shared_ = 0;
+
+// Sets up and tears down around the whole run, in mode "fixture".
+class ChildEnvironment : public testing::Environment {
+ public:
+  virtual void SetUp() { printf("fixture: environment SetUp\n"); }
+  virtual void TearDown() { printf("fixture: environment TearDown\n"); }
+};
+
+static bool AddChildEnvironment() {
+  if (strcmp(ChildMode(), "fixture") != 0)
+    return false;
+  testing::AddGlobalTestEnvironment(new ChildEnvironment);
+  return true;
+}
+
+static const bool child_environment_added = AddChildEnvironment();
+
+TEST_F(ChildFixture, first) { Use("first"); }
+
+TEST_F(ChildFixture, second) { Use("second"); }
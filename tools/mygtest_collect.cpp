@@ -0,0 +1,229 @@
+// A reference collector for --gtest_stream_to.
+//
+//   tools/mygtest-collect [--quiet] [--exit-after=N] unix:path | tcp:port
+//
+// Accepts any number of test programs at once and prints each event on a
+// line starting with the sender's pid, then a summary line when a program
+// ends.  --quiet prints only the summaries.  --exit-after=N exits once N
+// programs have ended, with status 1 if any test failed.
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "gtest_stream.h"
+
+namespace {
+
+using testing::internal::Int64;
+using testing::internal::StreamFrameHeader;
+using testing::internal::StreamFrameReader;
+
+struct Sender {
+  int fd;
+  Int64 pid;
+  Int64 tests_passed;
+  Int64 tests_failed;
+  Int64 dropped;
+  std::string input;
+};
+
+int Listen(const std::string& target) {
+  int fd = -1;
+  if (target.compare(0, 5, "unix:") == 0) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    const std::string path = target.substr(5);
+    if (path.empty() || path.size() >= sizeof(address.sun_path))
+      return -1;
+    memcpy(address.sun_path, path.c_str(), path.size());
+    unlink(path.c_str());
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && bind(fd, reinterpret_cast<struct sockaddr*>(&address),
+                        sizeof(address)) != 0) {
+      close(fd);
+      return -1;
+    }
+  } else if (target.compare(0, 4, "tcp:") == 0) {
+    const int port = atoi(target.c_str() + 4);
+    if (port <= 0 || port > 65535)
+      return -1;
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    const int reuse = 1;
+    if (fd >= 0 &&
+        (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0 ||
+         bind(fd, reinterpret_cast<struct sockaddr*>(&address),
+              sizeof(address)) != 0)) {
+      close(fd);
+      return -1;
+    }
+  }
+  if (fd >= 0 && listen(fd, SOMAXCONN) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Handles one frame.  Returns true when it ends the sender's program.
+bool HandleFrame(Sender* sender, const StreamFrameHeader& header,
+                 const char* payload, bool quiet) {
+  StreamFrameReader reader(payload, header.payload_size);
+  Int64 a = 0, b = 0, c = 0;
+  std::string name, test;
+  switch (header.type) {
+    case testing::internal::kStreamProgramStart:
+      if (reader.Read(&a) && reader.Read(&sender->pid) && reader.Read(&b) &&
+          reader.Read(&c) && !quiet)
+        printf("%lld start %lld tests\n", static_cast<long long>(sender->pid),
+               static_cast<long long>(c));
+      return false;
+    case testing::internal::kStreamTestPartResult:
+      if (reader.Read(&a) && reader.Read(&name) && reader.Read(&b) &&
+          reader.Read(&test) && !quiet)
+        printf("%lld part %s:%lld\n%s\n", static_cast<long long>(sender->pid),
+               name.c_str(), static_cast<long long>(b), test.c_str());
+      return false;
+    case testing::internal::kStreamTestEnd:
+      if (reader.Read(&a) && reader.Read(&name) && reader.Read(&test) &&
+          reader.Read(&b) && reader.Read(&c)) {
+        ++(b ? sender->tests_passed : sender->tests_failed);
+        if (!quiet)
+          printf("%lld %s %s.%s (%lld ms)\n",
+                 static_cast<long long>(sender->pid), b ? "passed" : "FAILED",
+                 name.c_str(), test.c_str(), static_cast<long long>(c));
+      }
+      return false;
+    case testing::internal::kStreamDropped:
+      if (reader.Read(&a))
+        sender->dropped += a;
+      return false;
+    case testing::internal::kStreamProgramEnd:
+      if (reader.Read(&a) && reader.Read(&b) && reader.Read(&c))
+        printf("%lld end: %lld passed, %lld failed, %lld ms, %lld events "
+               "dropped\n", static_cast<long long>(sender->pid),
+               static_cast<long long>(a), static_cast<long long>(b),
+               static_cast<long long>(c),
+               static_cast<long long>(sender->dropped));
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Handles every whole frame in the sender's input.  Returns the number of
+// programs that ended.
+int HandleInput(Sender* sender, bool quiet) {
+  int ended = 0;
+  size_t offset = 0;
+  StreamFrameHeader header;
+  while (sender->input.size() - offset >= sizeof(header)) {
+    memcpy(&header, sender->input.data() + offset, sizeof(header));
+    if (sender->input.size() - offset - sizeof(header) < header.payload_size)
+      break;
+    if (HandleFrame(sender, header,
+                    sender->input.data() + offset + sizeof(header), quiet))
+      ++ended;
+    offset += sizeof(header) + header.payload_size;
+  }
+  sender->input.erase(0, offset);
+  fflush(stdout);
+  return ended;
+}
+
+int Usage() {
+  fprintf(stderr, "Usage: mygtest-collect [--quiet] [--exit-after=N] "
+          "unix:path | tcp:port\n");
+  return 2;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  bool quiet = false;
+  int exit_after = 0;
+  const char* target = NULL;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--quiet") == 0)
+      quiet = true;
+    else if (strncmp(argv[i], "--exit-after=", 13) == 0)
+      exit_after = atoi(argv[i] + 13);
+    else if (argv[i][0] != '-' && target == NULL)
+      target = argv[i];
+    else
+      return Usage();
+  }
+  if (target == NULL)
+    return Usage();
+
+  const int listener = Listen(target);
+  if (listener < 0) {
+    fprintf(stderr, "Unable to listen on %s: %s\n", target, strerror(errno));
+    return 2;
+  }
+
+  std::vector<Sender> senders;
+  std::vector<struct pollfd> polled;
+  int ended = 0;
+  Int64 failed = 0;
+  char buffer[64 * 1024];
+  while (exit_after == 0 || ended < exit_after) {
+    polled.resize(senders.size() + 1);
+    polled[0].fd = listener;
+    polled[0].events = POLLIN;
+    for (size_t i = 0; i < senders.size(); ++i) {
+      polled[i + 1].fd = senders[i].fd;
+      polled[i + 1].events = POLLIN;
+    }
+    if (poll(&polled[0], polled.size(), -1) < 0 && errno != EINTR) {
+      perror("poll");
+      return 2;
+    }
+
+    for (size_t i = polled.size() - 1; i > 0; --i) {
+      if (polled[i].revents == 0)
+        continue;
+      Sender& sender = senders[i - 1];
+      const ssize_t got = read(sender.fd, buffer, sizeof(buffer));
+      if (got > 0) {
+        sender.input.append(buffer, got);
+        ended += HandleInput(&sender, quiet);
+        continue;
+      }
+      if (got < 0 && errno == EINTR)
+        continue;
+      failed += sender.tests_failed;
+      close(sender.fd);
+      senders.erase(senders.begin() + (i - 1));
+    }
+
+    if (polled[0].revents & POLLIN) {
+      const int fd = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+      if (fd >= 0) {
+        const Sender sender = { fd, 0, 0, 0, 0, std::string() };
+        senders.push_back(sender);
+      }
+    }
+  }
+
+  for (size_t i = 0; i < senders.size(); ++i)
+    failed += senders[i].tests_failed;
+  if (strncmp(target, "unix:", 5) == 0)
+    unlink(target + 5);
+  return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,371 @@
+// Merges result files written with --gtest_output=bin into one report.
+//
+//   tools/mygtest-merge [--xml=path | --json=path] file...
+//
+// Without an option it prints a summary and the failed tests.  All files
+// must come from the same test program, typically one per shard.  A test
+// found in several files is reported once, as failed if it failed in any.
+//
+// The files are mapped, not parsed, and tests are matched by id, so the
+// merge takes time linear in the number of records.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "gtest_output.h"
+#include "gtest_result_file.h"
+
+namespace {
+
+using testing::internal::BinaryPartRecord;
+using testing::internal::BinaryResultFile;
+using testing::internal::BinaryTestRecord;
+using testing::internal::Int64;
+using testing::internal::JsonLinesPrinter;
+using testing::internal::StreamingXmlPrinter;
+using testing::internal::UInt32;
+
+const size_t kWriteBytes = 64 * 1024;
+
+struct Occurrence {
+  const BinaryResultFile* file;
+  const BinaryTestRecord* record;
+};
+
+// Tests grouped by test case, each test with all of its occurrences.
+struct MergedResults {
+  std::vector<Occurrence> occurrences;  // Ordered by test id.
+  std::vector<UInt32> test_begin;       // Per id, into occurrences.
+  std::vector<std::string> case_names;
+  std::vector<UInt32> case_begin;       // Per case, into tests.
+  std::vector<UInt32> tests;            // Ids, grouped by case.
+  std::vector<bool> test_failed;
+  std::vector<Int64> test_time;
+  int failed_test_count;
+  Int64 elapsed_time;
+};
+
+MergedResults Merge(const std::vector<BinaryResultFile*>& files) {
+  const UInt32 id_count = files[0]->header().registered_test_count;
+  MergedResults merged;
+  merged.failed_test_count = 0;
+  merged.elapsed_time = 0;
+
+  // Counting sort of every record by id.
+  merged.test_begin.assign(id_count + 1, 0);
+  for (size_t f = 0; f < files.size(); ++f) {
+    for (UInt32 i = 0; i < files[f]->header().record_count; ++i)
+      ++merged.test_begin[files[f]->test(i).id + 1];
+  }
+  for (UInt32 id = 0; id < id_count; ++id)
+    merged.test_begin[id + 1] += merged.test_begin[id];
+  std::vector<UInt32> next(merged.test_begin.begin(),
+                           merged.test_begin.end() - 1);
+  merged.occurrences.resize(merged.test_begin[id_count]);
+  for (size_t f = 0; f < files.size(); ++f) {
+    for (UInt32 i = 0; i < files[f]->header().record_count; ++i) {
+      const BinaryTestRecord& record = files[f]->test(i);
+      const Occurrence occurrence = { files[f], &record };
+      merged.occurrences[next[record.id]++] = occurrence;
+    }
+  }
+
+  // Test cases are numbered in the order their first test was registered,
+  // and their tests bucketed the same way.
+  std::unordered_map<std::string, UInt32> case_ids;
+  std::vector<UInt32> test_case(id_count);
+  merged.test_failed.assign(id_count, false);
+  merged.test_time.assign(id_count, 0);
+  for (UInt32 id = 0; id < id_count; ++id) {
+    if (merged.test_begin[id] == merged.test_begin[id + 1])
+      continue;
+    for (UInt32 i = merged.test_begin[id]; i < merged.test_begin[id + 1];
+         ++i) {
+      merged.test_failed[id] = merged.test_failed[id] ||
+          merged.occurrences[i].record->failed != 0;
+      merged.test_time[id] += merged.occurrences[i].record->elapsed_time;
+    }
+    merged.failed_test_count += merged.test_failed[id] ? 1 : 0;
+    merged.elapsed_time += merged.test_time[id];
+
+    const Occurrence& first = merged.occurrences[merged.test_begin[id]];
+    const std::string name = first.file->string(first.record->case_name);
+    const std::pair<std::unordered_map<std::string, UInt32>::iterator, bool>
+        inserted = case_ids.insert(std::make_pair(
+            name, static_cast<UInt32>(merged.case_names.size())));
+    if (inserted.second)
+      merged.case_names.push_back(name);
+    test_case[id] = inserted.first->second;
+  }
+
+  merged.case_begin.assign(merged.case_names.size() + 1, 0);
+  for (UInt32 id = 0; id < id_count; ++id) {
+    if (merged.test_begin[id] != merged.test_begin[id + 1])
+      ++merged.case_begin[test_case[id] + 1];
+  }
+  for (size_t c = 0; c < merged.case_names.size(); ++c)
+    merged.case_begin[c + 1] += merged.case_begin[c];
+  next.assign(merged.case_begin.begin(), merged.case_begin.end() - 1);
+  merged.tests.resize(merged.case_begin.back());
+  for (UInt32 id = 0; id < id_count; ++id) {
+    if (merged.test_begin[id] != merged.test_begin[id + 1])
+      merged.tests[next[test_case[id]]++] = id;
+  }
+  return merged;
+}
+
+const BinaryTestRecord& FirstRecord(const MergedResults& merged, UInt32 id) {
+  return *merged.occurrences[merged.test_begin[id]].record;
+}
+
+const char* TestName(const MergedResults& merged, UInt32 id) {
+  const Occurrence& first = merged.occurrences[merged.test_begin[id]];
+  return first.file->string(first.record->name);
+}
+
+std::string FormatSeconds(Int64 millis) {
+  char text[32];
+  snprintf(text, sizeof(text), "%lld.%03d",
+           static_cast<long long>(millis / 1000),
+           static_cast<int>(millis % 1000));
+  return text;
+}
+
+std::string FormatInt(Int64 value) {
+  char text[24];
+  snprintf(text, sizeof(text), "%lld", static_cast<long long>(value));
+  return text;
+}
+
+// Buffers a report, writing it out in large pieces.
+class ReportWriter {
+ public:
+  explicit ReportWriter(int fd) : fd_(fd), ok_(true) {}
+
+  std::string* buffer() { return &buffer_; }
+
+  void MaybeWrite() {
+    if (buffer_.size() >= kWriteBytes)
+      Write();
+  }
+
+  bool Finish() {
+    Write();
+    return ok_;
+  }
+
+ private:
+  void Write() {
+    ok_ = testing::internal::WriteAll(fd_, buffer_.data(), buffer_.size()) &&
+        ok_;
+    buffer_.clear();
+  }
+
+  const int fd_;
+  bool ok_;
+  std::string buffer_;
+};
+
+void WriteXml(const MergedResults& merged, ReportWriter* writer) {
+  std::string& out = *writer->buffer();
+  out += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<testsuites tests=\"" +
+      FormatInt(merged.tests.size()) + "\" failures=\"" +
+      FormatInt(merged.failed_test_count) +
+      "\" disabled=\"0\" errors=\"0\" time=\"" +
+      FormatSeconds(merged.elapsed_time) + "\" name=\"AllTests\">\n";
+  for (size_t c = 0; c < merged.case_names.size(); ++c) {
+    int failures = 0;
+    Int64 time = 0;
+    for (UInt32 t = merged.case_begin[c]; t < merged.case_begin[c + 1]; ++t) {
+      failures += merged.test_failed[merged.tests[t]] ? 1 : 0;
+      time += merged.test_time[merged.tests[t]];
+    }
+    out += "  <testsuite name=\"";
+    StreamingXmlPrinter::AppendEscaped(&out, merged.case_names[c].c_str(),
+                                       true);
+    out += "\" tests=\"" +
+        FormatInt(merged.case_begin[c + 1] - merged.case_begin[c]) +
+        "\" failures=\"" + FormatInt(failures) +
+        "\" disabled=\"0\" errors=\"0\" time=\"" + FormatSeconds(time) +
+        "\">\n";
+
+    for (UInt32 t = merged.case_begin[c]; t < merged.case_begin[c + 1]; ++t) {
+      const UInt32 id = merged.tests[t];
+      out += "    <testcase name=\"";
+      StreamingXmlPrinter::AppendEscaped(&out, TestName(merged, id), true);
+      out += "\" status=\"run\" time=\"" + FormatSeconds(merged.test_time[id]) +
+          "\" classname=\"";
+      StreamingXmlPrinter::AppendEscaped(&out, merged.case_names[c].c_str(),
+                                         true);
+      out += '"';
+      if (!merged.test_failed[id]) {
+        out += " />\n";
+        writer->MaybeWrite();
+        continue;
+      }
+
+      out += ">\n";
+      for (UInt32 i = merged.test_begin[id]; i < merged.test_begin[id + 1];
+           ++i) {
+        const Occurrence& occurrence = merged.occurrences[i];
+        for (UInt32 p = 0; p < occurrence.record->part_count; ++p) {
+          const BinaryPartRecord& part =
+              occurrence.file->part(occurrence.record->first_part + p);
+          const std::string location =
+              std::string(occurrence.file->string(part.file)) + ":" +
+              FormatInt(part.line);
+          out += "      <failure message=\"";
+          StreamingXmlPrinter::AppendEscaped(&out, location.c_str(), true);
+          out += "\" type=\"\"><![CDATA[";
+          StreamingXmlPrinter::AppendCData(
+              &out, (location + "\n" + occurrence.file->string(part.message))
+                        .c_str());
+          out += "]]></failure>\n";
+        }
+      }
+      out += "    </testcase>\n";
+      writer->MaybeWrite();
+    }
+    out += "  </testsuite>\n";
+  }
+  out += "</testsuites>\n";
+}
+
+void WriteJson(const MergedResults& merged, ReportWriter* writer) {
+  std::string& out = *writer->buffer();
+  out += "{\"tests\":" + FormatInt(merged.tests.size()) +
+      ",\"failures\":" + FormatInt(merged.failed_test_count) +
+      ",\"time_ms\":" + FormatInt(merged.elapsed_time) + ",\"testsuites\":[";
+  for (size_t c = 0; c < merged.case_names.size(); ++c) {
+    out += c == 0 ? "\n{\"name\":" : ",\n{\"name\":";
+    JsonLinesPrinter::AppendString(&out, merged.case_names[c].c_str());
+    out += ",\"tests\":[";
+    for (UInt32 t = merged.case_begin[c]; t < merged.case_begin[c + 1]; ++t) {
+      const UInt32 id = merged.tests[t];
+      const BinaryTestRecord& record = FirstRecord(merged, id);
+      out += t == merged.case_begin[c] ? "\n  {\"name\":" : ",\n  {\"name\":";
+      JsonLinesPrinter::AppendString(&out, TestName(merged, id));
+      out += ",\"id\":" + FormatInt(record.id) + ",\"status\":\"" +
+          (merged.test_failed[id] ? "failed" : "passed") + "\",\"time_ms\":" +
+          FormatInt(merged.test_time[id]) + ",\"failures\":[";
+      bool first_part = true;
+      for (UInt32 i = merged.test_begin[id]; i < merged.test_begin[id + 1];
+           ++i) {
+        const Occurrence& occurrence = merged.occurrences[i];
+        for (UInt32 p = 0; p < occurrence.record->part_count; ++p) {
+          const BinaryPartRecord& part =
+              occurrence.file->part(occurrence.record->first_part + p);
+          out += first_part ? "{\"file\":" : ",{\"file\":";
+          first_part = false;
+          JsonLinesPrinter::AppendString(&out, occurrence.file->string(
+              part.file));
+          out += ",\"line\":" + FormatInt(part.line) + ",\"message\":";
+          JsonLinesPrinter::AppendString(&out, occurrence.file->string(
+              part.message));
+          out += '}';
+        }
+      }
+      out += "]}";
+      writer->MaybeWrite();
+    }
+    out += "]}";
+  }
+  out += "\n]}\n";
+}
+
+void PrintSummary(const MergedResults& merged, size_t file_count,
+                  UInt32 registered_test_count) {
+  printf("Merged %d file(s): %d of %d registered tests ran, %d passed, "
+         "%d failed (%s s).\n", static_cast<int>(file_count),
+         static_cast<int>(merged.tests.size()),
+         static_cast<int>(registered_test_count),
+         static_cast<int>(merged.tests.size()) - merged.failed_test_count,
+         merged.failed_test_count, FormatSeconds(merged.elapsed_time).c_str());
+  for (size_t c = 0; c < merged.case_names.size(); ++c) {
+    for (UInt32 t = merged.case_begin[c]; t < merged.case_begin[c + 1]; ++t) {
+      if (merged.test_failed[merged.tests[t]]) {
+        printf("[  FAILED  ] %s.%s\n", merged.case_names[c].c_str(),
+               TestName(merged, merged.tests[t]));
+      }
+    }
+  }
+}
+
+int Usage() {
+  fprintf(stderr,
+          "Usage: mygtest-merge [--xml=path | --json=path] file...\n");
+  return 2;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::string xml_path;
+  std::string json_path;
+  std::vector<BinaryResultFile*> files;
+  const char* first_path = NULL;
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--xml=", 6) == 0) {
+      xml_path = argv[i] + 6;
+      continue;
+    }
+    if (strncmp(argv[i], "--json=", 7) == 0) {
+      json_path = argv[i] + 7;
+      continue;
+    }
+    if (argv[i][0] == '-')
+      return Usage();
+
+    std::string error;
+    first_path = first_path == NULL ? argv[i] : first_path;
+    files.push_back(new BinaryResultFile);
+    if (!files.back()->Open(argv[i], &error)) {
+      fprintf(stderr, "%s\n", error.c_str());
+      return 2;
+    }
+    if (files.back()->header().registry_hash !=
+            files[0]->header().registry_hash ||
+        files.back()->header().registered_test_count !=
+            files[0]->header().registered_test_count) {
+      fprintf(stderr, "%s: written by a different test program than %s\n",
+              argv[i], first_path);
+      return 2;
+    }
+  }
+  if (files.empty() || (!xml_path.empty() && !json_path.empty()))
+    return Usage();
+
+  const MergedResults merged = Merge(files);
+  const std::string& path = xml_path.empty() ? json_path : xml_path;
+  if (path.empty()) {
+    PrintSummary(merged, files.size(),
+                 files[0]->header().registered_test_count);
+  } else {
+    const int fd = open(path.c_str(),
+                        O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0) {
+      fprintf(stderr, "%s: %s\n", path.c_str(), strerror(errno));
+      return 2;
+    }
+    ReportWriter writer(fd);
+    if (!xml_path.empty())
+      WriteXml(merged, &writer);
+    else
+      WriteJson(merged, &writer);
+    if (!writer.Finish() || close(fd) != 0) {
+      fprintf(stderr, "%s: %s\n", path.c_str(), strerror(errno));
+      return 2;
+    }
+  }
+
+  for (size_t i = 0; i < files.size(); ++i)
+    delete files[i];
+  return merged.failed_test_count == 0 ? 0 : 1;
+}
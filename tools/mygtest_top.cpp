@@ -0,0 +1,164 @@
+// Shows the live statistics of a run started with --gtest_stats_file.
+//
+//   tools/mygtest-top [--once] [--interval=ms] stats_file
+//
+// The file is mapped read-only and copied under its seqlocks, so watching
+// a run doesn't slow it down.  Exits once the run has finished.
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+
+#include "gtest_stats.h"
+
+namespace {
+
+using testing::internal::Int64;
+using testing::internal::LiveStatsCounters;
+using testing::internal::LiveStatsFile;
+using testing::internal::LiveStatsWorker;
+using testing::internal::kLiveStatsThroughputSeconds;
+
+// Throughput is averaged over this many whole seconds.
+const int kRateSeconds = 10;
+
+// Tests finished per second over the last whole seconds.
+double Rate(const LiveStatsCounters& counters, Int64 now) {
+  const Int64 current = (now - counters.start_nanos) / 1000000000;
+  const Int64 seconds = std::min<Int64>(kRateSeconds, current);
+  if (seconds <= 0)
+    return 0.0;
+
+  Int64 finished = 0;
+  for (Int64 s = current - seconds; s < current; ++s) {
+    // Buckets the writer hasn't reached yet are stale.
+    if (s <= counters.throughput_second &&
+        s > counters.throughput_second - kLiveStatsThroughputSeconds)
+      finished += counters.throughput[s % kLiveStatsThroughputSeconds];
+  }
+  return static_cast<double>(finished) / seconds;
+}
+
+std::string FormatDuration(Int64 nanos) {
+  const Int64 seconds = nanos / 1000000000;
+  char text[32];
+  snprintf(text, sizeof(text), "%lld:%02d:%02d",
+           static_cast<long long>(seconds / 3600),
+           static_cast<int>(seconds / 60 % 60), static_cast<int>(seconds % 60));
+  return text;
+}
+
+void Show(const LiveStatsFile& file, const LiveStatsCounters& counters,
+          bool clear_screen) {
+  const Int64 now = testing::internal::GetTimeInNanos();
+  const Int64 elapsed =
+      (counters.finished ? counters.update_nanos : now) - counters.start_nanos;
+  // A finished run is summed up by its average.
+  const double rate = !counters.finished ? Rate(counters, now) :
+      elapsed <= 0 ? 0.0 : counters.tests_run * 1e9 / elapsed;
+  const Int64 remaining = counters.total_test_count > counters.tests_run ?
+      counters.total_test_count - counters.tests_run : 0;
+
+  if (clear_screen)
+    printf("\033[H\033[2J");
+  printf("pid %lld  %s  elapsed %s\n", static_cast<long long>(counters.pid),
+         counters.finished ? "finished" :
+             (kill(static_cast<pid_t>(counters.pid), 0) == 0 ? "running" :
+                                                               "gone"),
+         FormatDuration(elapsed).c_str());
+  printf("tests   %llu / %u run, %llu passed, %llu failed\n",
+         static_cast<unsigned long long>(counters.tests_run),
+         counters.total_test_count,
+         static_cast<unsigned long long>(counters.tests_passed),
+         static_cast<unsigned long long>(counters.tests_failed));
+  printf("rate    %.1f tests/s", rate);
+  if (!counters.finished)
+    printf(" over %d s", kRateSeconds);
+  if (rate > 0 && !counters.finished) {
+    printf(", about %s left",
+           FormatDuration(static_cast<Int64>(remaining / rate * 1e9)).c_str());
+  }
+  printf("\n\n");
+
+  for (unsigned int i = 0; i < counters.worker_count &&
+           i < file.worker_slots; ++i) {
+    LiveStatsWorker worker;
+    if (!testing::internal::ReadSeqlocked(&file.workers[i], &worker))
+      continue;
+    worker.current_test[sizeof(worker.current_test) - 1] = '\0';
+    if (worker.test_start_nanos == 0) {
+      printf("worker %-3u idle\n", i);
+    } else {
+      printf("worker %-3u %s  %s\n", i,
+             FormatDuration(now - worker.test_start_nanos).c_str(),
+             worker.current_test);
+    }
+  }
+  fflush(stdout);
+}
+
+int Usage() {
+  fprintf(stderr,
+          "Usage: mygtest-top [--once] [--interval=ms] stats_file\n");
+  return 2;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  bool once = false;
+  long interval_ms = 1000;
+  const char* path = NULL;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--once") == 0)
+      once = true;
+    else if (strncmp(argv[i], "--interval=", 11) == 0)
+      interval_ms = atol(argv[i] + 11);
+    else if (argv[i][0] != '-' && path == NULL)
+      path = argv[i];
+    else
+      return Usage();
+  }
+  if (path == NULL || interval_ms <= 0)
+    return Usage();
+
+  const int fd = open(path, O_RDONLY | O_CLOEXEC);
+  struct stat status;
+  if (fd < 0 || fstat(fd, &status) != 0 ||
+      status.st_size < static_cast<off_t>(sizeof(LiveStatsFile))) {
+    fprintf(stderr, "%s: not a stats file\n", path);
+    return 2;
+  }
+  const LiveStatsFile* const file = static_cast<const LiveStatsFile*>(
+      mmap(NULL, sizeof(LiveStatsFile), PROT_READ, MAP_SHARED, fd, 0));
+  close(fd);
+  if (file == MAP_FAILED ||
+      memcmp(file->magic, testing::internal::kLiveStatsMagic,
+             sizeof(file->magic)) != 0 ||
+      file->version != testing::internal::kLiveStatsVersion) {
+    fprintf(stderr, "%s: not a stats file\n", path);
+    return 2;
+  }
+
+  const struct timespec pause = { interval_ms / 1000,
+                                  interval_ms % 1000 * 1000000 };
+  const bool clear_screen = !once && isatty(STDOUT_FILENO);
+  for (;;) {
+    LiveStatsCounters counters;
+    if (testing::internal::ReadSeqlocked(&file->counters, &counters)) {
+      Show(*file, counters, clear_screen);
+      if (once || counters.finished)
+        return 0;
+    }
+    nanosleep(&pause, NULL);
+  }
+}